@@ -0,0 +1,155 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace lmu
+{
+	// Binary checkpoint data. Values are stored in the native byte order, checkpoints are not meant to be moved between machines.
+	class CheckpointWriter
+	{
+	public:
+
+		template<typename T>
+		void write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written.");
+			_data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template<typename T>
+		void write(const std::vector<T>& values)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only vectors of trivially copyable values can be written.");
+			write<uint64_t>(values.size());
+			_data.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+		}
+
+		void write(const std::string& value)
+		{
+			write<uint64_t>(value.size());
+			_data.append(value);
+		}
+
+		const std::string& data() const
+		{
+			return _data;
+		}
+
+		std::string& data()
+		{
+			return _data;
+		}
+
+	private:
+		std::string _data;
+	};
+
+	// Reads what a CheckpointWriter wrote, in the same order. Throws if the data ends too early.
+	class CheckpointReader
+	{
+	public:
+
+		explicit CheckpointReader(std::string data) :
+			_data(std::move(data)),
+			_pos(0)
+		{
+		}
+
+		template<typename T>
+		T read()
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read.");
+			T value;
+			std::memcpy(&value, take(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		template<typename T>
+		std::vector<T> readVector()
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only vectors of trivially copyable values can be read.");
+			uint64_t size = read<uint64_t>();
+			if (size > (_data.size() - _pos) / sizeof(T))
+				throw std::runtime_error("Checkpoint is truncated.");
+
+			std::vector<T> values(size);
+			std::memcpy(values.data(), take(size * sizeof(T)), size * sizeof(T));
+			return values;
+		}
+
+		std::string readString()
+		{
+			uint64_t size = read<uint64_t>();
+			if (size > _data.size() - _pos)
+				throw std::runtime_error("Checkpoint is truncated.");
+
+			return std::string(take(size), size);
+		}
+
+		bool atEnd() const
+		{
+			return _pos == _data.size();
+		}
+
+	private:
+
+		const char* take(size_t size)
+		{
+			if (size > _data.size() - _pos)
+				throw std::runtime_error("Checkpoint is truncated.");
+
+			const char* p = _data.data() + _pos;
+			_pos += size;
+			return p;
+		}
+
+		std::string _data;
+		size_t _pos;
+	};
+
+	// Replaces the file at once: data is written to file.tmp first, which is then renamed. Readers never see a partially written file.
+	// Returns false (and logs a warning) if that fails.
+	bool writeFileAtomically(const std::string& file, const std::string& data);
+
+	// file with the fingerprint (hex) inserted before the extension, e.g. run.ckpt => run.1a2b3c.ckpt.
+	// Runs on different inputs (e.g. the partitions of a model) then write different files.
+	std::string fingerprintedFile(const std::string& file, uint64_t fingerprint);
+
+	// Writes checkpoints to a file in the background. The file is replaced atomically (writeFileAtomically),
+	// so it always holds a complete checkpoint. Only one write is in flight, the next one waits for it.
+	class AsyncCheckpointFile
+	{
+	public:
+
+		explicit AsyncCheckpointFile(const std::string& file);
+		// Waits for the pending write.
+		~AsyncCheckpointFile();
+
+		AsyncCheckpointFile(const AsyncCheckpointFile&) = delete;
+		AsyncCheckpointFile& operator=(const AsyncCheckpointFile&) = delete;
+
+		void write(std::string data);
+		void wait();
+
+		// Waits for the pending write and deletes the file.
+		void remove();
+
+		// Returns false if there is no checkpoint file.
+		bool read(std::string& data) const;
+
+		std::string file() const;
+
+	private:
+		std::string _file;
+		std::future<void> _pendingWrite;
+	};
+}
+
+#endif
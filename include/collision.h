@@ -2,16 +2,30 @@
 #define COLLISION_H
 
 namespace lmu
-{	
+{
 	struct ImplicitFunction;
 	struct IFSphere;
+	struct IFCylinder;
+	struct IFBox;
 	struct Mesh;
-	
+
+	// Dispatches to the analytic tests below. Cones are tested via a conservative bounding cylinder.
+	// Only Null (or otherwise unsupported, e.g. sheared) primitives fall back to the mesh-mesh check.
+	// All analytic tests are volume tests, i.e. a primitive fully contained in another one collides.
 	bool collides(const lmu::ImplicitFunction& f1, const lmu::ImplicitFunction& f2);
 
 	bool collides(const lmu::IFSphere& f1, const lmu::IFSphere& f2);
 
+	// Exact closest point tests.
+	bool collides(const lmu::IFSphere& f1, const lmu::IFBox& f2);
+	bool collides(const lmu::IFSphere& f1, const lmu::IFCylinder& f2);
+
+	// Separating axis tests. Exact for box-box, conservative (may report false positives) if cylinders are involved.
+	bool collides(const lmu::IFBox& f1, const lmu::IFBox& f2);
+	bool collides(const lmu::IFCylinder& f1, const lmu::IFBox& f2);
+	bool collides(const lmu::IFCylinder& f1, const lmu::IFCylinder& f2);
+
 	bool collides(const lmu::Mesh& m1, const lmu::Mesh& m2);
 }
 
-#endif
\ No newline at end of file
+#endif
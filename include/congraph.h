@@ -2,6 +2,9 @@
 #define CONGRAPH_H
 
 #include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
 #include <Eigen/Core>
 
 #include <boost/graph/graph_traits.hpp>
@@ -87,6 +90,55 @@ namespace lmu
 		}
 	};
 			
+	// Compact, read-only compressed sparse row representation of a Graph. 
+	// Vertex ids are the vertex indices of the source graph, edge ids number the undirected edges.
+	// Small graphs additionally get a bit matrix for constant time adjacency tests.
+	struct CSRGraph
+	{
+		static const int maxBitMatrixVertices = 2048;
+
+		std::vector<std::shared_ptr<lmu::ImplicitFunction>> functions;
+
+		// Neighbors of v (sorted) are targets[offsets[v]] ... targets[offsets[v+1]-1], edgeIds holds the corresponding edge ids.
+		std::vector<int> offsets;
+		std::vector<int> targets;
+		std::vector<int> edgeIds;
+		int numEdges;
+
+		// Row v has wordsPerRow 64 bit words, bit w is set if v and w are adjacent. Empty for large graphs.
+		std::vector<std::uint64_t> adjacency;
+		int wordsPerRow;
+
+		int numVertices() const
+		{
+			return (int)functions.size();
+		}
+
+		int degree(int v) const
+		{
+			return offsets[v + 1] - offsets[v];
+		}
+
+		bool areConnected(int v, int w) const
+		{
+			if (!adjacency.empty())
+				return (adjacency[v * wordsPerRow + (w >> 6)] >> (w & 63)) & 1;
+
+			return std::binary_search(targets.begin() + offsets[v], targets.begin() + offsets[v + 1], w);
+		}
+	};
+
+	CSRGraph createCSRGraph(const lmu::Graph& g);
+
+	// Creates a graph from the given vertices (in the given order) and all edges between them for which edgeEnabled is set (indexed by edge id, all edges if empty).
+	lmu::Graph createGraph(const CSRGraph& g, const std::vector<int>& vertices, const std::vector<char>& edgeEnabled = std::vector<char>());
+
+	// Returns the number of connected components, component ids are ordered by their smallest vertex id.
+	int connectedComponents(const CSRGraph& g, std::vector<int>& component, const std::vector<char>& edgeEnabled = std::vector<char>());
+
+	// Returns the number of biconnected components and stores the component id of each edge. 
+	int biconnectedComponents(const CSRGraph& g, std::vector<int>& edgeComponent, std::vector<int>& articulationPoints);
+
 	VertexDescriptor addVertex(lmu::Graph& g, const std::shared_ptr<lmu::ImplicitFunction>& f);
 	EdgeDescriptor addEdge(lmu::Graph& g, const VertexDescriptor& v1, const VertexDescriptor& v2);
 
@@ -105,6 +157,15 @@ namespace lmu
 
 	void writeConnectionGraph(const std::string& file, const lmu::Graph& graph);
 
+	// Called for each maximal clique together with the clique's vertex ids. Calls are serialized but may come from different threads.
+	// Enumeration waits for the call, so heavy work per clique should be handed to the thread pool (e.g. a TaskGroup).
+	using CliqueCallback = std::function<void(const lmu::Clique& clique, const std::vector<int>& vertices)>;
+
+	// Streams all maximal cliques with at least minCliqueSize vertices to callback as soon as they are found.
+	// Bron-Kerbosch with Tomita pivoting on adjacency bitsets, the outer loop runs in degeneracy order and in parallel.
+	void enumerateCliques(const lmu::Graph& graph, const CliqueCallback& callback, int minCliqueSize = 2);
+
+	// All maximal cliques with at least 2 vertices, sorted by vertex ids.
 	std::vector<lmu::Clique> getCliques(const lmu::Graph& graph);	
 
 	std::vector<std::shared_ptr<lmu::ImplicitFunction>> getImplicitFunctions(const lmu::Graph& graph);
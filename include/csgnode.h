@@ -253,6 +253,8 @@ namespace lmu
 	int depth(const CSGNode& node, int curDepth = 0);
 	int numNodes(const CSGNode& node);
 	int numPoints(const CSGNode& node);
+	// Unlike CSGNode::hash(), the result does not depend on the run: geometries are identified by their function's name and commutative operands are ordered.
+	size_t canonicalHash(const CSGNode& node, size_t seed = 0);
 	CSGNode* nodePtrAt(CSGNode& node, int idx);
 	int depthAt(const CSGNode& node, int idx);
 	std::vector<CSGNodePtr> allGeometryNodePtrs(const CSGNode& node);
@@ -302,6 +304,20 @@ namespace lmu
 			return *this;
 		}
 
+		//Moves take over the tree without cloning it. The moved-from node is empty.
+		CSGNode(CSGNode&& node) noexcept :
+			_node(std::move(node._node))
+		{
+		}
+
+		CSGNode& operator = (CSGNode&& other) noexcept
+		{
+			if (this != &other)
+				_node = std::move(other._node);
+
+			return *this;
+		}
+
 		inline virtual CSGNodePtr clone() const override final
 		{
 			return _node ? _node->clone() : nullptr;
@@ -523,6 +539,9 @@ namespace lmu
 
 	double computeGeometryScore(const CSGNode& node, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs);
 
+	// Contribution of a single point (with normal) to the geometry score, in [0, 2].
+	double computePointScore(const CSGNode& node, const Eigen::Vector3d& p, const Eigen::Vector3d& n, double epsilon, double alpha, double h);
+
 	double computeRawDistanceScore(const CSGNode& node, const Eigen::MatrixXd& points);
 	
 	void writeNode(const CSGNode& node, const std::string& file);
@@ -556,6 +575,11 @@ namespace lmu
 
 	SerializedCSGNode serializeNode(CSGNode& node);
 
+	// Compact preorder encoding to send trees to other processes: operations are stored as type and number of children, 
+	// geometries as -(index + 1) into functions. Node names are not stored. Throws if a function is not in functions.
+	std::vector<int> serializeCSGNode(const CSGNode& node, const std::vector<ImplicitFunctionPtr>& functions);
+	CSGNode deserializeCSGNode(const std::vector<int>& data, const std::vector<ImplicitFunctionPtr>& functions);
+
 	struct CommonSubgraph
 	{
 		CommonSubgraph(CSGNode* n1Root, CSGNode* n2Root, const std::vector<CSGNode*>& n1Appearances, const std::vector<CSGNode*>& n2Appearances, int size) :
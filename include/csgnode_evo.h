@@ -14,6 +14,7 @@
 namespace lmu
 {
 	struct ImplicitFunction;
+	class WorkerProcesses;
 
 	struct CSGNodeRanker
 	{
@@ -22,13 +23,47 @@ namespace lmu
 		double rank(const CSGNode& node) const;
 		double rank(const CSGNode& node, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions) const;
 
+		// Racing: ranks on a growing subsample with the same share of every function's points (stratified) and stops with an estimate 
+		// as soon as the upper confidence bound of the rank is below cutoff. Otherwise, and if racing is not used, the rank is exact.
+		double rank(const CSGNode& node, double cutoff, RaceOutcome& outcome) const;
+
+		// Relative ranking cost: every point is evaluated on every node of the tree.
+		double estimateCost(const CSGNode& node) const;
+
+		// Hash of the parameters and functions (incl. points) the rank depends on. Used as context of persistently cached ranks.
+		size_t fingerprint() const;
+
+		// From now on, rank(node) ranks in numWorkers local processes. Copies of the ranker made afterwards share the processes.
+		// Trees that fail to rank in a worker or take longer than timeoutMilliseconds (<= 0 => no limit) get the worst rank,
+		// rank(node, cutoff, outcome) reports them as RaceOutcome::FAILED.
+		void useWorkerProcesses(int numWorkers, bool pinWorkers, int timeoutMilliseconds = 0);
+
+		// From now on, rank(node, cutoff, outcome) races. The first subsample holds sampleRate of the points and is doubled until the decision is clear.
+		// confidenceZ: half width of the confidence interval in standard deviations. sampleRate <= 0 => no racing. Not used with worker processes.
+		void useRacing(double sampleRate, double confidenceZ);
+
+		// Builds voxel grid subsamples of every function's points: level l holds about 1/reduction^l of the points, level 0 are all points.
+		// Ranks at coarser levels weight each point with the share of points it stands for, so they are comparable to full ranks.
+		// Coarse levels are always ranked in process.
+		void useLevelsOfDetail(int numLevels, double reduction);
+		int numLevelsOfDetail() const;
+		double rankAtLevel(const CSGNode& node, int level) const;
+		// Hash of fingerprint() and the points of the level. Used as context of persistently cached ranks at that level.
+		size_t levelOfDetailFingerprint(int level) const;
+
+		// Points evaluated by all rankings on the calling thread so far (incl. rankings in worker processes it waited for).
+		uint64_t numEvaluatedPoints() const;
+
 		std::string info() const;
 
 		bool treeIsInvalid(const lmu::CSGNode& node) const;
 
 	private:
 
+		// failed: ranking in a worker process failed, the rank is worstRank.
+		double rank(const CSGNode& node, bool& failed) const;
 		double computeEpsilonScale();
+		size_t computeFingerprint() const;
 		double _h;
 		double _lambda;
 		std::vector<std::shared_ptr<lmu::ImplicitFunction>> _functions;
@@ -37,6 +72,16 @@ namespace lmu
 		double _epsilonScale;
 		double _epsilon;
 		double _alpha;
+		size_t _fingerprint;
+		std::shared_ptr<WorkerProcesses> _workers;
+		double _racingSampleRate;
+		double _racingConfidenceZ;
+		//Per function: random order of its point indices, subsamples are prefixes.
+		std::shared_ptr<const std::vector<std::vector<int>>> _racingOrder;
+		//Per level (starting at level 1) and function: the subsampled points.
+		std::shared_ptr<const std::vector<std::vector<PointCloud>>> _levelsOfDetail;
+		//Per level (starting at level 1).
+		std::vector<size_t> _levelOfDetailFingerprints;
 	};
 
 	using MappingFunction = std::function<double(double)>;
@@ -49,15 +94,26 @@ namespace lmu
 		std::vector<CSGNode> crossover(const CSGNode& tree1, const CSGNode& tree2) const;
 		CSGNode create(bool unions = true) const;
 		CSGNode create(int maxDepth) const;
+
+		// Same as above but drawing from the given engine instead of the creator's one. Safe to call concurrently with different engines.
+		CSGNode mutate(const CSGNode& tree, std::default_random_engine& rndEngine) const;
+		std::vector<CSGNode> crossover(const CSGNode& tree1, const CSGNode& tree2, std::default_random_engine& rndEngine) const;
+		CSGNode create(std::default_random_engine& rndEngine, bool unions = true) const;
+		CSGNode create(int maxDepth, std::default_random_engine& rndEngine) const;
+
+		// Checkpoints. Trees are stored with indices into the creator's functions.
+		std::vector<int> serialize(const CSGNode& tree) const;
+		CSGNode deserialize(const std::vector<int>& data) const;
+
 		std::string info() const;
 
 	private:
 
-		std::vector<CSGNode> simpleCrossover(const CSGNode& tree1, const CSGNode& tree2) const;
-		std::vector<CSGNode> sharedPrimitiveCrossover(const CSGNode& tree1, const CSGNode& tree2) const;
+		std::vector<CSGNode> simpleCrossover(const CSGNode& tree1, const CSGNode& tree2, std::default_random_engine& rndEngine) const;
+		std::vector<CSGNode> sharedPrimitiveCrossover(const CSGNode& tree1, const CSGNode& tree2, std::default_random_engine& rndEngine) const;
 
-		void create(CSGNode& node, int maxDepth, int curDepth) const;
-		void createUnionTree(CSGNode& node, std::vector<ImplicitFunctionPtr>& funcs) const;
+		void create(CSGNode& node, int maxDepth, int curDepth, std::default_random_engine& rndEngine) const;
+		void createUnionTree(CSGNode& node, std::vector<ImplicitFunctionPtr>& funcs, std::default_random_engine& rndEngine) const;
 
 		int getRndFuncIndex(const std::vector<int>& usedFuncIndices) const;
 
@@ -89,12 +145,17 @@ namespace lmu
 
 		void manipulateBeforeRanking(std::vector<RankedCreature<CSGNode>>& population) const;
 		void manipulateAfterRanking(std::vector<RankedCreature<CSGNode>>& population) const;
+
+		// Same as above but drawing from the given engine instead of the manipulator's one.
+		void manipulateBeforeRanking(std::vector<RankedCreature<CSGNode>>& population, std::default_random_engine& rndEngine) const;
+		void manipulateAfterRanking(std::vector<RankedCreature<CSGNode>>& population, std::default_random_engine& rndEngine) const;
+
 		std::string info() const;
 
 	private: 
 
 		CSGNode getOptimizedTree(std::vector<ImplicitFunctionPtr> funcs) const;
-		std::vector<ImplicitFunctionPtr> getSuitableFunctions(const std::vector<ImplicitFunctionPtr>& funcs) const;
+		std::vector<ImplicitFunctionPtr> getSuitableFunctions(const std::vector<ImplicitFunctionPtr>& funcs, std::default_random_engine& rndEngine) const;
 		double _optimizationProb;
 		double _preOptimizationProb;
 		int _maxFunctions;
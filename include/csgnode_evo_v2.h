@@ -28,6 +28,9 @@ namespace lmu
 		ImplicitFunctionPtr exchangeIF(const lmu::ImplicitFunctionPtr& func);
 		void freeIF(const lmu::ImplicitFunctionPtr& func);
 
+		// Seeds the engine used for random function selection.
+		void seed(std::default_random_engine::result_type value);
+
 		friend std::ostream& operator<<(std::ostream& os, const IFBudgetPerIF& b);
 	
 	private:
@@ -47,15 +50,21 @@ namespace lmu
 		CSGNode mutate(const CSGNode& tree) const;
 		std::vector<CSGNode> crossover(const CSGNode& tree1, const CSGNode& tree2) const;
 		CSGNode create() const;
+
+		// Same as above but drawing from the given engine instead of the creator's one. Safe to call concurrently with different engines.
+		CSGNode mutate(const CSGNode& tree, std::default_random_engine& rndEngine) const;
+		std::vector<CSGNode> crossover(const CSGNode& tree1, const CSGNode& tree2, std::default_random_engine& rndEngine) const;
+		CSGNode create(std::default_random_engine& rndEngine) const;
+
 		void replaceIFs(IFBudget& budget, CSGNode& node) const;
 		
 		std::string info() const;
 
 	private:
 
-		std::vector<CSGNode> simpleCrossover(const CSGNode& tree1, const CSGNode& tree2) const;
-		std::vector<CSGNode> sharedPrimitiveCrossover(const CSGNode& tree1, const CSGNode& tree2) const;
-		void create(lmu::CSGNode & node, IFBudget & budget) const;
+		std::vector<CSGNode> simpleCrossover(const CSGNode& tree1, const CSGNode& tree2, std::default_random_engine& rndEngine) const;
+		std::vector<CSGNode> sharedPrimitiveCrossover(const CSGNode& tree1, const CSGNode& tree2, std::default_random_engine& rndEngine) const;
+		void create(lmu::CSGNode & node, IFBudget & budget, std::default_random_engine& rndEngine) const;
 		
 		double _createNewRandomProb;
 		double _subtreeProb;
@@ -73,13 +82,22 @@ namespace lmu
 		double rank(const CSGNode& node) const;
 		std::string info() const;
 
+		// Relative ranking cost: every point is evaluated on every node of the tree.
+		double estimateCost(const CSGNode& node) const;
+
+		// Hash of the parameters, functions (incl. points) and connections the rank depends on. Used as context of persistently cached ranks.
+		size_t fingerprint() const;
+
 		double computeGeometryScore(const CSGNode& node, const std::vector<ImplicitFunctionPtr>& funcs) const;
 
 	private: 
+		size_t computeFingerprint() const;
+
 		lmu::Graph _connectionGraph;
 		IFBudget _ifBudget;
 		double _sizeWeight;
 		double _h;
+		size_t _fingerprint;
 	};
 
 	using CSGNodeGAV2 = GeneticAlgorithm<CSGNode, CSGNodeCreatorV2, CSGNodeRankerV2, CSGNodeTournamentSelector, CSGNodeNoFitnessIncreaseStopCriterion>;
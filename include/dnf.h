@@ -2,7 +2,9 @@
 #define DNF_H
 
 #include <vector>
-//#include <boost/dynamic_bitset.hpp>
+#include <map>
+#include <mutex>
+#include <boost/dynamic_bitset.hpp>
 #include <boost/container/vector.hpp>
 
 #include "csgnode.h"
@@ -54,19 +56,128 @@ namespace lmu
 	std::ostream& operator <<(std::ostream& stream, const Clause& c);
 
 	struct Graph;
+
+	// Deviation from flatness outlier test of a function's points (see computeOutlierTestValues).
+	// Points with |deviation - median| > maxDelta are considered to be close to an edge.
+	struct OutlierTestValue
+	{
+		double maxDelta;
+		double median;
+
+		// One bit per point of the function, computed once so clause scoring does not need to evaluate curvatures.
+		boost::dynamic_bitset<> outliers;
+	};
+
+	using OutlierTestValues = std::unordered_map<lmu::ImplicitFunctionPtr, OutlierTestValue>;
 	
 	CSGNode DNFtoCSGNode(const DNF& dnf);
 	CSGNode clauseToCSGNode(const Clause& clause, const std::vector<ImplicitFunctionPtr>& functions);
 	
 	std::tuple<Clause, double, double> scoreClause(const Clause& clause, const std::vector<ImplicitFunctionPtr>& functions, 
-		int numClauseFunctions, const std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double, double>>& outlierTestValues, 
+		int numClauseFunctions, const OutlierTestValues& outlierTestValues, 
 		const lmu::Graph& conGraph, const SampleParams& params);
 	
-	std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double, double>> computeOutlierTestValues(const std::vector<lmu::ImplicitFunctionPtr>& functions, double h);
+	// Point sets over the points of a function i describing their relation to a function l.
+	// d_i and d_l are the points' distances to function i and l, delta is the scoring tolerance.
+	struct ClausePointSets
+	{
+		boost::dynamic_bitset<> inside;          // d_l < -delta
+		boost::dynamic_bitset<> outside;         // d_l > delta
+		boost::dynamic_bitset<> notAbove;        // d_l - d_i <= delta
+		boost::dynamic_bitset<> notAboveNeg;     // -d_l - d_i <= delta
+		boost::dynamic_bitset<> notBelow;        // d_l - d_i >= -delta
+		boost::dynamic_bitset<> notBelowNeg;     // -d_l - d_i >= -delta
+
+		// Sign of l's gradient * point normal. Only set for points where l can define a clause's surface.
+		boost::dynamic_bitset<> gradientAligned; // > 0
+		boost::dynamic_bitset<> gradientOpposed; // < 0
+	};
+
+	// Point classification computed once per set of functions.
+	// Scoring a clause against the table only needs bit set operations instead of distance function evaluations.
+	struct ClauseScoringTable
+	{
+		std::vector<ImplicitFunctionPtr> functions;
+		
+		// Index i * functions.size() + l.
+		std::vector<ClausePointSets> pointSets;
+		std::vector<char> connected;
+
+		// Points of function i that are not close to a curvature outlier (== edge).
+		std::vector<boost::dynamic_bitset<>> flat;
+
+		// Distances of the points of function i (rows) to all functions (cols). 
+		// Needed to resolve points that lie on the surface of more than one literal.
+		std::vector<Eigen::MatrixXd> distances;
+
+		size_t index(size_t i, size_t l) const
+		{
+			return i * functions.size() + l;
+		}
+	};
+
+	ClauseScoringTable createClauseScoringTable(const std::vector<ImplicitFunctionPtr>& functions,
+		const OutlierTestValues& outlierTestValues,
+		const lmu::Graph& conGraph, const SampleParams& params);
+
+	// Creates a table for a subset of the table's functions without re-evaluating any distance function.
+	ClauseScoringTable createClauseScoringTable(const ClauseScoringTable& table, const std::vector<ImplicitFunctionPtr>& functions);
+
+	// Same scores as the scoreClause overload above with numClauseFunctions == functions.size().
+	std::tuple<Clause, double, double> scoreClause(const Clause& clause, const ClauseScoringTable& table);
+
+	OutlierTestValues computeOutlierTestValues(const std::vector<lmu::ImplicitFunctionPtr>& functions, double h);
+
+	// Results of the Shapiro stages that only depend on a function (and its neighborhood) and not on the remaining functions.
+	// Shared by all stages of a run (partitioning by prime implicants, Shapiro per partition, Shapiro in the GA) and thread-safe.
+	// Results are only kept while a Scope is open and dropped when the last one ends, without an open scope nothing is cached.
+	// Functions are identified by their fingerprint (type, parameters and points), not by pointer.
+	class ShapiroCache
+	{
+	public:
+
+		// Open for the duration of a run, e.g. by the entry functions below. Scopes can be nested and opened concurrently.
+		class Scope
+		{
+		public:
+			Scope();
+			~Scope();
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		};
+
+		bool getOutlierTestValue(const ImplicitFunctionPtr& func, double h, OutlierTestValue& value) const;
+		void addOutlierTestValue(const ImplicitFunctionPtr& func, double h, const OutlierTestValue& value);
+
+		// Scores (point check, angle check) of the clause that only contains func. 
+		// neighbors are the functions func is connected to (only their points are checked by the point check).
+		bool getSingleLiteralScores(const ImplicitFunctionPtr& func, const std::vector<ImplicitFunctionPtr>& neighbors, double h, std::tuple<double, double>& scores) const;
+		void addSingleLiteralScores(const ImplicitFunctionPtr& func, const std::vector<ImplicitFunctionPtr>& neighbors, double h, const std::tuple<double, double>& scores);
+
+		static ShapiroCache& instance();
+
+	private:
+
+		using FunctionKey = std::tuple<size_t, double>;
+
+		static FunctionKey key(const ImplicitFunctionPtr& func, double h);
+		static std::vector<size_t> keys(const std::vector<ImplicitFunctionPtr>& funcs);
+
+		mutable std::mutex _mutex;
+		int _numScopes = 0;
+		std::map<FunctionKey, OutlierTestValue> _outlierTestValues;
+		std::map<std::tuple<FunctionKey, std::vector<size_t>>, std::tuple<double, double>> _singleLiteralScores;
+	};
 
 	DNF computeShapiro(const std::vector<ImplicitFunctionPtr>& functions, bool usePrimeImplicantOptimization, const lmu::Graph& conGraph, const SampleParams& params);
 	DNF mergeDNFs(const std::vector<DNF>& dnfs);
 
+	// Two-level logic minimization (Espresso-style expand, irredundant and reduce loop). 
+	// The result describes the same set as the input with fewer (or equal) clauses and literals.
+	// Clauses keep at least one literal.
+	DNF minimizeDNF(const DNF& dnf);
+
 	std::string espressoExpression(const DNF& dnf);
 
 	CSGNode computeShapiroWithPartitions(const std::vector<Graph>& partitions, const SampleParams& params);
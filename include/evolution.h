@@ -7,6 +7,7 @@
 #include <random>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <atomic>
 #include <future>
 #include <chrono>
@@ -14,11 +15,15 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
 #include <unordered_map>
 
-#include <omp.h>
-
+#include "checkpoint.h"
 #include "helper.h"
+#include "log.h"
+#include "metrics.h"
+#include "rankcache.h"
+#include "threadpool.h"
 
 namespace lmu
 {
@@ -82,6 +87,78 @@ namespace lmu
 		}
 	};
 
+	// Schedule of the level of detail creatures are ranked at (level 0 is full resolution, higher levels are coarser).
+	// Runs start at the coarsest level and go one level finer whenever the best rank did not increase by more than delta 
+	// for maxIterationsWithoutChange generations or the level was used for maxIterationsPerLevel generations.
+	// maxIterationsWithoutChange should be well below the one of the stop criterion. numLevels <= 1 => always full resolution.
+	struct LevelOfDetailSchedule
+	{
+		LevelOfDetailSchedule(int numLevels = 1, int maxIterationsWithoutChange = 10, double delta = 0.01, int maxIterationsPerLevel = 100) :
+			numLevels(numLevels),
+			maxIterationsWithoutChange(maxIterationsWithoutChange),
+			delta(delta),
+			maxIterationsPerLevel(maxIterationsPerLevel)
+		{
+		}
+
+		bool isFinerLevelDue(int iterationsOnLevel, int iterationsWithoutChange) const
+		{
+			return iterationsWithoutChange >= maxIterationsWithoutChange || iterationsOnLevel >= maxIterationsPerLevel;
+		}
+
+		std::string info() const
+		{
+			std::stringstream ss;
+			ss << "Levels of Detail: " << numLevels <<
+				" Max Iterations Without Change: " << maxIterationsWithoutChange <<
+				" Delta: " << delta <<
+				" Max Iterations Per Level: " << maxIterationsPerLevel;
+			return ss.str();
+		}
+
+		int numLevels;
+		int maxIterationsWithoutChange;
+		double delta;
+		int maxIterationsPerLevel;
+	};
+
+	enum class MigrationTopology
+	{
+		RING,
+		FULLY_CONNECTED
+	};
+
+	MigrationTopology migrationTopologyFromString(std::string topology);
+
+	struct IslandParameters
+	{
+		// numIslands <= 1 => one population, no migration.
+		// Every migrationInterval generations, each island receives the migrationSize best creatures of its neighbours: 
+		// the previous island (ring) or all other islands (fully connected, only the migrationSize best of all are taken). 
+		IslandParameters(int numIslands = 1, int migrationInterval = 10, int migrationSize = 2, MigrationTopology topology = MigrationTopology::RING) :
+			numIslands(numIslands),
+			migrationInterval(migrationInterval),
+			migrationSize(migrationSize),
+			topology(topology)
+		{
+		}
+
+		std::string info() const
+		{
+			std::stringstream ss;
+			ss << "Islands: " << numIslands <<
+				" Migration Interval: " << migrationInterval <<
+				" Migration Size: " << migrationSize <<
+				" Migration Topology: " << (topology == MigrationTopology::RING ? "ring" : "fully connected");
+			return ss.str();
+		}
+
+		int numIslands;
+		int migrationInterval;
+		int migrationSize;
+		MigrationTopology topology;
+	};
+
 	template<typename Creature>
 	struct RankedCreature
 	{
@@ -91,6 +168,12 @@ namespace lmu
 		{
 		}		
 
+		RankedCreature(Creature&& c, double rank = unranked()) :
+			creature(std::move(c)),
+			rank(rank)
+		{
+		}
+
 		static double unranked() 
 		{
 			return std::numeric_limits<double>::min();
@@ -114,14 +197,26 @@ namespace lmu
 
 			RankedCreature selectFrom(const std::vector<RankedCreature>& population) const
 			{
-				static std::uniform_int_distribution<> d{};
+				return selectFrom(population, _rndEngine);
+			}
+
+			// Safe to call concurrently with different engines.
+			RankedCreature selectFrom(const std::vector<RankedCreature>& population, std::default_random_engine& rndEngine) const
+			{
+				return population[selectIndexFrom(population, rndEngine)];
+			}
+
+			// Index of the selected creature, nothing is copied.
+			int selectIndexFrom(const std::vector<RankedCreature>& population, std::default_random_engine& rndEngine) const
+			{
+				std::uniform_int_distribution<> d{};
 				using parm_t = decltype(d)::param_type;
 
 				bool firstRun = true;
 				int best = 0;				
 				for (int i = 0; i < _k; ++i)
 				{
-					int idx = d(_rndEngine, parm_t{ 0, (int)population.size() - 1 });
+					int idx = d(rndEngine, parm_t{ 0, (int)population.size() - 1 });
 
 					//while (_dropWorstPossible && population[idx].rank == lmu::worstRank)
 					//{
@@ -141,7 +236,7 @@ namespace lmu
 					}
 				}
 
-				return population[best];
+				return best;
 			}
 
 			std::string info() const
@@ -168,7 +263,7 @@ namespace lmu
 
 		bool shouldStop(const std::vector<RankedCreature>& population, int iterationCount) const
 		{
-			std::cout << "Iteration " << iterationCount << " of " << _maxIterations << std::endl;
+			LMU_LOG_INFO("Iteration " << iterationCount << " of " << _maxIterations);
 			return iterationCount >= _maxIterations;
 		}
 
@@ -197,7 +292,7 @@ namespace lmu
 
 		bool shouldStop(const std::vector<RankedCreature>& population, int iterationCount)
 		{
-			std::cout << "Iteration " << iterationCount << std::endl;
+			LMU_LOG_INFO("Iteration " << iterationCount);
 
 			if (iterationCount >= _maxIterations)
 				return true;
@@ -229,6 +324,18 @@ namespace lmu
 			return ss.str();
 		}
 
+		void writeTo(CheckpointWriter& writer) const
+		{
+			writer.write<int32_t>(_currentCount);
+			writer.write(_lastBestRank);
+		}
+
+		void readFrom(CheckpointReader& reader)
+		{
+			_currentCount = reader.read<int32_t>();
+			_lastBestRank = reader.read<double>();
+		}
+
 	private:
 		int _maxCount;
 		int _currentCount;
@@ -237,14 +344,15 @@ namespace lmu
 		double _lastBestRank;
 	};
 
+	// Population manipulators draw from the given engine, which the GA derives from the seed (like the engines of the creators).
 	template<typename RankedCreature>
 	struct EmptyPopulationManipulator
 	{
-		void manipulateBeforeRanking(std::vector<RankedCreature>& population) const
+		void manipulateBeforeRanking(std::vector<RankedCreature>&, std::default_random_engine&) const
 		{
 		}
 
-		void manipulateAfterRanking(std::vector<RankedCreature>& population) const
+		void manipulateAfterRanking(std::vector<RankedCreature>&, std::default_random_engine&) const
 		{
 		}
 
@@ -254,6 +362,201 @@ namespace lmu
 		}
 	};
 
+	// Relative cost of ranking a creature. 
+	// Rankers can provide double estimateCost(const Creature&) const, otherwise all creatures cost the same.
+	template<typename CreatureRanker, typename Creature>
+	auto estimateRankingCost(const CreatureRanker& ranker, const Creature& creature, int) -> decltype(ranker.estimateCost(creature))
+	{
+		return ranker.estimateCost(creature);
+	}
+
+	template<typename CreatureRanker, typename Creature>
+	double estimateRankingCost(const CreatureRanker&, const Creature&, long)
+	{
+		return 1.0;
+	}
+
+	enum class RaceOutcome
+	{
+		NOT_RACED,
+		// Ranked exactly since it may be ranked above the cutoff. 
+		PROMOTED,
+		// Very likely ranked below the cutoff, the rank is an estimate.
+		ELIMINATED,
+		// Ranking failed (e.g. in a worker process), the rank is worstRank for this generation only.
+		FAILED
+	};
+
+	// Only exact ranks are cached, estimates and failed rankings are not.
+	inline bool isExactRank(RaceOutcome outcome)
+	{
+		return outcome == RaceOutcome::NOT_RACED || outcome == RaceOutcome::PROMOTED;
+	}
+
+	inline bool isRaced(RaceOutcome outcome)
+	{
+		return outcome == RaceOutcome::PROMOTED || outcome == RaceOutcome::ELIMINATED;
+	}
+
+	// Ranks the creature, a rank below cutoff may be estimated (racing). 
+	// Rankers can provide double rank(const Creature&, double cutoff, RaceOutcome&) const, otherwise creatures are always ranked exactly.
+	// Rankers report rankings that failed for transient reasons with RaceOutcome::FAILED, so they are ranked again later.
+	template<typename CreatureRanker, typename Creature>
+	auto rankAgainstCutoff(const CreatureRanker& ranker, const Creature& creature, double cutoff, RaceOutcome& outcome, int) -> decltype(ranker.rank(creature, cutoff, outcome))
+	{
+		return ranker.rank(creature, cutoff, outcome);
+	}
+
+	template<typename CreatureRanker, typename Creature>
+	double rankAgainstCutoff(const CreatureRanker& ranker, const Creature& creature, double, RaceOutcome& outcome, long)
+	{
+		outcome = RaceOutcome::NOT_RACED;
+		return ranker.rank(creature);
+	}
+
+	// Checkpoints: creators provide std::vector<int> serialize(const Creature&) const and Creature deserialize(const std::vector<int>&) const.
+	// Stop criteria and population manipulators with state provide void writeTo(CheckpointWriter&) const and void readFrom(CheckpointReader&)
+	// (const for population manipulators, their state is mutable).
+	template<typename CreatureCreator, typename Creature>
+	auto supportsCheckpoints(const CreatureCreator& creator, const Creature* creature, int) -> decltype(creator.deserialize(creator.serialize(*creature)), bool())
+	{
+		return true;
+	}
+
+	template<typename CreatureCreator, typename Creature>
+	bool supportsCheckpoints(const CreatureCreator&, const Creature*, long)
+	{
+		return false;
+	}
+
+	template<typename CreatureCreator, typename Creature>
+	auto serializeCreature(const CreatureCreator& creator, const Creature& creature, int) -> decltype(creator.serialize(creature))
+	{
+		return creator.serialize(creature);
+	}
+
+	template<typename CreatureCreator, typename Creature>
+	std::vector<int> serializeCreature(const CreatureCreator&, const Creature&, long)
+	{
+		throw std::logic_error("Creator does not support checkpoints.");
+	}
+
+	template<typename Creature, typename CreatureCreator>
+	auto deserializeCreature(const CreatureCreator& creator, const std::vector<int>& data, int) -> decltype(creator.deserialize(data))
+	{
+		return creator.deserialize(data);
+	}
+
+	template<typename Creature, typename CreatureCreator>
+	Creature deserializeCreature(const CreatureCreator&, const std::vector<int>&, long)
+	{
+		throw std::logic_error("Creator does not support checkpoints.");
+	}
+
+	template<typename T>
+	auto writeCheckpointState(const T& obj, CheckpointWriter& writer, int) -> decltype(obj.writeTo(writer), void())
+	{
+		obj.writeTo(writer);
+	}
+
+	template<typename T>
+	void writeCheckpointState(const T&, CheckpointWriter&, long)
+	{
+	}
+
+	template<typename T>
+	auto readCheckpointState(T& obj, CheckpointReader& reader, int) -> decltype(obj.readFrom(reader), void())
+	{
+		obj.readFrom(reader);
+	}
+
+	template<typename T>
+	void readCheckpointState(T&, CheckpointReader&, long)
+	{
+	}
+
+	// Metrics: rankers can count the points they evaluate with uint64_t numEvaluatedPoints() const, which returns the total of the calling thread.
+	// A creature is ranked on one thread, so the difference around its ranking is what it cost.
+	template<typename CreatureRanker>
+	auto evaluatedPoints(const CreatureRanker& ranker, int) -> decltype(ranker.numEvaluatedPoints())
+	{
+		return ranker.numEvaluatedPoints();
+	}
+
+	template<typename CreatureRanker>
+	uint64_t evaluatedPoints(const CreatureRanker&, long)
+	{
+		return 0;
+	}
+
+	// Levels of detail: rankers can provide int numLevelsOfDetail() const and double rankAtLevel(const Creature&, int level) const 
+	// (level 0 is full resolution), otherwise creatures are always ranked at full resolution.
+	template<typename CreatureRanker>
+	auto numLevelsOfDetail(const CreatureRanker& ranker, int) -> decltype(ranker.numLevelsOfDetail())
+	{
+		return ranker.numLevelsOfDetail();
+	}
+
+	template<typename CreatureRanker>
+	int numLevelsOfDetail(const CreatureRanker&, long)
+	{
+		return 1;
+	}
+
+	template<typename CreatureRanker, typename Creature>
+	auto rankAtLevelOfDetail(const CreatureRanker& ranker, const Creature& creature, int level, int) -> decltype(ranker.rankAtLevel(creature, level))
+	{
+		return ranker.rankAtLevel(creature, level);
+	}
+
+	template<typename CreatureRanker, typename Creature>
+	double rankAtLevelOfDetail(const CreatureRanker& ranker, const Creature& creature, int, long)
+	{
+		return ranker.rank(creature);
+	}
+
+	// Context of persistently cached ranks at a coarse level of detail: rankers can provide size_t levelOfDetailFingerprint(int level) const,
+	// which has to cover the points of that level. Otherwise (0) ranks at coarse levels are not cached persistently.
+	template<typename CreatureRanker>
+	auto levelOfDetailFingerprint(const CreatureRanker& ranker, int level, int) -> decltype(ranker.levelOfDetailFingerprint(level), uint64_t())
+	{
+		return (uint64_t)ranker.levelOfDetailFingerprint(level);
+	}
+
+	template<typename CreatureRanker>
+	uint64_t levelOfDetailFingerprint(const CreatureRanker&, int, long)
+	{
+		return 0;
+	}
+
+	// Fingerprint of the ranker and its input if it provides size_t fingerprint() const, 0 otherwise.
+	template<typename CreatureRanker>
+	auto rankerFingerprint(const CreatureRanker& ranker, int) -> decltype(ranker.fingerprint(), uint64_t())
+	{
+		return (uint64_t)ranker.fingerprint();
+	}
+
+	template<typename CreatureRanker>
+	uint64_t rankerFingerprint(const CreatureRanker&, long)
+	{
+		return 0;
+	}
+
+	// Key of a persistently cached rank: (ranker fingerprint, run independent creature hash).
+	// Rankers can provide size_t fingerprint() const and creatures a size_t canonicalHash(const Creature&) found by ADL, 
+	// otherwise the context is 0 and ranks are not cached persistently.
+	template<typename CreatureRanker, typename Creature>
+	auto persistentRankKey(const CreatureRanker& ranker, const Creature& creature, int) -> decltype(ranker.fingerprint(), canonicalHash(creature), std::pair<uint64_t, uint64_t>())
+	{
+		return std::make_pair((uint64_t)ranker.fingerprint(), (uint64_t)canonicalHash(creature));
+	}
+
+	template<typename CreatureRanker, typename Creature>
+	std::pair<uint64_t, uint64_t> persistentRankKey(const CreatureRanker&, const Creature&, long)
+	{
+		return std::make_pair((uint64_t)0, (uint64_t)0);
+	}
+
 	template<
 		typename Creature, typename CreatureCreator, typename CreatureRanker,
 		typename ParentSelector = TournamentSelector<RankedCreature<Creature>>,
@@ -268,7 +571,20 @@ namespace lmu
 
 		struct Parameters
 		{
-			Parameters(int populationSize, int numBestParents, double mutationRate, double crossoverRate, bool rankingInParallel, const Schedule& crossoverSchedule, const Schedule& mutationSchedule, bool useCaching) :
+			// seed == 0 => a random seed is drawn for every run.
+			// cacheCapacity: max. number of cached ranks, 0 => unbounded.
+			// persistentCacheFile: if not empty and caching is used, ranks are also cached in this file across runs.
+			// islands: with more than one island, the population size is split evenly between the islands.
+			// levelOfDetailSchedule: only used if the ranker supports levels of detail. Every island follows it on its own.
+			// checkpointFile: if not empty, the state is written to this file every checkpointInterval generations (and when a stop is requested).
+			// The fingerprint of the ranker's input and the GA parameters is inserted into the file name (see fingerprintedFile), so concurrent runs 
+			// on different inputs do not share a file. A run resumes from it if it exists and deletes it when it is done.
+			// metricsFile, prometheusFile: if not empty, metrics of every iteration are streamed to these files (see MetricsSink::open). 
+			// Runs that stream to the same files at the same time are told apart by the fingerprint of the ranker's input.
+			Parameters(int populationSize, int numBestParents, double mutationRate, double crossoverRate, bool rankingInParallel, const Schedule& crossoverSchedule, const Schedule& mutationSchedule, bool useCaching, 
+				unsigned int seed = 0, size_t cacheCapacity = 1 << 20, const std::string& persistentCacheFile = std::string(), const IslandParameters& islands = IslandParameters(), 
+				const LevelOfDetailSchedule& levelOfDetailSchedule = LevelOfDetailSchedule(), const std::string& checkpointFile = std::string(), int checkpointInterval = 10, 
+				const std::string& metricsFile = std::string(), const std::string& prometheusFile = std::string()) :
 				populationSize(populationSize),
 				numBestParents(numBestParents),
 				mutationRate(mutationRate),
@@ -276,7 +592,16 @@ namespace lmu
 				rankingInParallel(rankingInParallel),
 				crossoverSchedule(crossoverSchedule),
 				mutationSchedule(mutationSchedule),
-				useCaching(useCaching)
+				useCaching(useCaching),
+				seed(seed),
+				cacheCapacity(cacheCapacity),
+				persistentCacheFile(persistentCacheFile),
+				islands(islands),
+				levelOfDetailSchedule(levelOfDetailSchedule),
+				checkpointFile(checkpointFile),
+				checkpointInterval(checkpointInterval),
+				metricsFile(metricsFile),
+				prometheusFile(prometheusFile)
 			{
 			}
 
@@ -288,7 +613,16 @@ namespace lmu
 					" Mutation Rate: " << mutationRate <<
 					" Crossover Rate: " << crossoverRate <<
 					" Ranking in parallel: " << rankingInParallel <<
-					" Use Caching: " << useCaching;
+					" Use Caching: " << useCaching <<
+					" Seed: " << seed <<
+					" Cache Capacity: " << cacheCapacity <<
+					" Persistent Cache File: " << persistentCacheFile <<
+					" " << islands.info() <<
+					" " << levelOfDetailSchedule.info() <<
+					" Checkpoint File: " << checkpointFile <<
+					" Checkpoint Interval: " << checkpointInterval <<
+					" Metrics File: " << metricsFile <<
+					" Prometheus File: " << prometheusFile;
 				return ss.str();
 			}
 
@@ -300,6 +634,15 @@ namespace lmu
 			Schedule crossoverSchedule;
 			Schedule mutationSchedule;
 			bool useCaching;
+			unsigned int seed;
+			size_t cacheCapacity;
+			std::string persistentCacheFile;
+			IslandParameters islands;
+			LevelOfDetailSchedule levelOfDetailSchedule;
+			std::string checkpointFile;
+			int checkpointInterval;
+			std::string metricsFile;
+			std::string prometheusFile;
 		};
 
 		struct Statistics
@@ -311,7 +654,14 @@ namespace lmu
 				numCrossovers(0),
 				numCrossoverTries(0),
 				numCacheHits(0),
-				numCacheTries(0)
+				numCacheTries(0),
+				numCacheEvictions(0),
+				numPersistentCacheHits(0),
+				cacheSize(0),
+				numRaces(0),
+				numRacePromotions(0),
+				numEvaluations(0),
+				numEvaluatedPoints(0)
 			{
 			}
 
@@ -323,6 +673,17 @@ namespace lmu
 
 			int numCacheHits; 
 			int numCacheTries;
+			int numCacheEvictions;
+			int numPersistentCacheHits;
+			size_t cacheSize;
+
+			//Creatures ranked against the elite cutoff and how many of them had to be ranked exactly.
+			int numRaces;
+			int numRacePromotions;
+
+			//Rankings that were not taken from a cache and the points they evaluated (if the ranker counts them).
+			int numEvaluations;
+			uint64_t numEvaluatedPoints;
 
 			double bestScore;
 			double worstScore;
@@ -334,6 +695,10 @@ namespace lmu
 			std::vector<long long> optDurations;
 
 			std::vector<long long> scmDurations;
+
+			//Share of the parallel ranking time the pool's workers (and the waiting thread, last entry) spent ranking.
+			std::vector<double> rankingUtilizations;
+			std::vector<double> rankingThreadUtilizations;
 		
 			TimeTicker totalDuration, iterationDuration;
 
@@ -345,17 +710,75 @@ namespace lmu
 
 			void print()
 			{
-				std::cout << "--- Iteration Statistics ---" << std::endl;
-				std::cout << "Mutations: " << numMutations << " Tried: " << numMutationTries << " (" << (double)numMutations / (double)numMutationTries * 100.0 << "%)" << std::endl;
-				std::cout << "Crossovers: " << numCrossovers << " Tried: " << numCrossoverTries << " (" << (double)numCrossovers / (double)numCrossoverTries * 100.0 << "%)" << std::endl;
-				std::cout << "Cache Hits: " << numCacheHits << " Tried: " << numCacheTries << " (" << (double)numCacheHits / (double)numCacheTries * 100.0 << "%)" << std::endl;
+				LMU_LOG_INFO("--- Iteration Statistics ---" << std::endl
+					<< "Mutations: " << numMutations << " Tried: " << numMutationTries << " (" << (double)numMutations / (double)numMutationTries * 100.0 << "%)" << std::endl
+					<< "Crossovers: " << numCrossovers << " Tried: " << numCrossoverTries << " (" << (double)numCrossovers / (double)numCrossoverTries * 100.0 << "%)" << std::endl
+					<< "Cache Hits: " << numCacheHits << " Tried: " << numCacheTries << " (" << (double)numCacheHits / (double)numCacheTries * 100.0 << "%)"
+					<< " Evictions: " << numCacheEvictions << " Size: " << cacheSize << " Persistent Hits: " << numPersistentCacheHits << std::endl
+					<< "Evaluations: " << numEvaluations << " Points: " << numEvaluatedPoints << std::endl
+					<< "Score Best: " << bestScore << " Worst: " << worstScore);
+
+				if (numRaces > 0)
+				{
+					LMU_LOG_INFO("Races: " << numRaces << " Promoted: " << numRacePromotions << " (" << (double)numRacePromotions / (double)numRaces * 100.0 << "%)");
+				}
+
+				if (!rankingThreadUtilizations.empty())
+				{
+					std::stringstream ss;
+					for (double u : rankingThreadUtilizations)
+						ss << " " << (int)(u * 100.0) << "%";
 
-				std::cout << "Score Best: " << bestScore << " Worst: " << worstScore << std::endl;				
+					LMU_LOG_INFO("Ranking Utilization: " << (int)(rankingUtilizations.back() * 100.0) << "% Per Thread:" << ss.str());
+				}
+			}
+
+			//Everything but the info and the durations of the current run.
+			void writeTo(CheckpointWriter& writer) const
+			{
+				for (int counter : { numMutations, numMutationTries, numCrossovers, numCrossoverTries, numCacheHits, numCacheTries, numCacheEvictions, 
+					numPersistentCacheHits, numRaces, numRacePromotions, numEvaluations })
+					writer.write<int32_t>(counter);
+				writer.write<uint64_t>(cacheSize);
+				writer.write<uint64_t>(numEvaluatedPoints);
+
+				writer.write(bestCandidateScores);
+				writer.write(worstCandidateScores);
+				writer.write(rankingDurations);
+				writer.write(sortingDurations);
+				writer.write(optDurations);
+				writer.write(scmDurations);
+				writer.write(rankingUtilizations);
+				writer.write(rankingThreadUtilizations);
+			}
+
+			void readFrom(CheckpointReader& reader)
+			{
+				for (int* counter : { &numMutations, &numMutationTries, &numCrossovers, &numCrossoverTries, &numCacheHits, &numCacheTries, &numCacheEvictions, 
+					&numPersistentCacheHits, &numRaces, &numRacePromotions, &numEvaluations })
+					*counter = reader.read<int32_t>();
+				cacheSize = reader.read<uint64_t>();
+				numEvaluatedPoints = reader.read<uint64_t>();
+
+				bestCandidateScores = reader.readVector<double>();
+				worstCandidateScores = reader.readVector<double>();
+				rankingDurations = reader.readVector<long long>();
+				sortingDurations = reader.readVector<long long>();
+				optDurations = reader.readVector<long long>();
+				scmDurations = reader.readVector<long long>();
+				rankingUtilizations = reader.readVector<double>();
+				rankingThreadUtilizations = reader.readVector<double>();
+
+				update();
 			}
 
 			void save(const std::string& file, const Creature* bestCreature = nullptr)
 			{
-				std::cout << "Save statistics to file " << file << "." << std::endl;
+				//GAs of different partitions may run in parallel and write to the same file.
+				static std::mutex saveMutex;
+				std::lock_guard<std::mutex> lock(saveMutex);
+
+				LMU_LOG_INFO("Save statistics to file " << file << ".");
 
 				std::ofstream fs(file);
 
@@ -378,12 +801,13 @@ namespace lmu
 
 					fs << bestCreature->info() << std::endl;
 
-					fs << "# iteration    best candidate score    worst candidate score    optimization durations    ranking durations    sorting durations    scm durations" << std::endl;
+					fs << "# iteration    best candidate score    worst candidate score    optimization durations    ranking durations    sorting durations    scm durations    ranking utilization" << std::endl;
 				}
 
 				for (int i = 0; i < bestCandidateScores.size(); ++i)
 				{
-					fs << i << " " << bestCandidateScores[i] << " " << worstCandidateScores[i] << " " << optDurations[i] << " " << rankingDurations[i] << " "  << sortingDurations[i] << " " << scmDurations[i] << std::endl;
+					fs << i << " " << bestCandidateScores[i] << " " << worstCandidateScores[i] << " " << optDurations[i] << " " << rankingDurations[i] << " "  << sortingDurations[i] << " " << scmDurations[i] << " " 
+						<< rankingUtilizations[i] << std::endl;
 				}
 
 				fs.close();
@@ -396,8 +820,8 @@ namespace lmu
 			{
 			}
 
-			Result(const std::vector<RankedCreature>& population, const Statistics& statistics) :
-				population(population),
+			Result(std::vector<RankedCreature> population, const Statistics& statistics) :
+				population(std::move(population)),
 				statistics(statistics)
 			{
 			}
@@ -408,12 +832,11 @@ namespace lmu
 
 		GeneticAlgorithm()
 		{
-			_rndEngine.seed(_rndDevice());
 		}
 	
 		void stop()
 		{
-			std::cout << "Stop requested." << std::endl;
+			LMU_LOG_INFO("Stop requested.");
 			_stopRequested.store(true);
 		}
 
@@ -445,236 +868,1126 @@ namespace lmu
 			const CreatureRanker& ranker, StopCriterion& stopCriterion, const PopulationManipulator& popMan) const
 		{
 			Statistics stats(assembleInfoString(params, parentSelector, creator, ranker, stopCriterion, popMan));
-	
-			auto population = createRandomPopulation(params.populationSize, creator);
-		
-			std::cout << "Random population with " << population.size() << " creatures was created." << std::endl;
 
-			int iterationCount = 0;
+			//All random decisions of creation and offspring generation are derived from this seed.
+			const unsigned int seed = params.seed != 0 ? params.seed : _rndDevice();
+			LMU_LOG_INFO("Seed: " << seed);
+
+			_rankLookup.setCapacity(params.cacheCapacity);
 			_stopRequested.store(false);
 
-			double crossoverRate = params.crossoverRate;
-			double mutationRate = params.mutationRate;
+			if (params.islands.numIslands > 1)
+				return runIslands(params, parentSelector, creator, ranker, stopCriterion, popMan, seed, stats);
+	
+			Island island(0, stopCriterion, stats, params, seed, initialLevelOfDetail(params, ranker));
+			std::vector<Island*> islands = { &island };
 
-			while (!stopCriterion.shouldStop(population, iterationCount) && !_stopRequested.load())			
+			auto checkpoint = openCheckpoint(params, creator, ranker);
+			if (checkpoint && loadCheckpoint(*checkpoint, islands, creator, popMan))
 			{
-				std::cout << "Start iteration " << std::endl;
-				stats.iterationDuration.reset();
-				
-				std::cout << "Optimize population." << std::endl;
-				popMan.manipulateBeforeRanking(population);
-				stats.optDurations.push_back(stats.iterationDuration.tick());
+				LMU_LOG_INFO("Resumed from checkpoint " << checkpoint->file.file() << " at iteration " << island.iterationCount << ".");
+			}
+			else
+			{
+				island.population = createRandomPopulation(params.populationSize, creator, seed, params.rankingInParallel);
+				LMU_LOG_INFO("Random population with " << island.population.size() << " creatures was created.");
+			}
 
-				std::cout << "Rank population." << std::endl;
-				rankPopulation(population, ranker, params.rankingInParallel, params.useCaching, stats);
-				stats.rankingDurations.push_back(stats.iterationDuration.tick());
+			auto persistentCache = openPersistentCache(params, ranker, island.population);
+			auto metrics = openMetrics(params);
 
-				sortPopulation(population);
-				stats.sortingDurations.push_back(stats.iterationDuration.tick());
+			while (!island.stopped && !_stopRequested.load())
+			{
+				iterate(island, params, parentSelector, creator, ranker, popMan, persistentCache.get(), metrics.get());
 
-				popMan.manipulateAfterRanking(population);
+				if (checkpoint && !island.stopped && island.iterationCount % params.checkpointInterval == 0)
+					saveCheckpoint(*checkpoint, islands, creator, popMan);
+			}
+
+			finishCheckpoints(checkpoint.get(), islands, creator, popMan);
+
+			finishAtFullResolution(island, params, ranker, persistentCache.get());
+
+			if (persistentCache)
+				persistentCache->flush();
+
+			//The sink outlives the run.
+			if (metrics)
+				metrics->flush();
+
+			island.stats.totalDuration.tick();
+						
+			return Result(std::move(island.population), island.stats);
+		}
+
+	private:
+
+		struct EpochRanks;
+
+		//State of one population. Without islands, the GA runs on exactly one.
+		struct Island
+		{
+			Island(int index, StopCriterion& stopCriterion, const Statistics& stats, const Parameters& params, unsigned int seed, int levelOfDetail) :
+				index(index),
+				stopCriterion(&stopCriterion),
+				stats(stats),
+				seed(seed),
+				iterationCount(0),
+				crossoverRate(params.crossoverRate),
+				mutationRate(params.mutationRate),
+				eliteCutoff(worstRank),
+				levelOfDetail(levelOfDetail),
+				iterationsOnLevel(0),
+				iterationsWithoutChangeOnLevel(0),
+				lastBestRankOnLevel(0.0),
+				stopped(false),
+				epochRanks(params.islands.numIslands > 1 ? std::make_shared<EpochRanks>() : nullptr)
+			{
+			}
+
+			std::vector<RankedCreature> population;
+			//Next generation while it is created, swapped with the population afterwards. Keeps its capacity between generations.
+			std::vector<RankedCreature> nextPopulation;
+			//Best creatures of the last ranked generation.
+			std::vector<RankedCreature> emigrants;
+
+			int index;
+			StopCriterion* stopCriterion;
+			Statistics stats;
+			unsigned int seed;
+			int iterationCount;
+			double crossoverRate;
+			double mutationRate;
+			//Rank of the worst best parent of the last generation. Creatures below it are only raced.
+			double eliteCutoff;
+			int levelOfDetail;
+			int iterationsOnLevel;
+			int iterationsWithoutChangeOnLevel;
+			double lastBestRankOnLevel;
+			bool stopped;
+			//Only with islands, see EpochRanks.
+			std::shared_ptr<EpochRanks> epochRanks;
+		};
+
+		//Ranks the island's population and replaces it with the next generation. Sets stopped instead if the stop criterion is met.
+		void iterate(Island& island, const Parameters& params, const ParentSelector& parentSelector, const CreatureCreator& creator, 
+			const CreatureRanker& ranker, const PopulationManipulator& popMan, PersistentRankCache* persistentCache, MetricsSink* metrics) const
+		{
+			if (island.stopCriterion->shouldStop(island.population, island.iterationCount))
+			{
+				island.stopped = true;
+				return;
+			}
+
+			auto& population = island.population;
+			auto& stats = island.stats;
+
+			//Population manipulators are not required to be thread-safe.
+			std::unique_lock<std::mutex> popManLock(_popManMutex, std::defer_lock);
+
+			LMU_LOG_DEBUG("Start iteration");
+			stats.iterationDuration.reset();
+
+			//Counters before this iteration, metrics hold the increments.
+			IterationMetrics m;
+			m.numEvaluations = stats.numEvaluations;
+			m.numEvaluatedPoints = stats.numEvaluatedPoints;
+			m.numCacheHits = stats.numCacheHits + stats.numPersistentCacheHits;
+			m.numCacheTries = stats.numCacheTries;
+				
+			//The manipulator's engine only depends on the island's seed and the iteration, islands may take the lock in any order.
+			auto popManEngine = slotEngine(island.seed, island.iterationCount, -1);
+
+			LMU_LOG_DEBUG("Optimize population.");
+			popManLock.lock();
+			popMan.manipulateBeforeRanking(population, popManEngine);
+			popManLock.unlock();
+			stats.optDurations.push_back(stats.iterationDuration.tick());
+			m.optMicroseconds = stats.iterationDuration.currentMicroseconds;
+
+			LMU_LOG_DEBUG("Rank population.");
+			rankPopulation(population, ranker, params.rankingInParallel, params.useCaching, persistentCache, island.epochRanks.get(), island.eliteCutoff, island.levelOfDetail, stats);
+			stats.rankingDurations.push_back(stats.iterationDuration.tick());
+			m.rankingMicroseconds = stats.iterationDuration.currentMicroseconds;
+			m.levelOfDetail = island.levelOfDetail;
+
+			//Only the creatures that are taken over as they are need to be in order, the tournament samples the rest by index.
+			const int numBest = std::max(1, std::max(params.numBestParents, params.islands.numIslands > 1 ? params.islands.migrationSize : 0));
+			selectBest(population, numBest);
+			stats.sortingDurations.push_back(stats.iterationDuration.tick());
+			m.sortingMicroseconds = stats.iterationDuration.currentMicroseconds;
+
+			if (params.numBestParents > 0 && (size_t)params.numBestParents <= population.size())
+				island.eliteCutoff = population[params.numBestParents - 1].rank;
+
+			if (island.levelOfDetail > 0)
+				updateLevelOfDetail(island, params.levelOfDetailSchedule);
+
+			popManLock.lock();
+			popMan.manipulateAfterRanking(population, popManEngine);
+			popManLock.unlock();
 			
-				stats.bestCandidateScores.push_back(population.front().rank);
-				stats.worstCandidateScores.push_back(population.back().rank);
+			stats.bestCandidateScores.push_back(population.front().rank);
+			stats.worstCandidateScores.push_back(worstRankOf(population));
+
+			if (params.islands.numIslands > 1)
+				island.emigrants.assign(population.begin(), population.begin() + std::min((int)population.size(), params.islands.migrationSize));
 				
-				auto newPopulation = getNBestParents(population, params.numBestParents);
+			createNextGeneration(population, island.nextPopulation, params.numBestParents, params.populationSize, island.crossoverRate, island.mutationRate, parentSelector, creator, 
+				island.seed, island.iterationCount, params.rankingInParallel, stats);
+			stats.scmDurations.push_back(stats.iterationDuration.tick());
+			m.scmMicroseconds = stats.iterationDuration.currentMicroseconds;
+				
+			std::swap(population, island.nextPopulation);
+			island.nextPopulation.clear();
+			stats.update();
+			stats.print();
+
+			if (metrics)
+			{
+				m.run = rankerFingerprint(ranker, 0);
+				m.island = island.index;
+				m.iteration = island.iterationCount;
+				m.bestScore = stats.bestScore;
+				m.worstScore = stats.worstScore;
+				m.numEvaluations = stats.numEvaluations - m.numEvaluations;
+				m.numEvaluatedPoints = stats.numEvaluatedPoints - m.numEvaluatedPoints;
+				m.numCacheHits = stats.numCacheHits + stats.numPersistentCacheHits - m.numCacheHits;
+				m.numCacheTries = stats.numCacheTries - m.numCacheTries;
+				m.cacheSize = stats.cacheSize;
+				m.rankingUtilization = stats.rankingUtilizations.empty() ? 0.0 : stats.rankingUtilizations.back();
+				m.peakMemoryBytes = peakMemoryUsage();
+				metrics->record(m);
+			}
+
+			island.iterationCount++;
 
-				while (newPopulation.size() < params.populationSize)
+			// Update the cross-over rate and mutation rate based on 
+			// some annealing schedule
+			island.crossoverRate = params.crossoverRate * params.crossoverSchedule.getFactor(island.iterationCount);
+			island.mutationRate = params.mutationRate * params.mutationSchedule.getFactor(island.iterationCount);
+		}
+
+		//Islands evolve concurrently for migrationInterval generations, then exchange their best creatures. 
+		//Migration and caching the ranks of the epoch happen in between these epochs, so runs stay reproducible independent of the number of threads.
+		Result runIslands(const Parameters& params, const ParentSelector& parentSelector, const CreatureCreator& creator, 
+			const CreatureRanker& ranker, StopCriterion& stopCriterion, const PopulationManipulator& popMan, unsigned int seed, Statistics& stats) const
+		{
+			const IslandParameters& ip = params.islands;
+
+			Parameters islandParams = params;
+			islandParams.populationSize = std::max(params.numBestParents + 2, params.populationSize / ip.numIslands);
+
+			//Every island has its own copy of the stop criterion and stops on its own.
+			std::vector<StopCriterion> stopCriteria(ip.numIslands, stopCriterion);
+
+			std::vector<Island> islands;
+			std::vector<Island*> islandPtrs;
+			islands.reserve(ip.numIslands);
+			for (int i = 0; i < ip.numIslands; ++i)
+			{
+				islands.push_back(Island(i, stopCriteria[i], Statistics(stats.info), islandParams, slotEngine(seed, -2, i)(), initialLevelOfDetail(params, ranker)));
+				islandPtrs.push_back(&islands.back());
+			}
+
+			auto checkpoint = openCheckpoint(params, creator, ranker);
+			if (checkpoint && loadCheckpoint(*checkpoint, islandPtrs, creator, popMan))
+			{
+				LMU_LOG_INFO("Resumed " << ip.numIslands << " islands from checkpoint " << checkpoint->file.file() << ".");
+			}
+			else
+			{
+				for (auto& island : islands)
+					island.population = createRandomPopulation(islandParams.populationSize, creator, island.seed, params.rankingInParallel);
+
+				LMU_LOG_INFO(ip.numIslands << " random populations with " << islandParams.populationSize << " creatures each were created.");
+			}
+
+			auto persistentCache = openPersistentCache(params, ranker, islands.front().population);
+			auto metrics = openMetrics(params);
+
+			//Checkpoints are written between epochs, resumed runs then migrate at the same generations.
+			auto maxIterationCount = [&]()
+			{
+				int n = 0;
+				for (const auto& island : islands)
+					n = std::max(n, island.iterationCount);
+				return n;
+			};
+			int lastCheckpointIteration = maxIterationCount();
+
+			auto isStopped = [](const Island& island) { return island.stopped; };
+			while (!std::all_of(islands.begin(), islands.end(), isStopped) && !_stopRequested.load())
+			{
+				parallelFor(0, ip.numIslands, 1, [&](int i)
 				{
-					auto parent1 = parentSelector.selectFrom(population);
-					auto parent2 = parentSelector.selectFrom(population);
-									
-					auto offspring = crossover(parent1, parent2, crossoverRate, creator, stats);					
-				
-					newPopulation.push_back(mutate(offspring[0], mutationRate, creator, stats));
-					newPopulation.push_back(mutate(offspring[1], mutationRate, creator, stats));
+					for (int g = 0; g < ip.migrationInterval && !islands[i].stopped && !_stopRequested.load(); ++g)
+						iterate(islands[i], islandParams, parentSelector, creator, ranker, popMan, persistentCache.get(), metrics.get());
+				});
+
+				mergeEpochRanks(islands, persistentCache.get());
+				migrate(islands, islandParams);
+
+				if (checkpoint && !_stopRequested.load() && maxIterationCount() - lastCheckpointIteration >= params.checkpointInterval)
+				{
+					saveCheckpoint(*checkpoint, islandPtrs, creator, popMan);
+					lastCheckpointIteration = maxIterationCount();
 				}
-				stats.scmDurations.push_back(stats.iterationDuration.tick());
-				
-				population = newPopulation; 
-				stats.update();
-				stats.print();
-				iterationCount++;
+			}
+
+			finishCheckpoints(checkpoint.get(), islandPtrs, creator, popMan);
+
+			parallelFor(0, ip.numIslands, 1, [&](int i)
+			{
+				finishAtFullResolution(islands[i], islandParams, ranker, persistentCache.get());
+			});
+			mergeEpochRanks(islands, persistentCache.get());
+
+			if (persistentCache)
+				persistentCache->flush();
 
-				// Update the cross-over rate and mutation rate based on 
-				// some annealing schedule
-				crossoverRate = params.crossoverRate * params.crossoverSchedule.getFactor(iterationCount);
-				mutationRate = params.mutationRate * params.mutationSchedule.getFactor(iterationCount);
+			//The sink outlives the run.
+			if (metrics)
+				metrics->flush();
+
+			//Best parents of all islands first.
+			std::vector<RankedCreature> elite;
+			std::vector<RankedCreature> rest;
+			for (auto& island : islands)
+			{
+				auto& population = island.population;
+				int numElite = std::min((int)population.size(), params.numBestParents);
+				elite.insert(elite.end(), std::make_move_iterator(population.begin()), std::make_move_iterator(population.begin() + numElite));
+				rest.insert(rest.end(), std::make_move_iterator(population.begin() + numElite), std::make_move_iterator(population.end()));
 			}
+			std::stable_sort(elite.begin(), elite.end(), [](const RankedCreature& a, const RankedCreature& b) { return a.rank > b.rank; });
+			elite.insert(elite.end(), std::make_move_iterator(rest.begin()), std::make_move_iterator(rest.end()));
 
+			mergeIslandStatistics(islands, stats);
 			stats.totalDuration.tick();
-						
-			return Result(population, stats);
+
+			return Result(std::move(elite), stats);
 		}
 
-	private:
+		static std::string checkpointMagic()
+		{
+			return "LMU GA Checkpoint";
+		}
+
+		static uint32_t checkpointVersion()
+		{
+			return 3;
+		}
+
+		std::shared_ptr<MetricsSink> openMetrics(const Parameters& params) const
+		{
+			if (params.metricsFile.empty() && params.prometheusFile.empty())
+				return nullptr;
+
+			return MetricsSink::open(params.metricsFile, params.prometheusFile);
+		}
+
+		//Checkpoint file of a run and the fingerprint of the run's input and parameters. 
+		struct Checkpoint
+		{
+			Checkpoint(const std::string& file, uint64_t fingerprint) :
+				file(file),
+				fingerprint(fingerprint)
+			{
+			}
+
+			AsyncCheckpointFile file;
+			uint64_t fingerprint;
+		};
+
+		//Runs only resume from checkpoints of the same input and parameters. The number of threads and the checkpoint settings do not matter.
+		static uint64_t checkpointFingerprint(const Parameters& params, const CreatureRanker& ranker)
+		{
+			std::stringstream ss;
+			ss.precision(std::numeric_limits<double>::max_digits10);
+			ss << rankerFingerprint(ranker, 0) << " " << params.populationSize << " " << params.numBestParents << " " << params.mutationRate << " " << params.crossoverRate <<
+				" " << params.seed << " " << params.islands.info() << " " << params.levelOfDetailSchedule.info();
+			return std::hash<std::string>()(ss.str());
+		}
+
+		std::unique_ptr<Checkpoint> openCheckpoint(const Parameters& params, const CreatureCreator& creator, const CreatureRanker& ranker) const
+		{
+			if (params.checkpointFile.empty() || params.checkpointInterval <= 0)
+				return nullptr;
+
+			if (!supportsCheckpoints(creator, (const Creature*)nullptr, 0))
+			{
+				LMU_LOG_WARNING("Creator does not support checkpoints.");
+				return nullptr;
+			}
+
+			const uint64_t fingerprint = checkpointFingerprint(params, ranker);
+			return std::make_unique<Checkpoint>(fingerprintedFile(params.checkpointFile, fingerprint), fingerprint);
+		}
+
+		//Layout: header (incl. fingerprint), islands, population manipulator state, rank cache. 
+		//Only the serialization happens here, the file is written in the background.
+		void saveCheckpoint(Checkpoint& checkpoint, const std::vector<Island*>& islands, const CreatureCreator& creator, const PopulationManipulator& popMan) const
+		{
+			CheckpointWriter writer;
+			writer.write(checkpointMagic());
+			writer.write<uint32_t>(checkpointVersion());
+			writer.write<uint64_t>(checkpoint.fingerprint);
+
+			writer.write<uint32_t>(islands.size());
+			for (const Island* island : islands)
+				writeIsland(writer, *island, creator);
+
+			CheckpointWriter popManWriter;
+			writeCheckpointState(popMan, popManWriter, 0);
+			writer.write(popManWriter.data());
+
+			_rankLookup.writeTo(writer);
+
+			const size_t size = writer.data().size();
+			checkpoint.file.write(std::move(writer.data()));
+			LMU_LOG_DEBUG("Checkpoint with " << size << " bytes queued.");
+		}
+
+		//Restores the islands (incl. their stop criteria), the population manipulator and the rank cache. 
+		//Returns false and changes nothing but the rank cache if there is no usable checkpoint.
+		bool loadCheckpoint(const Checkpoint& checkpoint, const std::vector<Island*>& islands, const CreatureCreator& creator, const PopulationManipulator& popMan) const
+		{
+			std::string data;
+			if (!checkpoint.file.read(data))
+				return false;
+
+			try
+			{
+				CheckpointReader reader(std::move(data));
+				if (reader.readString() != checkpointMagic() || reader.read<uint32_t>() != checkpointVersion())
+					throw std::runtime_error("Unknown format.");
+				if (reader.read<uint64_t>() != checkpoint.fingerprint)
+					throw std::runtime_error("Input or parameters differ.");
+				if (reader.read<uint32_t>() != islands.size())
+					throw std::runtime_error("Number of islands differs.");
+
+				//Everything is read before anything is changed.
+				std::vector<Island> loadedIslands;
+				std::vector<std::string> stopCriterionStates(islands.size());
+				bool hashesAreStable = true;
+				for (size_t i = 0; i < islands.size(); ++i)
+				{
+					loadedIslands.push_back(*islands[i]);
+					readIsland(reader, loadedIslands.back(), creator, stopCriterionStates[i], hashesAreStable);
+				}
+
+				std::string popManState = reader.readString();
+
+				//In-memory cache keys are creature hashes. If they depend on the process (e.g. pointers), the cached ranks are useless now.
+				if (hashesAreStable)
+					_rankLookup.readFrom(reader);
+				else
+					LMU_LOG_INFO("Creature hashes changed, the rank cache of the checkpoint is not used.");
+
+				for (size_t i = 0; i < islands.size(); ++i)
+				{
+					*islands[i] = std::move(loadedIslands[i]);
+					CheckpointReader stopCriterionReader(stopCriterionStates[i]);
+					readCheckpointState(*islands[i]->stopCriterion, stopCriterionReader, 0);
+				}
+
+				CheckpointReader popManReader(popManState);
+				readCheckpointState(popMan, popManReader, 0);
+			}
+			catch (const std::exception& ex)
+			{
+				LMU_LOG_WARNING("Checkpoint " << checkpoint.file.file() << " is not used: " << ex.what());
+				_rankLookup.clear();
+				return false;
+			}
+
+			return true;
+		}
+
+		//A run that was stopped on request keeps its latest state, a run that is done removes its checkpoint.
+		void finishCheckpoints(Checkpoint* checkpoint, const std::vector<Island*>& islands, const CreatureCreator& creator, const PopulationManipulator& popMan) const
+		{
+			if (!checkpoint)
+				return;
+
+			if (_stopRequested.load())
+			{
+				saveCheckpoint(*checkpoint, islands, creator, popMan);
+				checkpoint->file.wait();
+			}
+			else
+			{
+				checkpoint->file.remove();
+			}
+		}
+
+		void writeIsland(CheckpointWriter& writer, const Island& island, const CreatureCreator& creator) const
+		{
+			writer.write<uint32_t>(island.seed);
+			writer.write<int32_t>(island.iterationCount);
+			writer.write(island.crossoverRate);
+			writer.write(island.mutationRate);
+			writer.write(island.eliteCutoff);
+			writer.write<int32_t>(island.levelOfDetail);
+			writer.write<int32_t>(island.iterationsOnLevel);
+			writer.write<int32_t>(island.iterationsWithoutChangeOnLevel);
+			writer.write(island.lastBestRankOnLevel);
+			writer.write<uint8_t>(island.stopped);
+
+			writePopulation(writer, island.population, creator);
+			writePopulation(writer, island.emigrants, creator);
+
+			island.stats.writeTo(writer);
+
+			CheckpointWriter stopCriterionWriter;
+			writeCheckpointState(*island.stopCriterion, stopCriterionWriter, 0);
+			writer.write(stopCriterionWriter.data());
+		}
+
+		void readIsland(CheckpointReader& reader, Island& island, const CreatureCreator& creator, std::string& stopCriterionState, bool& hashesAreStable) const
+		{
+			island.seed = reader.read<uint32_t>();
+			island.iterationCount = reader.read<int32_t>();
+			island.crossoverRate = reader.read<double>();
+			island.mutationRate = reader.read<double>();
+			island.eliteCutoff = reader.read<double>();
+			island.levelOfDetail = reader.read<int32_t>();
+			island.iterationsOnLevel = reader.read<int32_t>();
+			island.iterationsWithoutChangeOnLevel = reader.read<int32_t>();
+			island.lastBestRankOnLevel = reader.read<double>();
+			island.stopped = reader.read<uint8_t>() != 0;
+
+			island.population = readPopulation(reader, creator, hashesAreStable);
+			island.emigrants = readPopulation(reader, creator, hashesAreStable);
+
+			island.stats.readFrom(reader);
+
+			stopCriterionState = reader.readString();
+		}
+
+		//Per creature: rank, hash (to check if hashes survive the process) and the serialized creature.
+		void writePopulation(CheckpointWriter& writer, const std::vector<RankedCreature>& population, const CreatureCreator& creator) const
+		{
+			writer.write<uint64_t>(population.size());
+			for (const auto& c : population)
+			{
+				writer.write(c.rank);
+				writer.write<uint64_t>(c.creature.hash(0));
+				writer.write(serializeCreature(creator, c.creature, 0));
+			}
+		}
+
+		std::vector<RankedCreature> readPopulation(CheckpointReader& reader, const CreatureCreator& creator, bool& hashesAreStable) const
+		{
+			std::vector<RankedCreature> population;
+
+			const uint64_t size = reader.read<uint64_t>();
+			for (uint64_t i = 0; i < size; ++i)
+			{
+				double rank = reader.read<double>();
+				uint64_t hash = reader.read<uint64_t>();
+				population.push_back(RankedCreature(deserializeCreature<Creature>(creator, reader.readVector<int>(), 0), rank));
+
+				if (population.back().creature.hash(0) != hash)
+					hashesAreStable = false;
+			}
+
+			return population;
+		}
+
+		//Coarsest level that is scheduled and supported by the ranker.
+		int initialLevelOfDetail(const Parameters& params, const CreatureRanker& ranker) const
+		{
+			return std::max(0, std::min(params.levelOfDetailSchedule.numLevels, numLevelsOfDetail(ranker, 0)) - 1);
+		}
+
+		//Goes one level finer if the schedule says so. Ranks of different levels are not compared, the counters and the cutoff start over.
+		void updateLevelOfDetail(Island& island, const LevelOfDetailSchedule& schedule) const
+		{
+			double bestRank = island.population.front().rank;
+
+			if (island.iterationsOnLevel > 0 && bestRank - island.lastBestRankOnLevel <= schedule.delta)
+				island.iterationsWithoutChangeOnLevel++;
+			else
+				island.iterationsWithoutChangeOnLevel = 0;
+
+			island.lastBestRankOnLevel = bestRank;
+			island.iterationsOnLevel++;
+
+			if (!schedule.isFinerLevelDue(island.iterationsOnLevel, island.iterationsWithoutChangeOnLevel))
+				return;
+
+			island.levelOfDetail--;
+			island.iterationsOnLevel = 0;
+			island.iterationsWithoutChangeOnLevel = 0;
+			island.eliteCutoff = worstRank;
+
+			LMU_LOG_INFO("Switch to level of detail " << island.levelOfDetail << " after iteration " << island.iterationCount << ".");
+		}
+
+		//Ranks the population at full resolution if the island did not get there, so results are comparable to runs without levels of detail.
+		void finishAtFullResolution(Island& island, const Parameters& params, const CreatureRanker& ranker, PersistentRankCache* persistentCache) const
+		{
+			if (island.levelOfDetail == 0 || island.population.empty())
+				return;
+
+			island.levelOfDetail = 0;
+
+			rankPopulation(island.population, ranker, params.rankingInParallel, params.useCaching, persistentCache, island.epochRanks.get(), worstRank, 0, island.stats);
+			//Not a generation of its own.
+			island.stats.rankingUtilizations.pop_back();
+
+			selectBest(island.population, std::max(1, params.numBestParents));
+		}
+
+		//Every island that is still running replaces its last creatures with the best emigrants of its neighbours.
+		void migrate(std::vector<Island>& islands, const Parameters& params) const
+		{
+			const IslandParameters& ip = params.islands;
+			const int numIslands = islands.size();
+
+			std::vector<std::vector<RankedCreature>> immigrants(numIslands);
+			for (int i = 0; i < numIslands; ++i)
+			{
+				if (islands[i].stopped)
+					continue;
+
+				for (int j = 0; j < numIslands; ++j)
+				{
+					bool isNeighbour = ip.topology == MigrationTopology::RING ? j == (i + numIslands - 1) % numIslands : j != i;
+					if (isNeighbour)
+						immigrants[i].insert(immigrants[i].end(), islands[j].emigrants.begin(), islands[j].emigrants.end());
+				}
+
+				std::stable_sort(immigrants[i].begin(), immigrants[i].end(), [](const RankedCreature& a, const RankedCreature& b) { return a.rank > b.rank; });
+				if ((int)immigrants[i].size() > ip.migrationSize)
+					immigrants[i].erase(immigrants[i].begin() + ip.migrationSize, immigrants[i].end());
+			}
+
+			for (int i = 0; i < numIslands; ++i)
+			{
+				auto& population = islands[i].population;
+
+				//The best parents at the front are kept.
+				int numReplaced = std::min((int)immigrants[i].size(), (int)population.size() - params.numBestParents);
+				for (int k = 0; k < numReplaced; ++k)
+					population[population.size() - 1 - k] = std::move(immigrants[i][k]);
+			}
+
+			LMU_LOG_DEBUG("Migration between " << numIslands << " islands done.");
+		}
+
+		//Per generation: best and worst score over all islands, the longest durations and the mean utilization. Counters are summed up.
+		void mergeIslandStatistics(const std::vector<Island>& islands, Statistics& stats) const
+		{
+			size_t numIterations = 0;
+			for (const auto& island : islands)
+			{
+				const auto& s = island.stats;
+				numIterations = std::max(numIterations, s.bestCandidateScores.size());
+
+				stats.numMutations += s.numMutations;
+				stats.numMutationTries += s.numMutationTries;
+				stats.numCrossovers += s.numCrossovers;
+				stats.numCrossoverTries += s.numCrossoverTries;
+				stats.numCacheHits += s.numCacheHits;
+				stats.numCacheTries += s.numCacheTries;
+				stats.numCacheEvictions += s.numCacheEvictions;
+				stats.numPersistentCacheHits += s.numPersistentCacheHits;
+				stats.numRaces += s.numRaces;
+				stats.numRacePromotions += s.numRacePromotions;
+				stats.numEvaluations += s.numEvaluations;
+				stats.numEvaluatedPoints += s.numEvaluatedPoints;
+			}
+			stats.cacheSize = _rankLookup.size();
+
+			for (size_t g = 0; g < numIterations; ++g)
+			{
+				double best = -std::numeric_limits<double>::max();
+				double worst = std::numeric_limits<double>::max();
+				long long opt = 0, ranking = 0, sorting = 0, scm = 0;
+				double utilization = 0.0;
+				int n = 0;
+
+				for (const auto& island : islands)
+				{
+					const auto& s = island.stats;
+					if (g >= s.bestCandidateScores.size())
+						continue;
+
+					best = std::max(best, s.bestCandidateScores[g]);
+					worst = std::min(worst, s.worstCandidateScores[g]);
+					opt = std::max(opt, s.optDurations[g]);
+					ranking = std::max(ranking, s.rankingDurations[g]);
+					sorting = std::max(sorting, s.sortingDurations[g]);
+					scm = std::max(scm, s.scmDurations[g]);
+					utilization += s.rankingUtilizations[g];
+					n++;
+				}
+
+				stats.bestCandidateScores.push_back(best);
+				stats.worstCandidateScores.push_back(worst);
+				stats.optDurations.push_back(opt);
+				stats.rankingDurations.push_back(ranking);
+				stats.sortingDurations.push_back(sorting);
+				stats.scmDurations.push_back(scm);
+				stats.rankingUtilizations.push_back(utilization / (double)n);
+			}
+
+			stats.update();
+			stats.print();
+		}
 	 
-		RankedCreature mutate(const RankedCreature& creature, double mutationRate, const CreatureCreator& creator, Statistics& stats) const
+		//Counters of one offspring pair, summed up after the (possibly parallel) offspring generation.
+		struct OffspringCounters
+		{
+			int numMutations = 0;
+			int numMutationTries = 0;
+			int numCrossovers = 0;
+			int numCrossoverTries = 0;
+		};
+
+		//Engine of one creation or offspring slot. It only depends on the seed, so results do not depend on the number of threads.
+		static std::default_random_engine slotEngine(unsigned int seed, int iteration, int slot)
 		{
-			stats.numMutationTries++;
+			std::seed_seq seq{ seed, (unsigned int)iteration, (unsigned int)slot };
+			return std::default_random_engine(seq);
+		}
 
-			static std::bernoulli_distribution d{};
+		//Appends the child to the offspring, mutated with the given rate. Only mutated children are new creatures, 
+		//children that stay unchanged are moved if they are owned (crossover results) and copied otherwise (parents).
+		template<typename Child>
+		void mutate(Child&& child, double mutationRate, const CreatureCreator& creator, std::default_random_engine& rndEngine, OffspringCounters& counters, 
+			std::vector<RankedCreature>& offspring) const
+		{
+			counters.numMutationTries++;
+
+			std::bernoulli_distribution d{};
 			using parm_t = decltype(d)::param_type;
 
-			if (d(_rndEngine, parm_t{ mutationRate }))
+			if (d(rndEngine, parm_t{ mutationRate }))
 			{
-				stats.numMutations++;
+				counters.numMutations++;
 
-				return RankedCreature(creator.mutate(creature.creature), RankedCreature::unranked());
+				offspring.push_back(RankedCreature(creator.mutate(child.creature, rndEngine), RankedCreature::unranked()));
 			}
 			else
 			{
-				return creature;
+				offspring.push_back(std::forward<Child>(child));
 			}
 		}
 
-		std::vector<RankedCreature> crossover(const RankedCreature& parent1, const RankedCreature& parent2, double crossoverRate, const CreatureCreator& creator, Statistics& stats) const
+		//Returns the crossover children or nothing if there is no crossover, the parents are the children in that case.
+		std::vector<RankedCreature> crossover(const RankedCreature& parent1, const RankedCreature& parent2, double crossoverRate, const CreatureCreator& creator, 
+			std::default_random_engine& rndEngine, OffspringCounters& counters) const
 		{
-			stats.numCrossoverTries++;
+			counters.numCrossoverTries++;
 
-			static std::bernoulli_distribution d{};
+			std::bernoulli_distribution d{};
 			using parm_t = decltype(d)::param_type;
 
-			if (d(_rndEngine, parm_t{ crossoverRate }))
+			std::vector<RankedCreature> rankedCrs;
+
+			if (d(rndEngine, parm_t{ crossoverRate }))
 			{
-				stats.numCrossovers++;
+				counters.numCrossovers++;
 
-				auto crs = creator.crossover(parent1.creature, parent2.creature);
+				auto crs = creator.crossover(parent1.creature, parent2.creature, rndEngine);
 				
-				std::vector<RankedCreature> rankedCrs;
 				rankedCrs.reserve(crs.size());
-				for (const auto& cr : crs)
-					rankedCrs.push_back(RankedCreature(cr, RankedCreature::unranked()));
-				
-				return rankedCrs;
-			}
-			else
-			{
-				return { parent1, parent2 };
+				for (auto& cr : crs)
+					rankedCrs.push_back(RankedCreature(std::move(cr), RankedCreature::unranked()));
 			}
+
+			return rankedCrs;
 		}
 
-		std::vector<RankedCreature> getNBestParents(const std::vector<RankedCreature>& population, int numBestParents) const
+		//Fills newPopulation with the best parents at the front of the ranked population, followed by pairs of mutated offspring up to the population size. 
+		//Each pair draws from its own slot engine. Parents are selected by index and only copied if they make it into the next generation unchanged.
+		//The best parents are moved, the population must not be used afterwards.
+		void createNextGeneration(std::vector<RankedCreature>& population, std::vector<RankedCreature>& newPopulation, int numBestParents, int populationSize, 
+			double crossoverRate, double mutationRate, const ParentSelector& parentSelector, const CreatureCreator& creator, unsigned int seed, int iteration, bool inParallel, 
+			Statistics& stats) const
 		{
 			//Assumption: popuplation size > numBestCreatures
-			return std::vector<RankedCreature>(population.begin(), population.begin() + numBestParents);
+			const int numElite = std::min(numBestParents, (int)population.size());
+			const int numPairs = std::max(0, (populationSize - numElite + 1) / 2);
+
+			std::vector<std::vector<RankedCreature>> offspring(numPairs);
+			std::vector<OffspringCounters> counters(numPairs);
+
+			auto createPair = [&](int i)
+			{
+				auto rndEngine = slotEngine(seed, iteration, i);
+
+				const RankedCreature& parent1 = population[parentSelector.selectIndexFrom(population, rndEngine)];
+				const RankedCreature& parent2 = population[parentSelector.selectIndexFrom(population, rndEngine)];
+
+				auto children = crossover(parent1, parent2, crossoverRate, creator, rndEngine, counters[i]);
+
+				offspring[i].reserve(2);
+				if (children.empty())
+				{
+					mutate(parent1, mutationRate, creator, rndEngine, counters[i], offspring[i]);
+					mutate(parent2, mutationRate, creator, rndEngine, counters[i], offspring[i]);
+				}
+				else
+				{
+					mutate(std::move(children[0]), mutationRate, creator, rndEngine, counters[i], offspring[i]);
+					mutate(std::move(children[1]), mutationRate, creator, rndEngine, counters[i], offspring[i]);
+				}
+			};
+
+			if (inParallel)
+				parallelFor(0, numPairs, 1, createPair);
+			else
+				for (int i = 0; i < numPairs; ++i)
+					createPair(i);
+
+			newPopulation.clear();
+			newPopulation.reserve(numElite + 2 * numPairs);
+			newPopulation.insert(newPopulation.end(), std::make_move_iterator(population.begin()), std::make_move_iterator(population.begin() + numElite));
+
+			for (int i = 0; i < numPairs; ++i)
+			{
+				newPopulation.insert(newPopulation.end(), std::make_move_iterator(offspring[i].begin()), std::make_move_iterator(offspring[i].end()));
+
+				stats.numMutations += counters[i].numMutations;
+				stats.numMutationTries += counters[i].numMutationTries;
+				stats.numCrossovers += counters[i].numCrossovers;
+				stats.numCrossoverTries += counters[i].numCrossoverTries;
+			}
 		}
 
-		std::vector<RankedCreature> createRandomPopulation(int populationSize, const CreatureCreator& creator) const 
+		//Creation happens before the first iteration, its slot engines use iteration -1.
+		std::vector<RankedCreature> createRandomPopulation(int populationSize, const CreatureCreator& creator, unsigned int seed, bool inParallel) const 
 		{
+			//Creatures need not be default constructible, every slot holds its creature in a vector of its own.
+			std::vector<std::vector<RankedCreature>> creatures(populationSize);
+
+			auto createCreature = [&](int i)
+			{
+				auto rndEngine = slotEngine(seed, -1, i);
+				creatures[i].push_back(RankedCreature(creator.create(rndEngine), RankedCreature::unranked()));
+			};
+
+			if (inParallel)
+				parallelFor(0, populationSize, 1, createCreature);
+			else
+				for (int i = 0; i < populationSize; ++i)
+					createCreature(i);
+
 			std::vector<RankedCreature> population;
 			population.reserve(populationSize);
+			for (auto& creature : creatures)
+				population.push_back(std::move(creature.front()));
+
+			return population;
+		}
+
+		std::shared_ptr<PersistentRankCache> openPersistentCache(const Parameters& params, const CreatureRanker& ranker, const std::vector<RankedCreature>& population) const
+		{
+			if (!params.useCaching || params.persistentCacheFile.empty() || population.empty())
+				return nullptr;
 
-			for (int i = 0; i < populationSize; ++i)
+			if (persistentRankKey(ranker, population.front().creature, 0).first == 0)
 			{
-				auto creature = creator.create();
-				population.push_back(RankedCreature(creature, RankedCreature::unranked()));
+				LMU_LOG_WARNING("Ranker does not support persistent caching.");
+				return nullptr;
+			}
+
+			try
+			{
+				auto cache = PersistentRankCache::open(params.persistentCacheFile);
+				LMU_LOG_INFO("Persistent rank cache " << cache->file() << " holds " << cache->size() << " ranks.");
+				return cache;
+			}
+			catch (const std::exception& ex)
+			{
+				LMU_LOG_WARNING("Persistent rank cache is not used: " << ex.what());
+				return nullptr;
 			}
-			return population;
 		}
 
-		void rankPopulation(std::vector<RankedCreature>& population, const CreatureRanker& ranker, bool inParallel, bool useCaching, Statistics& stats) const 
-		{	
-			if (inParallel)
+		//Ranks of different levels of detail are cached under different keys in memory. Keys of full resolution ranks stay the same.
+		static uint64_t levelKey(uint64_t key, int level)
+		{
+			return level == 0 ? key : key ^ ((uint64_t)level * 0x9e3779b97f4a7c15ull);
+		}
+
+		//Exact at coarse levels of detail, raced at full resolution.
+		double rankCreature(const Creature& c, const CreatureRanker& ranker, int level, double cutoff, RaceOutcome& outcome) const
+		{
+			if (level > 0)
 			{
-#ifndef _OPENMP 
-				throw std::runtime_error("Ranking should run in parallel but OpenMP is not available.");
-#endif
-				if (useCaching)
-				{
-					//Collect all creatures that need to be ranked ( == not in cache).
-					std::vector<std::tuple<size_t,size_t>> creaturesToRank;
-					creaturesToRank.reserve(population.size());
-					for (int i = 0; i < population.size(); ++i)
-					{
-						stats.numCacheTries++;
-						size_t hash = population[i].creature.hash(0);
-
-						auto it = _rankLookup.find(hash);
-						if (it != _rankLookup.end())
-						{
-							stats.numCacheHits++;
-							population[i].rank = it->second;
-						}
-						else
-						{
-							creaturesToRank.push_back(std::make_tuple(i, hash));
-						}
-					}
+				outcome = RaceOutcome::NOT_RACED;
+				return rankAtLevelOfDetail(ranker, c, level, 0);
+			}
 
-					//Rank creatures not found in cache.
-#pragma omp parallel for				
-					for (int i = 0; i < creaturesToRank.size(); ++i)
-					{
-						size_t index = std::get<0>(creaturesToRank[i]);
-						double rank = ranker.rank(population[index].creature);
-						population[index].rank = rank;
+			return rankAgainstCutoff(ranker, c, cutoff, outcome, 0);
+		}
 
-						size_t hash = std::get<1>(creaturesToRank[i]);
+		//Cache keys of a creature to rank. 
+		struct RankKey
+		{
+			size_t hash;
+			std::pair<uint64_t, uint64_t> persistentKey;
+		};
 
-						std::lock_guard<std::mutex> l(_mutex);
-						_rankLookup[hash] = rank;
-					}
+		//Ranks an island cached during the current epoch. The shared caches are only read during an epoch: otherwise, whether a creature 
+		//is found in the cache or raced would depend on which island ranked it first. Ranks are ordered by key, so merging them is deterministic.
+		struct EpochRanks
+		{
+			bool find(size_t hash, double& rank) const
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto it = ranks.find(hash);
+				if (it == ranks.end())
+					return false;
+				rank = it->second.second;
+				return true;
+			}
+
+			void insert(const RankKey& key, double rank)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				ranks[key.hash] = std::make_pair(key, rank);
+			}
 
+			mutable std::mutex mutex;
+			std::map<size_t, std::pair<RankKey, double>> ranks;
+		};
+
+		//Caches the ranks of all islands' epochs, island by island.
+		void mergeEpochRanks(std::vector<Island>& islands, PersistentRankCache* persistentCache) const
+		{
+			for (auto& island : islands)
+			{
+				for (const auto& entry : island.epochRanks->ranks)
+				{
+					if (cacheRank(entry.second.first, entry.second.second, persistentCache, nullptr))
+						island.stats.numCacheEvictions++;
 				}
-				else //no caching.
+				island.epochRanks->ranks.clear();
+
+				island.stats.cacheSize = _rankLookup.size();
+			}
+		}
+
+		//Looks the creature up in the in-memory cache (and the epoch's ranks), then in the persistent cache. 
+		//Persistent hits are added to the in-memory cache.
+		bool findRank(const Creature& c, const CreatureRanker& ranker, PersistentRankCache* persistentCache, EpochRanks* epochRanks, int level, RankKey& key, double& rank, 
+			Statistics& stats) const
+		{
+			stats.numCacheTries++;
+
+			key.hash = levelKey(c.hash(0), level);
+			if (_rankLookup.find(key.hash, rank) || (epochRanks && epochRanks->find(key.hash, rank)))
+			{
+				stats.numCacheHits++;
+				return true;
+			}
+
+			if (!persistentCache)
+				return false;
+
+			//The ranker's fingerprint does not cover the subsampled points of coarse levels, they have their own context.
+			key.persistentKey = persistentRankKey(ranker, c, 0);
+			if (level > 0)
+				key.persistentKey.first = levelOfDetailFingerprint(ranker, level, 0);
+			if (key.persistentKey.first == 0 || !persistentCache->find(key.persistentKey.first, key.persistentKey.second, rank))
+				return false;
+
+			stats.numPersistentCacheHits++;
+			if (epochRanks)
+				epochRanks->insert(RankKey{ key.hash, std::make_pair(0, 0) }, rank);
+			else if (_rankLookup.insert(key.hash, rank))
+				stats.numCacheEvictions++;
+			return true;
+		}
+
+		//Returns true if another rank was evicted from the in-memory cache. With epoch ranks, the rank is only cached after the epoch.
+		bool cacheRank(const RankKey& key, double rank, PersistentRankCache* persistentCache, EpochRanks* epochRanks) const
+		{
+			if (epochRanks)
+			{
+				epochRanks->insert(key, rank);
+				return false;
+			}
+
+			if (persistentCache && key.persistentKey.first != 0)
+				persistentCache->insert(key.persistentKey.first, key.persistentKey.second, rank);
+
+			return _rankLookup.insert(key.hash, rank);
+		}
+
+		//Creatures that are very likely ranked below cutoff may get an estimated rank (if the ranker supports racing). 
+		//Estimates and failed rankings are not cached.
+		void rankPopulation(std::vector<RankedCreature>& population, const CreatureRanker& ranker, bool inParallel, bool useCaching, PersistentRankCache* persistentCache, 
+			EpochRanks* epochRanks, double cutoff, int level, Statistics& stats) const 
+		{	
+			//Counters are collected here and not taken from the cache, islands rank concurrently on the same cache.
+			if (inParallel)
+			{
+				//Collect all creatures that need to be ranked ( == not in cache).
+				std::vector<size_t> creaturesToRank;
+				std::vector<RankKey> keys;
+				creaturesToRank.reserve(population.size());
+				for (size_t i = 0; i < population.size(); ++i)
 				{
+					if (!useCaching)
+					{
+						creaturesToRank.push_back(i);
+						continue;
+					}
 
-#pragma omp parallel for				
-					for (int i = 0; i < population.size(); ++i)
+					RankKey key;
+					if (!findRank(population[i].creature, ranker, persistentCache, epochRanks, level, key, population[i].rank, stats))
 					{
-						population[i].rank = ranker.rank(population[i].creature);
+						creaturesToRank.push_back(i);
+						keys.push_back(key);
 					}
 				}
+
+				rankCreaturesInParallel(population, creaturesToRank, keys, ranker, persistentCache, epochRanks, cutoff, level, stats);
 			}
 			else // single threaded
 			{
 				for (auto& c : population)
 				{
-					c.rank = rankCreatureSingleThreaded(c.creature, ranker, useCaching, stats);								
+					c.rank = rankCreatureSingleThreaded(c.creature, ranker, useCaching, persistentCache, epochRanks, cutoff, level, stats);
 				}
+
+				stats.rankingUtilizations.push_back(1.0);
+				stats.rankingThreadUtilizations.clear();
 			}
+
+			if (useCaching)
+				stats.cacheSize = _rankLookup.size();
 		}
 
-		inline double rankCreatureSingleThreaded(const Creature& c, const CreatureRanker& ranker, bool useCaching, Statistics& stats) const
+		//Ranks the creatures at the given indices on the shared pool, the most expensive ones first.
+		//Ranking costs vary a lot with the creature size, starting with the large ones keeps the workers busy until the end.
+		//If keys are given, the ranks are cached right after ranking.
+		void rankCreaturesInParallel(std::vector<RankedCreature>& population, const std::vector<size_t>& indices, const std::vector<RankKey>& keys, const CreatureRanker& ranker, 
+			PersistentRankCache* persistentCache, EpochRanks* epochRanks, double cutoff, int level, Statistics& stats) const
 		{
-			if (!useCaching)
-				return ranker.rank(c);
+			ThreadPool& pool = ThreadPool::instance();
 
-			stats.numCacheTries++;
+			std::vector<double> costs(indices.size());
+			for (size_t i = 0; i < indices.size(); ++i)
+				costs[i] = estimateRankingCost(ranker, population[indices[i]].creature, 0);
 
-			size_t hash = c.hash(0);
-			
-			auto it = _rankLookup.find(hash);
-			if (it != _rankLookup.end())
+			//Busy time in microseconds per worker, the last slot is used by threads that are no workers (e.g. the waiting thread).
+			const int numSlots = pool.numThreads() + 1;
+			std::unique_ptr<std::atomic<long long>[]> busy(new std::atomic<long long>[numSlots]);
+			for (int i = 0; i < numSlots; ++i)
+				busy[i] = 0;
+
+			std::atomic<int> numEvictions(0);
+			std::atomic<int> numRaces(0);
+			std::atomic<int> numRacePromotions(0);
+			std::atomic<uint64_t> numPoints(0);
+
+			auto start = std::chrono::steady_clock::now();
+
+			parallelForLargestFirst(costs, [&](int i)
 			{
-				stats.numCacheHits++;
-				return it->second;
+				auto taskStart = std::chrono::steady_clock::now();
+
+				RaceOutcome outcome;
+				const uint64_t pointsBefore = evaluatedPoints(ranker, 0);
+				double rank = rankCreature(population[indices[i]].creature, ranker, level, cutoff, outcome);
+				numPoints += evaluatedPoints(ranker, 0) - pointsBefore;
+				population[indices[i]].rank = rank;
+
+				if (isRaced(outcome))
+					numRaces++;
+				if (outcome == RaceOutcome::PROMOTED)
+					numRacePromotions++;
+
+				if (!keys.empty() && isExactRank(outcome) && cacheRank(keys[i], rank, persistentCache, epochRanks))
+					numEvictions++;
+
+				int worker = pool.workerIndex();
+				busy[worker == -1 ? numSlots - 1 : worker] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - taskStart).count();
+			}, pool);
+
+			long long duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+			stats.numCacheEvictions += numEvictions;
+			stats.numRaces += numRaces;
+			stats.numRacePromotions += numRacePromotions;
+			stats.numEvaluations += indices.size();
+			stats.numEvaluatedPoints += numPoints;
+
+			long long totalBusy = 0;
+			stats.rankingThreadUtilizations.resize(numSlots);
+			for (int i = 0; i < numSlots; ++i)
+			{
+				totalBusy += busy[i];
+				stats.rankingThreadUtilizations[i] = duration == 0 ? 0.0 : (double)busy[i] / (double)duration;
 			}
+			stats.rankingUtilizations.push_back(duration == 0 ? 0.0 : (double)totalBusy / (double)(duration * numSlots));
+		}
+
+		inline double rankCreatureSingleThreaded(const Creature& c, const CreatureRanker& ranker, bool useCaching, PersistentRankCache* persistentCache, EpochRanks* epochRanks, 
+			double cutoff, int level, Statistics& stats) const
+		{
+			RankKey key;
+			double rank;
+			if (useCaching && findRank(c, ranker, persistentCache, epochRanks, level, key, rank, stats))
+				return rank;
 			
-			double rank = ranker.rank(c);			
-			_rankLookup[hash] = rank;
+			RaceOutcome outcome;
+			const uint64_t pointsBefore = evaluatedPoints(ranker, 0);
+			rank = rankCreature(c, ranker, level, cutoff, outcome);
+			stats.numEvaluations++;
+			stats.numEvaluatedPoints += evaluatedPoints(ranker, 0) - pointsBefore;
+
+			if (isRaced(outcome))
+				stats.numRaces++;
+			if (outcome == RaceOutcome::PROMOTED)
+				stats.numRacePromotions++;
+
+			if (useCaching && isExactRank(outcome) && cacheRank(key, rank, persistentCache, epochRanks))
+				stats.numCacheEvictions++;
 			
 			return rank;
 		}
 
-		void sortPopulation(std::vector<RankedCreature>& population) const
+		//Moves the numBest best creatures to the front, sorted by rank. The order of the others is unspecified.
+		//Costs O(n + numBest log numBest) instead of O(n log n) for a full sort.
+		void selectBest(std::vector<RankedCreature>& population, int numBest) const
 		{
-			std::cout << "Sort population." << std::endl;
+			LMU_LOG_DEBUG("Select best creatures.");
 
-			//sort by rank
-			std::sort(population.begin(), population.end(),
-				[](const RankedCreature& a, const RankedCreature& b) -> bool
+			auto byRank = [](const RankedCreature& a, const RankedCreature& b) -> bool
 			{
 				return a.rank > b.rank;
-			});
+			};
+
+			numBest = std::min(numBest, (int)population.size());
+			if (numBest <= 0)
+				return;
+
+			std::nth_element(population.begin(), population.begin() + (numBest - 1), population.end(), byRank);
+			std::sort(population.begin(), population.begin() + numBest, byRank);
 		}
 
-		mutable std::unordered_map<size_t, double> _rankLookup;
-		mutable std::default_random_engine _rndEngine;
+		double worstRankOf(const std::vector<RankedCreature>& population) const
+		{
+			auto it = std::min_element(population.begin(), population.end(),
+				[](const RankedCreature& a, const RankedCreature& b) { return a.rank < b.rank; });
+
+			return it == population.end() ? 0.0 : it->rank;
+		}
+
+		mutable RankCache _rankLookup;
 		mutable std::random_device _rndDevice;
 		mutable std::atomic<bool> _stopRequested;
-		mutable std::mutex _mutex;
+		mutable std::mutex _popManMutex;
 	};
 
 	struct ImplicitFunction;
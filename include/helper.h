@@ -41,7 +41,9 @@ namespace lmu
 		}
 		long long tick()
 		{
-			current = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - _time).count();
+			auto duration = std::chrono::high_resolution_clock::now() - _time;
+			current = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+			currentMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
 			reset();
 
 			return current;
@@ -53,6 +55,7 @@ namespace lmu
 		}
 
 		long long current;
+		long long currentMicroseconds;
 
 	private:
 		std::chrono::high_resolution_clock::time_point _time;
@@ -0,0 +1,116 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+// Compile-time log level. Statements above this level are removed by the preprocessor.
+// 0: Off, 1: Error, 2: Warning, 3: Info, 4: Debug, 5: Trace
+#ifndef LMU_LOG_LEVEL
+#define LMU_LOG_LEVEL 4
+#endif
+
+namespace lmu
+{
+	enum class LogLevel
+	{
+		Off = 0,
+		Error,
+		Warning,
+		Info,
+		Debug,
+		Trace
+	};
+
+	enum class LogFormat
+	{
+		Text = 0,
+		Json
+	};
+
+	extern std::atomic<int> g_logLevel;
+
+	inline bool isLogLevelEnabled(LogLevel level)
+	{
+		return (int)level <= g_logLevel.load(std::memory_order_relaxed);
+	}
+
+	void setLogLevel(LogLevel level);
+	LogLevel logLevel();
+
+	// Text: one message per line. Json: one object per line with level, thread, file, line and message.
+	void setLogFormat(LogFormat format);
+
+	// Empty path => std::cout.
+	void setLogFile(const std::string& path);
+
+	// Accepts off, error, warning, info, debug, trace and text, json. Throws on unknown names.
+	LogLevel logLevelFromString(const std::string& level);
+	LogFormat logFormatFromString(const std::string& format);
+
+	// Debug and trace records are buffered per thread and written to the sink as a whole if the buffer is full,
+	// on the next record with a higher level, on flushLog() and when the thread exits.
+	// Flushes the buffer of the calling thread.
+	void flushLog();
+
+	class LogRecord
+	{
+	public:
+
+		LogRecord(LogLevel level, const char* file, int line);
+		~LogRecord();
+
+		std::ostream& stream()
+		{
+			return _stream;
+		}
+
+	private:
+
+		LogLevel _level;
+		const char* _file;
+		int _line;
+		std::ostringstream _stream;
+	};
+}
+
+// True if records of the given level are compiled in and enabled at runtime. Use it to skip building expensive messages.
+#define LMU_LOG_ENABLED(level) (LMU_LOG_LEVEL >= (int)(level) && lmu::isLogLevelEnabled(level))
+
+#define LMU_LOG(level, message) \
+	do { if (lmu::isLogLevelEnabled(level)) { lmu::LogRecord(level, __FILE__, __LINE__).stream() << message; } } while (0)
+
+#define LMU_LOG_DISABLED(message) do { } while (0)
+
+#if LMU_LOG_LEVEL >= 1
+#define LMU_LOG_ERROR(message) LMU_LOG(lmu::LogLevel::Error, message)
+#else
+#define LMU_LOG_ERROR(message) LMU_LOG_DISABLED(message)
+#endif
+
+#if LMU_LOG_LEVEL >= 2
+#define LMU_LOG_WARNING(message) LMU_LOG(lmu::LogLevel::Warning, message)
+#else
+#define LMU_LOG_WARNING(message) LMU_LOG_DISABLED(message)
+#endif
+
+#if LMU_LOG_LEVEL >= 3
+#define LMU_LOG_INFO(message) LMU_LOG(lmu::LogLevel::Info, message)
+#else
+#define LMU_LOG_INFO(message) LMU_LOG_DISABLED(message)
+#endif
+
+#if LMU_LOG_LEVEL >= 4
+#define LMU_LOG_DEBUG(message) LMU_LOG(lmu::LogLevel::Debug, message)
+#else
+#define LMU_LOG_DEBUG(message) LMU_LOG_DISABLED(message)
+#endif
+
+#if LMU_LOG_LEVEL >= 5
+#define LMU_LOG_TRACE(message) LMU_LOG(lmu::LogLevel::Trace, message)
+#else
+#define LMU_LOG_TRACE(message) LMU_LOG_DISABLED(message)
+#endif
+
+#endif
@@ -490,6 +490,9 @@ namespace lmu
 
 	// Read primitives saved with the .PRIM file format
 	std::vector<std::shared_ptr<ImplicitFunction>> fromFilePRIM(const std::string& file);
+
+	// Hash of the functions' names, types, parameters and points. Stays the same across runs for the same input.
+	size_t fingerprint(const std::vector<std::shared_ptr<ImplicitFunction>>& functions, size_t seed = 0);
 }
 
 #endif
\ No newline at end of file
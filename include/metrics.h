@@ -0,0 +1,136 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace lmu
+{
+	// Metrics of one GA iteration of one island. Counters are the increments of this iteration, durations are in microseconds.
+	struct IterationMetrics
+	{
+		IterationMetrics() :
+			run(0),
+			island(0),
+			iteration(0),
+			levelOfDetail(0),
+			bestScore(0.0),
+			worstScore(0.0),
+			optMicroseconds(0),
+			rankingMicroseconds(0),
+			sortingMicroseconds(0),
+			scmMicroseconds(0),
+			numEvaluations(0),
+			numEvaluatedPoints(0),
+			numCacheHits(0),
+			numCacheTries(0),
+			cacheSize(0),
+			rankingUtilization(0.0),
+			peakMemoryBytes(0)
+		{
+		}
+
+		long long iterationMicroseconds() const
+		{
+			return optMicroseconds + rankingMicroseconds + sortingMicroseconds + scmMicroseconds;
+		}
+
+		// Points evaluated per second of ranking time.
+		double pointsPerSecond() const
+		{
+			return rankingMicroseconds <= 0 ? 0.0 : (double)numEvaluatedPoints * 1e6 / (double)rankingMicroseconds;
+		}
+
+		// Fingerprint of the run's input, tells apart runs that share a sink (e.g. the GAs of the partitions of a model).
+		uint64_t run;
+		int island;
+		int iteration;
+		int levelOfDetail;
+		double bestScore;
+		double worstScore;
+
+		long long optMicroseconds;
+		long long rankingMicroseconds;
+		long long sortingMicroseconds;
+		long long scmMicroseconds;
+
+		int numEvaluations;
+		uint64_t numEvaluatedPoints;
+		int numCacheHits;
+		int numCacheTries;
+		size_t cacheSize;
+		double rankingUtilization;
+
+		size_t peakMemoryBytes;
+	};
+
+	// Streams iteration metrics while a run is in progress, e.g. for dashboards.
+	// file: one line per iteration, CSV if the name ends with .csv, JSON lines otherwise. Not written if empty.
+	// prometheusFile: latest values and totals per run and island in the Prometheus text format. The file is replaced atomically
+	// at most once per second (and when the sink is flushed or destroyed), so it can be served by a file based exporter. Not written if empty.
+	// Safe to use from concurrently evolving islands and runs.
+	class MetricsSink
+	{
+	public:
+
+		// The sink of these files, shared by all runs of the process that stream to them. Files are truncated when they are opened first
+		// and stay open until the process ends, so runs one after another (or at the same time) add to the same files.
+		static std::shared_ptr<MetricsSink> open(const std::string& file, const std::string& prometheusFile);
+
+		MetricsSink(const std::string& file, const std::string& prometheusFile);
+		~MetricsSink();
+
+		MetricsSink(const MetricsSink&) = delete;
+		MetricsSink& operator=(const MetricsSink&) = delete;
+
+		void record(const IterationMetrics& metrics);
+
+		// Writes the Prometheus file now.
+		void flush();
+
+	private:
+
+		struct IslandTotals
+		{
+			IslandTotals() :
+				numEvaluations(0),
+				numEvaluatedPoints(0),
+				numCacheHits(0),
+				numCacheTries(0),
+				rankingMicroseconds(0),
+				iterationMicroseconds(0)
+			{
+			}
+
+			IterationMetrics latest;
+			uint64_t numEvaluations;
+			uint64_t numEvaluatedPoints;
+			uint64_t numCacheHits;
+			uint64_t numCacheTries;
+			uint64_t rankingMicroseconds;
+			uint64_t iterationMicroseconds;
+		};
+
+		//Need _mutex to be locked.
+		void writeLine(const IterationMetrics& metrics);
+		void writePrometheusFile();
+
+		std::ofstream _file;
+		bool _csv;
+		std::string _prometheusFile;
+		//Key: (run, island).
+		std::map<std::pair<uint64_t, int>, IslandTotals> _islands;
+		std::chrono::steady_clock::time_point _lastPrometheusWrite;
+		std::mutex _mutex;
+	};
+
+	// Peak resident memory of the process in bytes (high-water mark), 0 if not available.
+	size_t peakMemoryUsage();
+}
+
+#endif
@@ -15,6 +15,9 @@ namespace lmu
   PointCloud readPointCloud(const std::string& file, double scaleFactor=1.0);
   PointCloud readPointCloudXYZ(const std::string& file, double scaleFactor=1.0);
   PointCloud pointCloudFromMesh(const lmu::Mesh & mesh, double delta, double samplingRate, double errorSigma);
+
+  // Keeps one point per occupied cell of a grid with the given cell size: the one closest to the cell center.
+  PointCloud voxelGridSubsample(const PointCloud& points, double voxelSize);
   
   Eigen::MatrixXd getSIFTKeypoints(Eigen::MatrixXd& points, double minScale, double minContrast, int numOctaves, int numScalesPerOctave, bool normalsAvailable);
 
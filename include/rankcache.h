@@ -0,0 +1,140 @@
+#ifndef RANKCACHE_H
+#define RANKCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "checkpoint.h"
+
+namespace boost
+{
+	namespace interprocess
+	{
+		class file_lock;
+		class file_mapping;
+		class mapped_region;
+	}
+}
+
+namespace lmu
+{
+	// Concurrent map from creature hashes to ranks with a bounded number of entries.
+	// Entries are distributed over shards with a mutex each. A full shard evicts with the CLOCK policy:
+	// the hand sweeps over the entries, clears their referenced flag and evicts the first entry that was not looked up since the last sweep.
+	class RankCache
+	{
+	public:
+
+		struct Counters
+		{
+			long long numHits = 0;
+			long long numMisses = 0;
+			long long numEvictions = 0;
+		};
+
+		// capacity == 0 => unbounded.
+		explicit RankCache(size_t capacity = 0, int numShards = 16);
+
+		// Drops all entries if the capacity changes. Must not be called concurrently with other members.
+		void setCapacity(size_t capacity);
+		size_t capacity() const;
+
+		bool find(size_t hash, double& rank);
+		// Returns true if another entry was evicted.
+		bool insert(size_t hash, double rank);
+
+		void clear();
+		size_t size() const;
+
+		Counters counters() const;
+
+		// Entries incl. the eviction state. Must not be called concurrently with other members.
+		// Entries are restored as they were if the capacity and the number of shards are the same, otherwise they are inserted one by one.
+		void writeTo(CheckpointWriter& writer) const;
+		void readFrom(CheckpointReader& reader);
+
+	private:
+
+		struct Entry
+		{
+			size_t hash;
+			double rank;
+			bool referenced;
+		};
+
+		struct Shard
+		{
+			std::mutex mutex;
+			std::vector<Entry> entries;
+			std::unordered_map<size_t, size_t> index;
+			size_t hand = 0;
+		};
+
+		Shard& shard(size_t hash) const;
+
+		std::vector<std::unique_ptr<Shard>> _shards;
+		size_t _capacity;
+		size_t _shardCapacity;
+
+		std::atomic<long long> _numHits;
+		std::atomic<long long> _numMisses;
+		std::atomic<long long> _numEvictions;
+	};
+
+	// Map from (context, creature hash) to ranks, stored in a memory mapped file so that ranks survive the process.
+	// The context identifies everything the rank depends on apart from the creature (ranker parameters, input data),
+	// the creature hash must not depend on the run (e.g. no pointer values).
+	// The file holds a header and an open addressing table with linear probing that is doubled in place when it is 70% full.
+	// Files that are not valid are reset. A file is used by one process at a time,
+	// it is locked through a lock file next to it (file + ".lock").
+	class PersistentRankCache
+	{
+	public:
+
+		~PersistentRankCache();
+
+		PersistentRankCache(const PersistentRankCache&) = delete;
+		PersistentRankCache& operator=(const PersistentRankCache&) = delete;
+
+		// Returns the cache of the given file, all callers in the process share one instance per file. 
+		// Throws if the file cannot be mapped or is used by another process.
+		static std::shared_ptr<PersistentRankCache> open(const std::string& file);
+
+		bool find(uint64_t context, uint64_t hash, double& rank) const;
+		void insert(uint64_t context, uint64_t hash, double rank);
+
+		size_t size() const;
+		std::string file() const;
+
+		// Writes modified pages back to the file.
+		void flush();
+
+	private:
+
+		struct Header;
+		struct Slot;
+
+		explicit PersistentRankCache(const std::string& file);
+
+		void map(uint64_t numSlots);
+		void unmap();
+		void grow();
+
+		Header& header() const;
+		Slot* slots() const;
+		Slot* findSlot(uint64_t context, uint64_t hash) const;
+
+		std::string _file;
+		std::unique_ptr<boost::interprocess::file_lock> _lock;
+		std::unique_ptr<boost::interprocess::file_mapping> _mapping;
+		std::unique_ptr<boost::interprocess::mapped_region> _region;
+		mutable std::mutex _mutex;
+	};
+}
+
+#endif
@@ -6,6 +6,9 @@
 #include "csgnode_evo.h"
 #include "csgnode_helper.h"
 #include "evolution.h"
+#include "collision.h"
+#include "dnf.h"
+#include "rankcache.h"
 
 using namespace lmu;
 
@@ -152,4 +155,264 @@ TEST(CSGNodeTest)
 	mergedNode = mergeCSGNodeCliqueSimple(clique);
 }
 
-#endif
\ No newline at end of file
+TEST(CSGNodeSerializationTest)
+{
+	using namespace lmu;
+
+	auto g = geometries({ "A", "B", "C", "D" });
+	std::vector<ImplicitFunctionPtr> functions = { g["A"], g["B"], g["C"], g["D"] };
+
+	CSGNode node = createOperation(CSGNodeOperationType::Union, "root",
+	{
+		opDiff(
+		{
+			geometry(g["A"]),
+			opInter(
+			{
+				geometry(g["B"]),
+				geometry(g["C"]),
+				geometry(g["D"])
+			})
+		}),
+		geometry(g["C"])
+	});
+
+	auto data = serializeCSGNode(node, functions);
+	CSGNode restored = deserializeCSGNode(data, functions);
+
+	std::stringstream ss1, ss2;
+	ss1 << serializeNode(node);
+	ss2 << serializeNode(restored);
+	ASSERT_EQ(ss2.str(), ss1.str());
+	ASSERT_EQ(numNodes(restored), numNodes(node));
+	ASSERT_TRUE(serializeCSGNode(restored, functions) == data);
+
+	//Geometries are restored with their functions (and names), operations lose their names.
+	ASSERT_TRUE(restored.childsCRef()[1].function() == g["C"]);
+	ASSERT_EQ(restored.name(), std::string());
+
+	bool thrown = false;
+	try
+	{
+		serializeCSGNode(node, { g["A"], g["B"] });
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE(thrown);
+
+	thrown = false;
+	try
+	{
+		deserializeCSGNode({ data.begin(), data.end() - 1 }, functions);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE(thrown);
+}
+
+TEST(CollisionTest)
+{
+	using namespace lmu;
+
+	auto translation = [](double x, double y, double z)
+	{
+		Eigen::Affine3d t = Eigen::Affine3d::Identity();
+		t.translate(Eigen::Vector3d(x, y, z));
+		return t;
+	};
+
+	Eigen::Affine3d rotated = translation(2.3, 0.0, 0.0);
+	rotated.rotate(Eigen::AngleAxisd(0.25 * 3.14159265358979323846, Eigen::Vector3d(0.0, 0.0, 1.0)));
+
+	IFBox box(translation(0.0, 0.0, 0.0), Eigen::Vector3d(2.0, 2.0, 2.0), 1, "box");
+
+	ASSERT_TRUE(collides(box, IFBox(translation(1.9, 0.0, 0.0), Eigen::Vector3d(2.0, 2.0, 2.0), 1, "")));
+	ASSERT_TRUE(!collides(box, IFBox(translation(2.1, 0.0, 0.0), Eigen::Vector3d(2.0, 2.0, 2.0), 1, "")));
+	ASSERT_TRUE(collides(box, IFBox(rotated, Eigen::Vector3d(2.0, 2.0, 2.0), 1, "")));
+	
+	//Containment counts as collision.
+	ASSERT_TRUE(collides(box, IFBox(translation(0.0, 0.0, 0.0), Eigen::Vector3d(0.2, 0.2, 0.2), 1, "")));
+
+	ASSERT_TRUE(!collides(IFSphere(translation(2.0, 2.0, 0.0), 1.0, ""), box));
+	ASSERT_TRUE(collides(IFSphere(translation(1.5, 1.5, 0.0), 1.0, ""), box));
+
+	IFCylinder cylinder(translation(0.0, 0.0, 0.0), 1.0, 2.0, "cylinder");
+
+	ASSERT_TRUE(!collides(cylinder, IFCylinder(translation(2.1, 0.0, 0.0), 1.0, 2.0, "")));
+	ASSERT_TRUE(collides(cylinder, IFCylinder(translation(1.9, 0.0, 0.0), 1.0, 2.0, "")));
+	ASSERT_TRUE(!collides(IFSphere(translation(0.0, 2.1, 0.0), 1.0, ""), cylinder));
+}
+
+TEST(DNFTest)
+{
+	using namespace lmu;
+
+	auto clause = [](const std::string& s)
+	{
+		Clause c(s.size());
+		for (size_t i = 0; i < s.size(); ++i)
+		{
+			c.literals[i] = s[i] != '-';
+			c.negated[i] = s[i] == '0';
+		}
+		return c;
+	};
+
+	auto contains = [](const DNF& dnf, int x)
+	{
+		for (const auto& c : dnf.clauses)
+		{
+			bool inside = true;
+			for (size_t i = 0; i < c.size(); ++i)
+				inside &= !c.literals[i] || c.negated[i] != (bool)((x >> i) & 1);
+			if (inside)
+				return true;
+		}
+		return false;
+	};
+
+	DNF dnf;
+	dnf.functions.resize(3);
+	dnf.clauses = { clause("110"), clause("111"), clause("011"), clause("1-0") };
+
+	DNF minimized = minimizeDNF(dnf);
+
+	//A & !C | B & C (A & B is covered by the other two clauses).
+	ASSERT_EQ(minimized.clauses.size(), 2u);
+	for (int x = 0; x < 8; ++x)
+		ASSERT_EQ(contains(minimized, x), contains(dnf, x));
+}
+
+TEST(ShapiroTest)
+{
+	using namespace lmu;
+
+	//(A | B) - C, sampled on the surface of the solid. Normals of C's points point into C.
+	const double pi = 3.14159265358979323846;
+	auto sphere = [](double x, double y, double z, double r, const std::string& name)
+	{
+		Eigen::Affine3d t = Eigen::Affine3d::Identity();
+		t.translate(Eigen::Vector3d(x, y, z));
+		return std::make_shared<IFSphere>(t, r, name);
+	};
+	std::vector<double> radii = { 1.0, 1.0, 0.6 };
+	std::vector<ImplicitFunctionPtr> functions = { sphere(0.0, 0.0, 0.0, radii[0], "A"), sphere(1.2, 0.0, 0.0, radii[1], "B"), sphere(0.6, 0.9, 0.0, radii[2], "C") };
+	const int n = functions.size();
+
+	auto solidDistance = [&](const Eigen::Vector3d& p)
+	{
+		return std::max(std::min(functions[0]->signedDistance(p), functions[1]->signedDistance(p)), -functions[2]->signedDistance(p));
+	};
+
+	for (int f = 0; f < n; ++f)
+	{
+		const int numSamples = 400;
+		std::vector<Eigen::Matrix<double, 1, 6>> points;
+		for (int j = 0; j < numSamples; ++j)
+		{
+			//Fibonacci sphere.
+			double z = 1.0 - 2.0 * (j + 0.5) / numSamples;
+			double phi = j * pi * (3.0 - std::sqrt(5.0));
+			Eigen::Vector3d normal(std::cos(phi) * std::sqrt(1.0 - z * z), std::sin(phi) * std::sqrt(1.0 - z * z), z);
+			Eigen::Vector3d p = functions[f]->pos() + radii[f] * normal;
+			if (std::abs(solidDistance(p)) > 1e-6)
+				continue;
+
+			Eigen::Matrix<double, 1, 6> pn;
+			pn << p.transpose(), (f == 2 ? -normal : normal).transpose();
+			points.push_back(pn);
+		}
+
+		PointCloud pc(points.size(), 6);
+		for (size_t j = 0; j < points.size(); ++j)
+			pc.row(j) = points[j];
+		functions[f]->setPoints(pc);
+	}
+
+	SampleParams params = { 0.01 };
+	Graph graph = createConnectionGraph(functions);
+	auto outlierTestValues = computeOutlierTestValues(functions, params.h);
+	auto table = createClauseScoringTable(functions, outlierTestValues, graph, params);
+
+	//Baseline: all negation patterns of the clause with all functions as literals scored one by one, 
+	//valid with both scores >= 0.6 (see getValidClauses()).
+	DNF expected;
+	expected.functions = functions;
+	for (int pattern = 0; pattern < (1 << n); ++pattern)
+	{
+		Clause clause(n);
+		for (int i = 0; i < n; ++i)
+		{
+			clause.literals[i] = true;
+			clause.negated[i] = ((pattern >> i) & 1) != 0;
+		}
+
+		auto scores = scoreClause(clause, functions, n, outlierTestValues, graph, params);
+		auto tableScores = scoreClause(clause, table);
+		ASSERT_EQ(std::get<1>(tableScores), std::get<1>(scores));
+		ASSERT_EQ(std::get<2>(tableScores), std::get<2>(scores));
+
+		if (std::get<1>(scores) >= 0.6 && std::get<2>(scores) >= 0.6)
+			expected.clauses.push_back(clause);
+	}
+	ASSERT_TRUE(!expected.clauses.empty());
+
+	//x: bit i is set if the point is inside functions[i].
+	auto contains = [&](const DNF& dnf, int x)
+	{
+		for (const auto& c : dnf.clauses)
+		{
+			bool inside = true;
+			for (size_t i = 0; i < c.size(); ++i)
+			{
+				int f = std::find(functions.begin(), functions.end(), dnf.functions[i]) - functions.begin();
+				inside &= !c.literals[i] || c.negated[i] != (bool)((x >> f) & 1);
+			}
+			if (inside)
+				return true;
+		}
+		return false;
+	};
+
+	DNF dnf = computeShapiro(functions, false, graph, params);
+	for (int x = 0; x < (1 << n); ++x)
+		ASSERT_EQ(contains(dnf, x), contains(expected, x));
+
+	//A & !C | B & !C.
+	for (int x = 0; x < (1 << n); ++x)
+		ASSERT_EQ(contains(dnf, x), (x & 3) != 0 && (x & 4) == 0);
+}
+
+TEST(RankCacheTest)
+{
+	using namespace lmu;
+
+	RankCache cache(2, 1);
+
+	double rank;
+	ASSERT_TRUE(!cache.find(1, rank));
+
+	cache.insert(1, 1.0);
+	cache.insert(2, 2.0);
+	ASSERT_TRUE(cache.find(1, rank));
+	ASSERT_EQ(rank, 1.0);
+
+	//2 was not looked up since its insertion and is evicted first.
+	cache.insert(3, 3.0);
+	ASSERT_EQ(cache.size(), 2u);
+	ASSERT_TRUE(cache.find(1, rank));
+	ASSERT_TRUE(!cache.find(2, rank));
+	ASSERT_TRUE(cache.find(3, rank));
+	ASSERT_EQ(rank, 3.0);
+
+	auto counters = cache.counters();
+	ASSERT_EQ(counters.numHits, 3);
+	ASSERT_EQ(counters.numMisses, 2);
+	ASSERT_EQ(counters.numEvictions, 1);
+}
+
+#endif
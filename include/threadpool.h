@@ -0,0 +1,143 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lmu
+{
+	using Task = std::function<void()>;
+
+	// Work-stealing thread pool.
+	// Every worker owns a deque: tasks spawned by a worker are pushed to and popped from the back of its own deque,
+	// idle workers steal from the front of the other workers' deques. Tasks submitted by other threads go to a shared queue.
+	class ThreadPool
+	{
+	public:
+
+		// numThreads <= 0 => one worker per hardware thread.
+		explicit ThreadPool(int numThreads = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		int numThreads() const;
+
+		// Index of the worker running on the calling thread, -1 if the calling thread is not a worker of this pool.
+		int workerIndex() const;
+
+		void submit(Task task);
+
+		// Executes one pending task on the calling thread. Returns false if no task was available.
+		bool runPendingTask();
+
+		// Pool shared by all algorithms of the library.
+		static ThreadPool& instance();
+
+	private:
+
+		struct Worker
+		{
+			std::deque<Task> tasks;
+			std::mutex mutex;
+		};
+
+		bool popTask(Task& task);
+		void work(int workerIndex);
+
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::vector<std::thread> _threads;
+
+		std::deque<Task> _sharedTasks;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+		std::atomic<int> _numPendingTasks;
+		bool _stop;
+	};
+
+	// Set of tasks that can be waited for.
+	// Tasks are queued in the group, the pool only receives tickets that run the next queued task of the group.
+	// A waiting thread executes the group's queued tasks itself and then blocks until the ones other threads claimed are done.
+	// It never runs tasks of other groups, so a wait does not depend on unrelated (possibly long running) work and groups can be nested inside of tasks.
+	class TaskGroup
+	{
+	public:
+
+		explicit TaskGroup(ThreadPool& pool = ThreadPool::instance());
+		~TaskGroup();
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		void run(Task task);
+
+		// Waits for all tasks of the group. Rethrows the first exception thrown by a task.
+		void wait();
+
+	private:
+
+		//Shared with the tickets in the pool, which may outlive the group.
+		struct State;
+
+		void waitForTasks();
+
+		ThreadPool& _pool;
+		std::shared_ptr<State> _state;
+	};
+
+	// Calls f(i) for all i in [begin, end). Indices are processed in chunks of grainSize.
+	template<typename Func>
+	void parallelFor(int begin, int end, int grainSize, const Func& f, ThreadPool& pool = ThreadPool::instance())
+	{
+		grainSize = grainSize < 1 ? 1 : grainSize;
+
+		TaskGroup group(pool);
+		for (int chunkBegin = begin; chunkBegin < end; chunkBegin += grainSize)
+		{
+			int chunkEnd = chunkBegin + grainSize < end ? chunkBegin + grainSize : end;
+			group.run([chunkBegin, chunkEnd, &f]()
+			{
+				for (int i = chunkBegin; i < chunkEnd; ++i)
+					f(i);
+			});
+		}
+		group.wait();
+	}
+
+	// Calls f(i) for all i in [0, costs.size()), starting with the largest cost. 
+	// Indices are handed out in that order to a task per worker, independent of the order in which the pool executes tasks.
+	template<typename Func>
+	void parallelForLargestFirst(const std::vector<double>& costs, const Func& f, ThreadPool& pool = ThreadPool::instance())
+	{
+		std::vector<int> order(costs.size());
+		for (int i = 0; i < (int)order.size(); ++i)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&costs](int i0, int i1) { return costs[i0] > costs[i1]; });
+
+		std::atomic<size_t> next(0);
+		int numTasks = std::min((int)order.size(), pool.numThreads());
+
+		TaskGroup group(pool);
+		for (int t = 0; t < numTasks; ++t)
+		{
+			group.run([&order, &next, &f]()
+			{
+				size_t k;
+				while ((k = next++) < order.size())
+					f(order[k]);
+			});
+		}
+		group.wait();
+	}
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef WORKERPROCESSES_H
+#define WORKERPROCESSES_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace lmu
+{
+	// Local worker processes that evaluate requests with a handler, e.g. to rank trees outside of the coordinating process.
+	// Workers are forked in the constructor and see the memory of the coordinator at that time (shared copy-on-write),
+	// large read-only data like point clouds is therefore not copied. Requests and results are exchanged over pipes.
+	// A crashed or hanging worker is replaced by a new one. Only supported on POSIX systems.
+	class WorkerProcesses
+	{
+	public:
+
+		// Runs in the worker process. It must not rely on other threads of the coordinator (e.g. the thread pool or log buffers).
+		using Handler = std::function<double(const std::vector<int>& request)>;
+
+		// pinWorkers: Binds worker i to cpu i modulo the number of cpus (Linux only).
+		// timeoutMilliseconds: max. time a worker may take for a request, <= 0 => no limit.
+		WorkerProcesses(int numWorkers, const Handler& handler, bool pinWorkers = false, int timeoutMilliseconds = 0);
+		~WorkerProcesses();
+
+		WorkerProcesses(const WorkerProcesses&) = delete;
+		WorkerProcesses& operator=(const WorkerProcesses&) = delete;
+
+		static bool isSupported();
+
+		int numWorkers() const;
+
+		// Sends the request to the next idle worker and waits for the result. Safe to call concurrently.
+		// Throws if the worker died, timed out or the handler threw. The worker is replaced if it died or timed out.
+		double call(const std::vector<int>& request);
+
+	private:
+
+		struct Worker
+		{
+			int pid = -1;
+			int requestFd = -1;
+			int resultFd = -1;
+		};
+
+		//Both need _forkMutex to be locked: forked workers must not inherit pipes that are half set up.
+		void start(int idx);
+		void stop(int idx);
+
+		Handler _handler;
+		bool _pinWorkers;
+		int _timeoutMilliseconds;
+		std::vector<Worker> _workers;
+
+		std::mutex _forkMutex;
+
+		std::vector<int> _idleWorkers;
+		std::mutex _mutex;
+		std::condition_variable _condition;
+	};
+}
+
+#endif
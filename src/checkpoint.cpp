@@ -0,0 +1,97 @@
+#include "checkpoint.h"
+#include "log.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+bool lmu::writeFileAtomically(const std::string& file, const std::string& data)
+{
+	const std::string tmpFile = file + ".tmp";
+	{
+		std::ofstream fs(tmpFile, std::ios::binary | std::ios::trunc);
+		fs.write(data.data(), data.size());
+		fs.close();
+
+		if (!fs)
+		{
+			LMU_LOG_WARNING("Could not write file " << tmpFile << ".");
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	//rename does not replace existing files on Windows.
+	std::remove(file.c_str());
+#endif
+	if (std::rename(tmpFile.c_str(), file.c_str()) != 0)
+	{
+		LMU_LOG_WARNING("Could not replace file " << file << ".");
+		return false;
+	}
+
+	return true;
+}
+
+std::string lmu::fingerprintedFile(const std::string& file, uint64_t fingerprint)
+{
+	std::stringstream ss;
+	ss << std::hex << fingerprint;
+
+	//Only a dot in the file name starts an extension, not one in a directory name.
+	size_t dirEnd = file.find_last_of("/\\");
+	size_t dot = file.find_last_of('.');
+	if (dot == std::string::npos || (dirEnd != std::string::npos && dot < dirEnd))
+		return file + "." + ss.str();
+
+	return file.substr(0, dot) + "." + ss.str() + file.substr(dot);
+}
+
+lmu::AsyncCheckpointFile::AsyncCheckpointFile(const std::string& file) :
+	_file(file)
+{
+}
+
+lmu::AsyncCheckpointFile::~AsyncCheckpointFile()
+{
+	wait();
+}
+
+void lmu::AsyncCheckpointFile::write(std::string data)
+{
+	wait();
+
+	std::string file = _file;
+	_pendingWrite = std::async(std::launch::async, [file](const std::string& data)
+	{
+		writeFileAtomically(file, data);
+	}, std::move(data));
+}
+
+void lmu::AsyncCheckpointFile::wait()
+{
+	if (_pendingWrite.valid())
+		_pendingWrite.get();
+}
+
+void lmu::AsyncCheckpointFile::remove()
+{
+	wait();
+	std::remove(_file.c_str());
+}
+
+bool lmu::AsyncCheckpointFile::read(std::string& data) const
+{
+	std::ifstream fs(_file, std::ios::binary);
+	if (!fs.is_open())
+		return false;
+
+	data.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+	return true;
+}
+
+std::string lmu::AsyncCheckpointFile::file() const
+{
+	return _file;
+}
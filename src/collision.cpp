@@ -1,25 +1,350 @@
 #include "..\include\collision.h"
 #include "..\include\mesh.h"
+#include "..\include\log.h"
 #include "igl/copyleft/cgal/intersect_other.h"
 
+#include <cmath>
+
+// Convex bound of a primitive in world space.
+// Box:      halfExtents are the half sizes along the axes.
+// Cylinder: axis is axes.col(1), halfExtents = (radius, half height, radius).
+// Sphere:   halfExtents = (radius, radius, radius).
+struct ConvexBound
+{
+	lmu::ImplicitFunctionType type;
+	Eigen::Vector3d center;
+	Eigen::Matrix3d axes;
+	Eigen::Vector3d halfExtents;
+};
+
+const double collisionEpsilon = 1e-9;
+
+// The displacement term of spheres and boxes is in [-1,1] and added to the signed distance.
+double displacementMargin(double displacement)
+{
+	return displacement == 0.0 ? 0.0 : 1.0;
+}
+
+// Splits the linear part of the transform into orthonormal axes and per-axis scale.
+// Returns false for sheared transforms.
+bool orthogonalFrame(const Eigen::Affine3d& transform, Eigen::Matrix3d& axes, Eigen::Vector3d& scale)
+{
+	Eigen::Matrix3d l = transform.linear();
+
+	for (int i = 0; i < 3; ++i)
+	{
+		scale[i] = l.col(i).norm();
+		if (scale[i] < collisionEpsilon)
+			return false;
+		axes.col(i) = l.col(i) / scale[i];
+	}
+
+	const double orthoEpsilon = 1e-6;
+	return
+		std::abs(axes.col(0).dot(axes.col(1))) < orthoEpsilon &&
+		std::abs(axes.col(0).dot(axes.col(2))) < orthoEpsilon &&
+		std::abs(axes.col(1).dot(axes.col(2))) < orthoEpsilon;
+}
+
+bool almostEqual(double a, double b)
+{
+	return std::abs(a - b) <= 1e-6 * std::max(std::abs(a), std::abs(b));
+}
+
+ConvexBound boxBound(const Eigen::Vector3d& center, const Eigen::Matrix3d& axes, const Eigen::Vector3d& halfExtents)
+{
+	return ConvexBound{ lmu::ImplicitFunctionType::Box, center, axes, halfExtents };
+}
+
+// Local cylinder (axis = local y) centered at localCenter. Falls back to a box if the cross section is not circular.
+ConvexBound cylinderBound(const Eigen::Affine3d& transform, const Eigen::Matrix3d& axes, const Eigen::Vector3d& scale,
+	const Eigen::Vector3d& localCenter, double radius, double halfHeight)
+{
+	Eigen::Vector3d center = transform * localCenter;
+
+	if (!almostEqual(scale.x(), scale.z()))
+		return boxBound(center, axes, Eigen::Vector3d(radius * scale.x(), halfHeight * scale.y(), radius * scale.z()));
+
+	return ConvexBound{ lmu::ImplicitFunctionType::Cylinder, center, axes, Eigen::Vector3d(radius * scale.x(), halfHeight * scale.y(), radius * scale.x()) };
+}
+
+bool convexBound(const lmu::ImplicitFunction& f, ConvexBound& bound)
+{
+	Eigen::Matrix3d axes;
+	Eigen::Vector3d scale;
+	if (!orthogonalFrame(f.transform(), axes, scale))
+		return false;
+
+	switch (f.type())
+	{
+	case lmu::ImplicitFunctionType::Sphere:
+	{
+		const auto& s = static_cast<const lmu::IFSphere&>(f);
+		double r = s.radius() + displacementMargin(s.displacement());
+
+		if (almostEqual(scale.x(), scale.y()) && almostEqual(scale.x(), scale.z()))
+			bound = ConvexBound{ lmu::ImplicitFunctionType::Sphere, f.pos(), axes, Eigen::Vector3d::Constant(r * scale.x()) };
+		else
+			bound = boxBound(f.pos(), axes, r * scale);
+		return true;
+	}
+	case lmu::ImplicitFunctionType::Box:
+	{
+		const auto& b = static_cast<const lmu::IFBox&>(f);
+		Eigen::Vector3d h = b.size() * 0.5 + Eigen::Vector3d::Constant(displacementMargin(b.displacement()));
+
+		bound = boxBound(f.pos(), axes, h.cwiseProduct(scale));
+		return true;
+	}
+	case lmu::ImplicitFunctionType::Cylinder:
+	{
+		const auto& c = static_cast<const lmu::IFCylinder&>(f);
+
+		bound = cylinderBound(f.transform(), axes, scale, Eigen::Vector3d(0.0, 0.0, 0.0), c.radius(), c.height() * 0.5);
+		return true;
+	}
+	case lmu::ImplicitFunctionType::Cone:
+	{
+		// The distance function describes a cone with apex at the origin and base at y = -c.z,
+		// the mesh a frustum centered at the origin. The bounding cylinder covers both.
+		Eigen::Vector3d c = static_cast<const lmu::IFCone&>(f).c();
+		double h = std::abs(c.z());
+		double r = std::max(std::max(std::abs(c.x()), std::abs(c.y())), std::abs(c.z() * c.y() / c.x()));
+		if (!std::isfinite(r))
+			return false;
+
+		bound = cylinderBound(f.transform(), axes, scale, Eigen::Vector3d(0.0, -0.25 * h, 0.0), r, 0.75 * h);
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+// Radius of the projection of the bound onto the unit axis n.
+double projectedRadius(const ConvexBound& b, const Eigen::Vector3d& n)
+{
+	switch (b.type)
+	{
+	case lmu::ImplicitFunctionType::Sphere:
+		return b.halfExtents.x();
+	case lmu::ImplicitFunctionType::Cylinder:
+	{
+		double na = std::abs(n.dot(b.axes.col(1)));
+		return b.halfExtents.y() * na + b.halfExtents.x() * std::sqrt(std::max(0.0, 1.0 - na * na));
+	}
+	default:
+		return
+			b.halfExtents.x() * std::abs(n.dot(b.axes.col(0))) +
+			b.halfExtents.y() * std::abs(n.dot(b.axes.col(1))) +
+			b.halfExtents.z() * std::abs(n.dot(b.axes.col(2)));
+	}
+}
+
+void addSeparatingAxisCandidates(const ConvexBound& b, std::vector<Eigen::Vector3d>& axes)
+{
+	if (b.type == lmu::ImplicitFunctionType::Box)
+	{
+		axes.push_back(b.axes.col(0));
+		axes.push_back(b.axes.col(1));
+		axes.push_back(b.axes.col(2));
+	}
+	else if (b.type == lmu::ImplicitFunctionType::Cylinder)
+	{
+		axes.push_back(b.axes.col(1));
+	}
+}
+
+double clamp01(double v)
+{
+	return std::min(std::max(v, 0.0), 1.0);
+}
+
+// Distance between segments [p1,q1] and [p2,q2] (Ericson, Real-Time Collision Detection, 5.1.9).
+double segmentSegmentDistance(const Eigen::Vector3d& p1, const Eigen::Vector3d& q1, const Eigen::Vector3d& p2, const Eigen::Vector3d& q2)
+{
+	Eigen::Vector3d d1 = q1 - p1;
+	Eigen::Vector3d d2 = q2 - p2;
+	Eigen::Vector3d r = p1 - p2;
+	double a = d1.squaredNorm();
+	double e = d2.squaredNorm();
+	double f = d2.dot(r);
+	double s = 0.0;
+	double t = 0.0;
+
+	if (a <= collisionEpsilon && e <= collisionEpsilon)
+		return r.norm();
+
+	if (a <= collisionEpsilon)
+	{
+		t = clamp01(f / e);
+	}
+	else
+	{
+		double c = d1.dot(r);
+		if (e <= collisionEpsilon)
+		{
+			s = clamp01(-c / a);
+		}
+		else
+		{
+			double b = d1.dot(d2);
+			double denom = a * e - b * b;
+
+			s = denom != 0.0 ? clamp01((b * f - c * e) / denom) : 0.0;
+			t = (b * s + f) / e;
+
+			if (t < 0.0)
+			{
+				t = 0.0;
+				s = clamp01(-c / a);
+			}
+			else if (t > 1.0)
+			{
+				t = 1.0;
+				s = clamp01((b - c) / a);
+			}
+		}
+	}
+
+	return ((p1 + d1 * s) - (p2 + d2 * t)).norm();
+}
+
+// Distance from point p to the volume of the bound (0 if p is inside).
+double pointDistance(const Eigen::Vector3d& p, const ConvexBound& b)
+{
+	Eigen::Vector3d q = b.axes.transpose() * (p - b.center);
+
+	switch (b.type)
+	{
+	case lmu::ImplicitFunctionType::Sphere:
+		return std::max(q.norm() - b.halfExtents.x(), 0.0);
+	case lmu::ImplicitFunctionType::Cylinder:
+	{
+		double dr = std::max(Eigen::Vector2d(q.x(), q.z()).norm() - b.halfExtents.x(), 0.0);
+		double dy = std::max(std::abs(q.y()) - b.halfExtents.y(), 0.0);
+		return Eigen::Vector2d(dr, dy).norm();
+	}
+	default:
+		return (q.cwiseAbs() - b.halfExtents).cwiseMax(0.0).norm();
+	}
+}
+
+bool boundsOverlap(const ConvexBound& b1, const ConvexBound& b2)
+{
+	//Exact test if one of the bounds is a sphere.
+	if (b1.type == lmu::ImplicitFunctionType::Sphere)
+		return pointDistance(b1.center, b2) < b1.halfExtents.x();
+	if (b2.type == lmu::ImplicitFunctionType::Sphere)
+		return pointDistance(b2.center, b1) < b2.halfExtents.x();
+
+	Eigen::Vector3d d = b2.center - b1.center;
+
+	if (b1.type == lmu::ImplicitFunctionType::Cylinder && b2.type == lmu::ImplicitFunctionType::Cylinder)
+	{
+		//The capsules around both cylinders do not touch.
+		Eigen::Vector3d a1 = b1.axes.col(1) * b1.halfExtents.y();
+		Eigen::Vector3d a2 = b2.axes.col(1) * b2.halfExtents.y();
+		if (segmentSegmentDistance(b1.center - a1, b1.center + a1, b2.center - a2, b2.center + a2) >= b1.halfExtents.x() + b2.halfExtents.x())
+			return false;
+	}
+
+	std::vector<Eigen::Vector3d> faceAxes;
+	addSeparatingAxisCandidates(b1, faceAxes);
+	size_t numFaceAxes1 = faceAxes.size();
+	addSeparatingAxisCandidates(b2, faceAxes);
+
+	std::vector<Eigen::Vector3d> candidates = faceAxes;
+	for (size_t i = 0; i < numFaceAxes1; ++i)
+		for (size_t j = numFaceAxes1; j < faceAxes.size(); ++j)
+			candidates.push_back(faceAxes[i].cross(faceAxes[j]));
+
+	//Direction between centers and its components orthogonal to the cylinder axes.
+	candidates.push_back(d);
+	if (b1.type == lmu::ImplicitFunctionType::Cylinder)
+		candidates.push_back(d - d.dot(b1.axes.col(1)) * b1.axes.col(1));
+	if (b2.type == lmu::ImplicitFunctionType::Cylinder)
+		candidates.push_back(d - d.dot(b2.axes.col(1)) * b2.axes.col(1));
+
+	for (const auto& candidate : candidates)
+	{
+		double l = candidate.norm();
+		if (l < collisionEpsilon)
+			continue;
+
+		Eigen::Vector3d n = candidate / l;
+		if (std::abs(d.dot(n)) >= projectedRadius(b1, n) + projectedRadius(b2, n))
+			return false;
+	}
+
+	return true;
+}
+
+bool collidesAnalytic(const lmu::ImplicitFunction& f1, const lmu::ImplicitFunction& f2, bool& result)
+{
+	ConvexBound b1, b2;
+	if (!convexBound(f1, b1) || !convexBound(f2, b2))
+		return false;
+
+	result = boundsOverlap(b1, b2);
+	return true;
+}
+
+bool collidesOrMesh(const lmu::ImplicitFunction& f1, const lmu::ImplicitFunction& f2)
+{
+	bool result;
+	if (collidesAnalytic(f1, f2, result))
+		return result;
+
+	//mesh-mesh collision check fallback.
+	return lmu::collides(f1.meshCRef(), f2.meshCRef());
+}
+
 bool lmu::collides(const lmu::ImplicitFunction & f1, const lmu::ImplicitFunction & f2)
 {
 	if (f1.type() == ImplicitFunctionType::Sphere && f2.type() == ImplicitFunctionType::Sphere)
 		return collides(static_cast<const lmu::IFSphere&>(f1), static_cast<const lmu::IFSphere&>(f2));
-	else //mesh-mesh collision check fallback.
-		return collides(f1.meshCRef(), f2.meshCRef());
-
-	return false;
+	else
+		return collidesOrMesh(f1, f2);
 }
 
 bool lmu::collides(const lmu::IFSphere & f1, const lmu::IFSphere & f2)
 {
+	bool result;
+	if (collidesAnalytic(f1, f2, result))
+		return result;
+
 	return (f1.pos() - f2.pos()).squaredNorm() < (f1.radius() + f2.radius())*(f1.radius() + f2.radius());
 }
 
+bool lmu::collides(const lmu::IFSphere& f1, const lmu::IFBox& f2)
+{
+	return collidesOrMesh(f1, f2);
+}
+
+bool lmu::collides(const lmu::IFSphere& f1, const lmu::IFCylinder& f2)
+{
+	return collidesOrMesh(f1, f2);
+}
+
+bool lmu::collides(const lmu::IFBox& f1, const lmu::IFBox& f2)
+{
+	return collidesOrMesh(f1, f2);
+}
+
+bool lmu::collides(const lmu::IFCylinder& f1, const lmu::IFBox& f2)
+{
+	return collidesOrMesh(f1, f2);
+}
+
+bool lmu::collides(const lmu::IFCylinder& f1, const lmu::IFCylinder& f2)
+{
+	return collidesOrMesh(f1, f2);
+}
+
 bool lmu::collides(const lmu::Mesh& m1, const lmu::Mesh& m2)
 {
 	Eigen::MatrixXi iF;
-	std::cout << "COLLIDES" << std::endl;
+	LMU_LOG_DEBUG("COLLIDES");
 	return igl::copyleft::cgal::intersect_other(m1.vertices, m1.indices, m2.vertices, m2.indices, true, iF);
 }
@@ -3,9 +3,10 @@
 #include "..\include\congraph.h"
 #include "..\include\mesh.h"
 #include "..\include\collision.h"
+#include "..\include\log.h"
+#include "..\include\threadpool.h"
 
 #include "boost/graph/graphviz.hpp"
-#include "boost/graph/bron_kerbosch_all_cliques.hpp"
 #include "boost/graph/copy.hpp"
 #include <boost/graph/biconnected_components.hpp>
 #include <boost/graph/adjacency_list.hpp>
@@ -13,6 +14,9 @@
 
 #include <boost/dynamic_bitset.hpp>
 
+#include <bitset>
+#include <mutex>
+
 std::ostream& lmu::operator<<(std::ostream& os, const lmu::Clique& c)
 {
 	os << "Clique#";
@@ -117,37 +121,137 @@ lmu::Graph lmu::createConnectionGraph(const std::vector<std::shared_ptr<lmu::Imp
 	return graph;
 }
 
-void createConnectionGraphRec(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize, std::vector<boost::dynamic_bitset<>>& overlaps)
+// Upper bound for the Lipschitz constant of the function's signed distance in world space.
+double lipschitzBound(const lmu::ImplicitFunction& f)
+{
+	double l = f.transform().linear().inverse().jacobiSvd().singularValues()(0);
+
+	//The displacement term sin(ax)sin(ay)sin(az) has a gradient of at most sqrt(3)*|a|.
+	double displacement = 0.0;
+	if (f.type() == lmu::ImplicitFunctionType::Sphere)
+		displacement = static_cast<const lmu::IFSphere&>(f).displacement();
+	else if (f.type() == lmu::ImplicitFunctionType::Box)
+		displacement = static_cast<const lmu::IFBox&>(f).displacement();
+
+	return l * (1.0 + std::sqrt(3.0) * std::abs(displacement));
+}
+
+struct OctreeFunction
+{
+	std::shared_ptr<lmu::ImplicitFunction> function;
+	int index;
+	double lipschitz;
+};
+
+// Cell i of the 8 children of the cell [min, min + s].
+Eigen::Vector3d octantMin(const Eigen::Vector3d& min, const Eigen::Vector3d& s, int i)
+{
+	return min + 0.5 * Eigen::Vector3d((i & 1) ? s.x() : 0.0, (i & 2) ? s.y() : 0.0, (i & 4) ? s.z() : 0.0);
+}
+
+// Evaluates the distances of all functions at the centers of the 8 child cells (distances[child * funcs.size() + function]).
+std::vector<double> evaluateOctantCenters(const std::vector<OctreeFunction>& funcs, const Eigen::Vector3d& min, const Eigen::Vector3d& s)
+{
+	std::vector<double> distances(8 * funcs.size());
+
+	Eigen::Vector3d centers[8];
+	for (int c = 0; c < 8; ++c)
+		centers[c] = octantMin(min, s, c) + 0.25 * s;
+
+	for (size_t i = 0; i < funcs.size(); ++i)
+		for (int c = 0; c < 8; ++c)
+			distances[c * funcs.size() + i] = funcs[i].function->signedDistance(centers[c]);
+
+	return distances;
+}
+
+// Marks all functions containing the cell center as overlapping and returns the functions that may still reach into the cell. 
+// An empty result means that the subtree cannot contribute new overlaps:
+// Either less than two functions reach into the cell or all of them contain the complete cell.
+std::vector<OctreeFunction> processOctreeCell(const std::vector<OctreeFunction>& funcs, const double* distances, double halfDiagonal, std::vector<boost::dynamic_bitset<>>& overlaps)
 {
-	//std::cout << "part: " << std::endl << min << std::endl << max << std::endl;
+	boost::dynamic_bitset<> isIn(overlaps.size());
+	for (size_t i = 0; i < funcs.size(); ++i)
+		isIn[funcs[i].index] = distances[i] < 0.0;
+
+	for (size_t i = 0; i < funcs.size(); ++i)
+		if (isIn[funcs[i].index])
+			overlaps[funcs[i].index] |= isIn;
 
-	if ((max - min).norm() < minCellSize)
+	std::vector<OctreeFunction> remaining;
+	bool anyBoundary = false;
+	for (size_t i = 0; i < funcs.size(); ++i)
+	{
+		double bound = funcs[i].lipschitz * halfDiagonal;
+		if (distances[i] <= bound)
+		{
+			remaining.push_back(funcs[i]);
+			anyBoundary |= distances[i] >= -bound;
+		}
+	}
+
+	if (remaining.size() < 2 || !anyBoundary)
+		remaining.clear();
+
+	return remaining;
+}
+
+void createConnectionGraphRec(const std::vector<OctreeFunction>& funcs, const double* distances, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize, std::vector<boost::dynamic_bitset<>>& overlaps)
+{
+	Eigen::Vector3d s = (max - min);
+	if (s.norm() < minCellSize)
+		return;
+
+	auto remaining = processOctreeCell(funcs, distances, 0.5 * s.norm(), overlaps);
+	if (remaining.empty() || (0.5 * s).norm() < minCellSize)
 		return;
 
+	auto childDistances = evaluateOctantCenters(remaining, min, s);
+
+	for (int c = 0; c < 8; ++c)
+	{
+		Eigen::Vector3d childMin = octantMin(min, s, c);
+		createConnectionGraphRec(remaining, &childDistances[c * remaining.size()], childMin, childMin + 0.5 * s, minCellSize, overlaps);
+	}
+}
+
+// Adaptive octree: Cells are only subdivided as long as they can contribute new overlaps (see processOctreeCell()). 
+// Top-level octants are processed in parallel with separate overlap matrices that are merged afterwards.
+void createConnectionGraphRec(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& impFuncs, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize, std::vector<boost::dynamic_bitset<>>& overlaps)
+{
 	Eigen::Vector3d s = (max - min);
-	Eigen::Vector3d p = min + 0.5 * s;
-	
-	boost::dynamic_bitset<> isIn(funcs.size());
-	
-	for (int i = 0; i < funcs.size(); ++i)	
-		isIn[i] = funcs[i]->signedDistance(p) < 0.0;	
-	
-	for (int i = 0; i < funcs.size(); ++i)
-		overlaps[i] = isIn[i] ? overlaps[i] | isIn : overlaps[i]; // overlaps[i] | isIn;
-		
-	createConnectionGraphRec(funcs, min, min + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, 0.0, 0.0),			min + Eigen::Vector3d(s.x() * 0.5, 0.0, 0.0) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(0.0, s.y() * 0.5, 0.0),			min + Eigen::Vector3d(0.0, s.y() * 0.5, 0.0) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, 0.0),	min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, 0.0) + 0.5 * s, minCellSize, overlaps);
-
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(0.0, 0.0, s.z() * 0.5),			min + Eigen::Vector3d(0.0, 0.0, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, 0.0, s.z() * 0.5),	min + Eigen::Vector3d(s.x() * 0.5, 0.0, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(0.0, s.y() * 0.5, s.z() * 0.5),	min + Eigen::Vector3d(0.0, s.y() * 0.5, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-	createConnectionGraphRec(funcs, min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, s.z() * 0.5), min + Eigen::Vector3d(s.x() * 0.5, s.y() * 0.5, s.z() * 0.5) + 0.5 * s, minCellSize, overlaps);
-		
-	//All bits are set.
-	if (isIn.count() == funcs.size())
-		return; 
+	if (s.norm() < minCellSize)
+		return;
+
+	std::vector<OctreeFunction> funcs;
+	for (int i = 0; i < (int)impFuncs.size(); ++i)
+	{
+		//Null functions never contain a point.
+		if (impFuncs[i]->type() != lmu::ImplicitFunctionType::Null)
+			funcs.push_back({ impFuncs[i], i, lipschitzBound(*impFuncs[i]) });
+	}
+
+	std::vector<double> distances(funcs.size());
+	for (size_t i = 0; i < funcs.size(); ++i)
+		distances[i] = funcs[i].function->signedDistance(min + 0.5 * s);
+
+	auto remaining = processOctreeCell(funcs, distances.data(), 0.5 * s.norm(), overlaps);
+	if (remaining.empty() || (0.5 * s).norm() < minCellSize)
+		return;
+
+	auto childDistances = evaluateOctantCenters(remaining, min, s);
+
+	std::vector<std::vector<boost::dynamic_bitset<>>> octantOverlaps(8, std::vector<boost::dynamic_bitset<>>(overlaps.size(), boost::dynamic_bitset<>(overlaps.size(), false)));
+
+	lmu::parallelFor(0, 8, 1, [&](int c)
+	{
+		Eigen::Vector3d childMin = octantMin(min, s, c);
+		createConnectionGraphRec(remaining, &childDistances[c * remaining.size()], childMin, childMin + 0.5 * s, minCellSize, octantOverlaps[c]);
+	});
+
+	for (const auto& o : octantOverlaps)
+		for (size_t i = 0; i < overlaps.size(); ++i)
+			overlaps[i] |= o[i];
 }
 
 lmu::Graph lmu::createConnectionGraph(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& impFuncs, const Eigen::Vector3d & min, const Eigen::Vector3d & max, double minCellSize)
@@ -189,8 +293,6 @@ lmu::Graph lmu::createConnectionGraph(const std::vector<std::shared_ptr<lmu::Imp
 			j++;
 		}
 
-		std::cout << std::endl;
-
 		i++;
 	}
 	
@@ -264,40 +366,251 @@ void lmu::writeConnectionGraph(const std::string& file, const lmu::Graph & graph
 	f.close();
 }
 
-struct CliqueCollector
+using CliqueBitset = std::vector<std::uint64_t>;
+
+// Bron-Kerbosch with Tomita pivoting on 64 bit adjacency rows. 
+struct CliqueEnumerator
 {
-	CliqueCollector(std::vector<lmu::Clique>& cliques) :
-		cliques(cliques)
+	CliqueEnumerator(const lmu::CSRGraph& g, int minCliqueSize, const lmu::CliqueCallback& callback, std::mutex& callbackMutex) :
+		g(g),
+		words(g.wordsPerRow),
+		minCliqueSize(minCliqueSize),
+		callback(callback),
+		callbackMutex(callbackMutex)
 	{
+		if (!g.adjacency.empty())
+		{
+			rows = g.adjacency.data();
+		}
+		else
+		{
+			ownRows.assign((size_t)g.numVertices() * words, 0);
+			for (int v = 0; v < g.numVertices(); ++v)
+				for (int i = g.offsets[v]; i < g.offsets[v + 1]; ++i)
+					ownRows[(size_t)v * words + (g.targets[i] >> 6)] |= std::uint64_t(1) << (g.targets[i] & 63);
+			rows = ownRows.data();
+		}
+	}
+
+	const std::uint64_t* row(int v) const
+	{
+		return rows + (size_t)v * words;
+	}
 
+	int countIntersection(const CliqueBitset& a, const std::uint64_t* b) const
+	{
+		int c = 0;
+		for (int w = 0; w < words; ++w)
+			c += (int)std::bitset<64>(a[w] & b[w]).count();
+		return c;
 	}
 
-	template <typename Clique, typename Graph>
-	void clique(const Clique& c, const Graph& g)
+	void intersect(const CliqueBitset& a, const std::uint64_t* b, CliqueBitset& res) const
 	{
+		for (int w = 0; w < words; ++w)
+			res[w] = a[w] & b[w];
+	}
+
+	void emit(const std::vector<int>& r)
+	{
+		if ((int)r.size() < minCliqueSize)
+			return;
+
 		lmu::Clique clique;
-		// Iterate over the clique and print each vertex within it.
-		typename Clique::const_iterator i, end = c.end();
-		for (i = c.begin(); i != end; ++i)
+		clique.functions.reserve(r.size());
+		for (int v : r)
+			clique.functions.push_back(g.functions[v]);
+
+		std::lock_guard<std::mutex> lock(callbackMutex);
+		callback(clique, r);
+	}
+
+	void expand(std::vector<int>& r, CliqueBitset& p, CliqueBitset& x)
+	{
+		bool pEmpty = true;
+		bool xEmpty = true;
+		for (int w = 0; w < words; ++w)
+		{
+			pEmpty &= p[w] == 0;
+			xEmpty &= x[w] == 0;
+		}
+
+		if (pEmpty)
+		{
+			if (xEmpty)
+				emit(r);
+			return;
+		}
+
+		//Tomita pivot: vertex in P u X with the most neighbors in P.
+		int pivot = -1;
+		int maxNeighbors = -1;
+		for (int w = 0; w < words; ++w)
+		{
+			std::uint64_t bits = p[w] | x[w];
+			while (bits)
+			{
+				int u = w * 64 + ctz(bits);
+				bits &= bits - 1;
+
+				int n = countIntersection(p, row(u));
+				if (n > maxNeighbors)
+				{
+					maxNeighbors = n;
+					pivot = u;
+				}
+			}
+		}
+
+		CliqueBitset candidates(words);
+		for (int w = 0; w < words; ++w)
+			candidates[w] = p[w] & ~row(pivot)[w];
+
+		CliqueBitset newP(words), newX(words);
+		for (int w = 0; w < words; ++w)
 		{
-			clique.functions.push_back(g[*i]);
+			while (candidates[w])
+			{
+				int v = w * 64 + ctz(candidates[w]);
+				candidates[w] &= candidates[w] - 1;
+
+				intersect(p, row(v), newP);
+				intersect(x, row(v), newX);
+
+				r.push_back(v);
+				expand(r, newP, newX);
+				r.pop_back();
+
+				p[w] &= ~(std::uint64_t(1) << (v & 63));
+				x[w] |= std::uint64_t(1) << (v & 63);
+			}
 		}
-		cliques.push_back(clique);
-		std::cout << "CLIQUE! " << cliques.size() << std::endl;
 	}
 
-	std::vector<lmu::Clique>& cliques;
+	//Index of the lowest set bit (v != 0).
+	static int ctz(std::uint64_t v)
+	{
+		return (int)std::bitset<64>((v & (~v + 1)) - 1).count();
+	}
+
+	const lmu::CSRGraph& g;
+	int words;
+	int minCliqueSize;
+	const lmu::CliqueCallback& callback;
+	std::mutex& callbackMutex;
+	const std::uint64_t* rows;
+	std::vector<std::uint64_t> ownRows;
 };
 
+// Vertices ordered by repeatedly removing a vertex of minimum degree (Matula & Beck).
+std::vector<int> degeneracyOrdering(const lmu::CSRGraph& g)
+{
+	int n = g.numVertices();
+	std::vector<int> degree(n);
+	int maxDegree = 0;
+	for (int v = 0; v < n; ++v)
+	{
+		degree[v] = g.degree(v);
+		maxDegree = std::max(maxDegree, degree[v]);
+	}
+
+	std::vector<std::vector<int>> buckets(maxDegree + 1);
+	for (int v = 0; v < n; ++v)
+		buckets[degree[v]].push_back(v);
+
+	std::vector<char> removed(n, 0);
+	std::vector<int> order;
+	order.reserve(n);
+
+	int d = 0;
+	while ((int)order.size() < n)
+	{
+		d = std::max(0, d - 1);
+		while (buckets[d].empty())
+			d++;
+
+		int v = buckets[d].back();
+		buckets[d].pop_back();
+
+		//Skip outdated bucket entries.
+		if (removed[v] || degree[v] != d)
+			continue;
+
+		removed[v] = 1;
+		order.push_back(v);
+
+		for (int i = g.offsets[v]; i < g.offsets[v + 1]; ++i)
+		{
+			int w = g.targets[i];
+			if (!removed[w] && w != v)
+				buckets[--degree[w]].push_back(w);
+		}
+	}
+
+	return order;
+}
+
+void lmu::enumerateCliques(const lmu::Graph& graph, const CliqueCallback& callback, int minCliqueSize)
+{
+	auto csr = createCSRGraph(graph);
+	auto order = degeneracyOrdering(csr);
+
+	std::vector<int> position(order.size());
+	for (int i = 0; i < (int)order.size(); ++i)
+		position[order[i]] = i;
+
+	std::mutex callbackMutex;
+	CliqueEnumerator enumerator(csr, minCliqueSize, callback, callbackMutex);
+
+	//Each maximal clique is found exactly once starting from its vertex that comes first in the degeneracy order.
+	lmu::parallelFor(0, order.size(), 1, [&](int i)
+	{
+		int v = order[i];
+		CliqueBitset p(csr.wordsPerRow, 0);
+		CliqueBitset x(csr.wordsPerRow, 0);
+
+		for (int j = csr.offsets[v]; j < csr.offsets[v + 1]; ++j)
+		{
+			int w = csr.targets[j];
+			if (w == v)
+				continue;
+
+			if (position[w] > i)
+				p[w >> 6] |= std::uint64_t(1) << (w & 63);
+			else
+				x[w >> 6] |= std::uint64_t(1) << (w & 63);
+		}
+
+		std::vector<int> r(1, v);
+		enumerator.expand(r, p, x);
+	});
+}
+
 std::vector<lmu::Clique> lmu::getCliques(const lmu::Graph & graph)
 {
-	std::vector<lmu::Clique> cliques;
-	CliqueCollector cc(cliques);
+	std::vector<std::tuple<std::vector<int>, lmu::Clique>> cliques;
+
+	enumerateCliques(graph, [&cliques](const lmu::Clique& clique, const std::vector<int>& vertices)
+	{
+		auto sortedVertices = vertices;
+		std::sort(sortedVertices.begin(), sortedVertices.end());
+		cliques.push_back(std::make_tuple(sortedVertices, clique));
+	});
+
+	//Enumeration order depends on thread scheduling.
+	std::sort(cliques.begin(), cliques.end(), [](const std::tuple<std::vector<int>, lmu::Clique>& c1, const std::tuple<std::vector<int>, lmu::Clique>& c2)
+	{
+		return std::get<0>(c1) < std::get<0>(c2);
+	});
+
+	std::vector<lmu::Clique> res;
+	res.reserve(cliques.size());
+	for (const auto& c : cliques)
+		res.push_back(std::get<1>(c));
 
-	// Use the Bron-Kerbosch algorithm to find all cliques.
-	boost::bron_kerbosch_all_cliques(graph.structure, cc);
+	LMU_LOG_INFO("Found " << res.size() << " cliques.");
 
-	return cliques;
+	return res;
 }
 
 std::vector<std::shared_ptr<lmu::ImplicitFunction>> lmu::getImplicitFunctions(const lmu::Graph & graph)
@@ -326,59 +639,259 @@ void lmu::recreateVertexLookup(lmu::Graph& graph)
 	}
 }
 
-//From https://stackoverflow.com/questions/26763193/return-a-list-of-connected-component-subgraphs-in-boost-graph
-std::vector<lmu::Graph> lmu::getConnectedComponents(lmu::Graph const & g)
+lmu::CSRGraph lmu::createCSRGraph(const lmu::Graph& g)
 {
-	using cid = lmu::GraphStructure::vertices_size_type;
-	std::map<lmu::GraphStructure::vertex_descriptor, cid> mapping;
-	//std::map<Graph::vertex_descriptor, default_color_type> colors;
-
-	cid num = boost::connected_components(
-		g.structure,
-		boost::make_assoc_property_map(mapping)//,
-		//color_map(make_assoc_property_map(colors))
-	);
-
-	std::vector<lmu::GraphStructure> componentGraphs(num);
-
-	std::map<lmu::GraphStructure::vertex_descriptor, int> vim;
-	for (auto const& vd : boost::make_iterator_range(vertices(g.structure)))
-		vim.emplace(vd, vim.size());
-
-	for (cid i = 0; i < num; i++)
-	{
-		typedef boost::filtered_graph<
-			GraphStructure,
-			std::function<bool(EdgeDescriptor)>,
-			std::function<bool(VertexDescriptor)>
-		> FilteredView;
-
-		boost::copy_graph(FilteredView(g.structure,
-			[&](EdgeDescriptor e) {
-			return mapping[source(e, g.structure)] == i
-				|| mapping[target(e, g.structure)] == i;
-		},
-			[&](VertexDescriptor v) {
-			return mapping[v] == i;
+	CSRGraph res;
+
+	int n = (int)boost::num_vertices(g.structure);
+	res.functions.resize(n);
+	res.offsets.assign(n + 1, 0);
+	res.numEdges = 0;
+
+	for (int v = 0; v < n; ++v)
+		res.functions[v] = g.structure[v];
+
+	std::vector<std::pair<int, int>> edges;
+	edges.reserve(boost::num_edges(g.structure));
+	boost::graph_traits<GraphStructure>::edge_iterator ei, ei_end;
+	for (boost::tie(ei, ei_end) = boost::edges(g.structure); ei != ei_end; ++ei)
+	{
+		int u = (int)boost::source(*ei, g.structure);
+		int v = (int)boost::target(*ei, g.structure);
+		edges.push_back(std::make_pair(u, v));
+		res.offsets[u + 1]++;
+		res.offsets[v + 1]++;
+	}
+	res.numEdges = (int)edges.size();
+
+	for (int v = 0; v < n; ++v)
+		res.offsets[v + 1] += res.offsets[v];
+
+	std::vector<int> pos(res.offsets.begin(), res.offsets.end() - 1);
+	std::vector<std::pair<int, int>> adjacent(res.offsets[n]);
+	for (int e = 0; e < res.numEdges; ++e)
+	{
+		adjacent[pos[edges[e].first]++] = std::make_pair(edges[e].second, e);
+		adjacent[pos[edges[e].second]++] = std::make_pair(edges[e].first, e);
+	}
+
+	res.targets.resize(adjacent.size());
+	res.edgeIds.resize(adjacent.size());
+	for (int v = 0; v < n; ++v)
+	{
+		std::sort(adjacent.begin() + res.offsets[v], adjacent.begin() + res.offsets[v + 1]);
+		for (int i = res.offsets[v]; i < res.offsets[v + 1]; ++i)
+		{
+			res.targets[i] = adjacent[i].first;
+			res.edgeIds[i] = adjacent[i].second;
 		}
-			),
-			componentGraphs[i],
-			vertex_index_map(boost::make_assoc_property_map(vim)));
 	}
 
-	std::vector<lmu::Graph> res;
-	res.reserve(componentGraphs.size());
+	res.wordsPerRow = (n + 63) / 64;
+	if (n <= CSRGraph::maxBitMatrixVertices)
+	{
+		res.adjacency.assign((size_t)n * res.wordsPerRow, 0);
+		for (const auto& e : edges)
+		{
+			res.adjacency[e.first * res.wordsPerRow + (e.second >> 6)] |= std::uint64_t(1) << (e.second & 63);
+			res.adjacency[e.second * res.wordsPerRow + (e.first >> 6)] |= std::uint64_t(1) << (e.first & 63);
+		}
+	}
 
-	for (const auto& componentGraph : componentGraphs)
+	return res;
+}
+
+lmu::Graph lmu::createGraph(const lmu::CSRGraph& g, const std::vector<int>& vertices, const std::vector<char>& edgeEnabled)
+{
+	lmu::Graph res;
+
+	std::unordered_map<int, VertexDescriptor> localVertices;
+	localVertices.reserve(vertices.size());
+	for (int v : vertices)
+		localVertices[v] = addVertex(res, g.functions[v]);
+
+	for (int v : vertices)
 	{
-		lmu::Graph g;
-		g.structure = componentGraph; 
-		recreateVertexLookup(g);
-		res.push_back(g);
+		int lastSelfLoop = -1;
+		for (int i = g.offsets[v]; i < g.offsets[v + 1]; ++i)
+		{
+			int w = g.targets[i];
+			int e = g.edgeIds[i];
+
+			//Each edge is stored twice, self loops twice in the same list.
+			if (w < v || (!edgeEnabled.empty() && !edgeEnabled[e]) || (w == v && e == lastSelfLoop))
+				continue;
+			
+			auto it = localVertices.find(w);
+			if (it == localVertices.end())
+				continue;
+
+			if (w == v)
+				lastSelfLoop = e;
+
+			addEdge(res, localVertices[v], it->second);
+		}
 	}
 
 	return res;
-	
+}
+
+int lmu::connectedComponents(const lmu::CSRGraph& g, std::vector<int>& component, const std::vector<char>& edgeEnabled)
+{
+	int n = g.numVertices();
+	component.assign(n, -1);
+
+	int numComponents = 0;
+	std::vector<int> queue;
+	queue.reserve(n);
+
+	for (int root = 0; root < n; ++root)
+	{
+		if (component[root] != -1)
+			continue;
+
+		queue.clear();
+		queue.push_back(root);
+		component[root] = numComponents;
+
+		for (size_t qi = 0; qi < queue.size(); ++qi)
+		{
+			int v = queue[qi];
+			for (int i = g.offsets[v]; i < g.offsets[v + 1]; ++i)
+			{
+				int w = g.targets[i];
+				if (component[w] == -1 && (edgeEnabled.empty() || edgeEnabled[g.edgeIds[i]]))
+				{
+					component[w] = numComponents;
+					queue.push_back(w);
+				}
+			}
+		}
+
+		numComponents++;
+	}
+
+	return numComponents;
+}
+
+//Iterative version of the Hopcroft-Tarjan algorithm.
+int lmu::biconnectedComponents(const lmu::CSRGraph& g, std::vector<int>& edgeComponent, std::vector<int>& articulationPoints)
+{
+	struct Frame
+	{
+		int v;
+		int parentEdge;
+		int next;
+		int numChildren;
+	};
+
+	int n = g.numVertices();
+	edgeComponent.assign(g.numEdges, -1);
+	articulationPoints.clear();
+
+	std::vector<int> discover(n, -1);
+	std::vector<int> low(n, 0);
+	std::vector<char> isArticulationPoint(n, 0);
+	std::vector<int> edgeStack;
+	std::vector<Frame> stack;
+	int time = 0;
+	int numComponents = 0;
+
+	for (int root = 0; root < n; ++root)
+	{
+		if (discover[root] != -1)
+			continue;
+
+		discover[root] = low[root] = time++;
+		stack.push_back({ root, -1, g.offsets[root], 0 });
+
+		while (!stack.empty())
+		{
+			Frame& f = stack.back();
+
+			if (f.next < g.offsets[f.v + 1])
+			{
+				int i = f.next++;
+				int w = g.targets[i];
+				int e = g.edgeIds[i];
+
+				if (e == f.parentEdge)
+					continue;
+
+				if (discover[w] == -1)
+				{
+					edgeStack.push_back(e);
+					f.numChildren++;
+					discover[w] = low[w] = time++;
+					stack.push_back({ w, e, g.offsets[w], 0 });
+				}
+				else if (discover[w] < discover[f.v])
+				{
+					//Back edge.
+					edgeStack.push_back(e);
+					low[f.v] = std::min(low[f.v], discover[w]);
+				}
+				continue;
+			}
+
+			Frame child = f;
+			stack.pop_back();
+
+			if (stack.empty())
+			{
+				//The root is an articulation point if it has more than one DFS child.
+				if (child.numChildren > 1)
+					articulationPoints.push_back(child.v);
+				break;
+			}
+
+			int parent = stack.back().v;
+			low[parent] = std::min(low[parent], low[child.v]);
+
+			if (low[child.v] >= discover[parent])
+			{
+				if (stack.size() > 1 && !isArticulationPoint[parent])
+				{
+					isArticulationPoint[parent] = 1;
+					articulationPoints.push_back(parent);
+				}
+
+				int e;
+				do
+				{
+					e = edgeStack.back();
+					edgeStack.pop_back();
+					edgeComponent[e] = numComponents;
+				} while (e != child.parentEdge);
+
+				numComponents++;
+			}
+		}
+	}
+
+	return numComponents;
+}
+
+std::vector<lmu::Graph> createComponentGraphs(const lmu::CSRGraph& g, const std::vector<char>& edgeEnabled)
+{
+	std::vector<int> component;
+	int num = lmu::connectedComponents(g, component, edgeEnabled);
+
+	std::vector<std::vector<int>> componentVertices(num);
+	for (int v = 0; v < g.numVertices(); ++v)
+		componentVertices[component[v]].push_back(v);
+
+	std::vector<lmu::Graph> res;
+	res.reserve(num);
+	for (const auto& vertices : componentVertices)
+		res.push_back(lmu::createGraph(g, vertices, edgeEnabled));
+
+	return res;
+}
+
+std::vector<lmu::Graph> lmu::getConnectedComponents(lmu::Graph const & g)
+{
+	return createComponentGraphs(createCSRGraph(g), std::vector<char>());
 }
 
 /*
@@ -401,109 +914,96 @@ std::vector<lmu::Graph> lmu::getBridgeSeparatedConnectedComponents(const Graph&
 		3. Iterate again over all edges and check if the edge counter of the corresponding component is 1, if so this edge is a bridge
 	*/
 
-	lmu::Graph res = g;
-
-	//Get component property map 
-	boost::property_map <GraphStructure, boost::edge_component_t >::type
-		component = boost::get(boost::edge_component_t(), res.structure);
-
-	//Get pruned property map
-	//boost::property_map <GraphStructure, boost::edge_pruned_t >::type
-	//	pruned = boost::get(boost::edge_pruned_t(), res.structure);
-
+	auto csr = createCSRGraph(g);
 
 	//1
-	auto numComponents = biconnected_components(res.structure, component);
+	std::vector<int> component;
+	std::vector<int> artPoints;
+	auto numComponents = biconnectedComponents(csr, component, artPoints);
 
 	//2
-	std::vector<size_t> edgeCounter (numComponents, 0);
-	boost::graph_traits <GraphStructure>::edge_iterator ei, ei_end;
-	for (boost::tie(ei, ei_end) = boost::edges(res.structure); ei != ei_end; ++ei)
-			edgeCounter[component[*ei]]++;
+	std::vector<size_t> edgeCounter(numComponents, 0);
+	for (int c : component)
+		if (c != -1)
+			edgeCounter[c]++;
 
 	//3 + remove all bridges
-	res = filterGraph(res, [&edgeCounter, &component](const EdgeDescriptor& edge)
-	{
-		return edgeCounter[component[edge]] != 1; // || pruned[edge];
-	});
+	std::vector<char> edgeEnabled(csr.numEdges);
+	for (int e = 0; e < csr.numEdges; ++e)
+		edgeEnabled[e] = component[e] == -1 || edgeCounter[component[e]] != 1;
 	
-	//
-	return getConnectedComponents(res);
+	return createComponentGraphs(csr, edgeEnabled);
 }
 
 std::vector<lmu::Graph> lmu::getArticulationPointSeparatedConnectedComponents(const Graph& g)
 {
-	auto gCopy = g;
+	auto csr = createCSRGraph(g);
 	std::vector<lmu::Graph> res;
 
-	//Get component property map 
-	boost::property_map <GraphStructure, boost::edge_component_t >::type
-		component = boost::get(boost::edge_component_t(), gCopy.structure);
-
-	auto numComponents = biconnected_components(gCopy.structure, component);
-
-	std::cout << "Num Components: " << numComponents << std::endl;
+	std::vector<int> component;
+	std::vector<int> artPoints;
+	auto numComponents = biconnectedComponents(csr, component, artPoints);
 
-	std::vector<VertexDescriptor> artPoints;
-	boost::articulation_points(gCopy.structure, std::back_inserter(artPoints));
+	LMU_LOG_INFO("Num Components: " << numComponents);
 
-	std::unordered_map<VertexDescriptor, std::unordered_set<size_t>> componentIds;
-	std::unordered_map<VertexDescriptor, std::vector<size_t>> sortedComponentIds;
+	std::vector<char> isArticulationPoint(csr.numVertices(), 0);
+	for (int ap : artPoints)
+		isArticulationPoint[ap] = 1;
 
 	//Iterate over all neighboring edges of all vertices to get components that a certain vertex is part of.
-	boost::graph_traits<GraphStructure>::vertex_iterator vi, vi_end;
-	for (boost::tie(vi, vi_end) = boost::vertices(gCopy.structure); vi != vi_end; ++vi)
+	std::vector<std::vector<int>> sortedComponentIds(csr.numVertices());
+	for (int v = 0; v < csr.numVertices(); ++v)
 	{
-		typename boost::graph_traits <lmu::GraphStructure>::out_edge_iterator ei, ei_end;
-		for (boost::tie(ei, ei_end) = boost::out_edges(*vi, gCopy.structure); ei != ei_end; ++ei)
-		{
-			componentIds[*vi].insert(component[*ei]);
-		}
+		for (int i = csr.offsets[v]; i < csr.offsets[v + 1]; ++i)
+			if (component[csr.edgeIds[i]] != -1)
+				sortedComponentIds[v].push_back(component[csr.edgeIds[i]]);
 
-		sortedComponentIds[*vi].insert(sortedComponentIds[*vi].end(), componentIds[*vi].begin(), componentIds[*vi].end());
-		std::sort(sortedComponentIds[*vi].begin(), sortedComponentIds[*vi].end());
+		std::sort(sortedComponentIds[v].begin(), sortedComponentIds[v].end());
+		sortedComponentIds[v].erase(std::unique(sortedComponentIds[v].begin(), sortedComponentIds[v].end()), sortedComponentIds[v].end());
 	}
 
+	std::vector<char> isApComponent(numComponents, 0);
+	std::vector<char> edgeEnabled(csr.numEdges, 0);
 
-	
-	for (auto ap : artPoints)
+	for (int ap : artPoints)
 	{
-		std::cout << "ART POINT " << gCopy.structure[ap]->name() << std::endl;
-		for (size_t c : componentIds[ap])
-			std::cout << c << std::endl;
+		LMU_LOG_DEBUG("ART POINT " << csr.functions[ap]->name());
+		for (int c : sortedComponentIds[ap])
+		{
+			LMU_LOG_DEBUG(c);
+			isApComponent[c] = 1;
+		}
 
-		auto pGraph = lmu::filterGraph(gCopy,
-			[&gCopy, &ap, &artPoints, &sortedComponentIds](const VertexDescriptor& v)
-		{ 
+		//Vertices must not be an articulation point itself and must belong to one of the ap's components.
+		std::vector<int> vertices;
+		for (int v = 0; v < csr.numVertices(); ++v)
+		{
 			if (v == ap)
-				return true;
-
-			//Vertex must not be an articulation point itself.
-			bool isArticulationPoint = std::find(artPoints.begin(), artPoints.end(), v) != artPoints.end();
-			if (isArticulationPoint)
-				return false; 
-
-			//Vertex must belong to one of the ap's components
-			std::vector<size_t> intersection;
-			std::set_intersection(sortedComponentIds[v].begin(), sortedComponentIds[v].end(), sortedComponentIds[ap].begin(), sortedComponentIds[ap].end(), std::back_inserter(intersection));
-			bool shareComponents = !intersection.empty();
-
-			/*std::cout << "   SHARED COMPONENT " << gCopy.structure[v]->name() << ": " << shareComponents << std::endl;
-			for (size_t c : sortedComponentIds[v])
-				std::cout << "   "<< c << std::endl;
-			std::cout << "    ---" << std::endl;
-			for (size_t c : sortedComponentIds[ap])
-				std::cout << "   " << c << std::endl;
-			*/
-
-			return shareComponents;
-		},
-			[&ap, &component, &componentIds](const EdgeDescriptor& e)
-		{ 
-			return componentIds[ap].find(component[e]) != componentIds[ap].end(); 
-		});
-		
-		res.push_back(pGraph);
+			{
+				vertices.push_back(v);
+				continue;
+			}
+
+			if (isArticulationPoint[v])
+				continue;
+
+			for (int c : sortedComponentIds[v])
+			{
+				if (isApComponent[c])
+				{
+					vertices.push_back(v);
+					break;
+				}
+			}
+		}
+
+		for (int e = 0; e < csr.numEdges; ++e)
+			edgeEnabled[e] = component[e] != -1 && isApComponent[component[e]];
+
+		res.push_back(createGraph(csr, vertices, edgeEnabled));
+
+		for (int c : sortedComponentIds[ap])
+			isApComponent[c] = 0;
 	}
 
 	return res;
@@ -520,23 +1020,29 @@ bool shouldBePruned(const lmu::Graph& g, const lmu::EdgeDescriptor& ed)
 
 lmu::Graph lmu::pruneGraph(const Graph& g)
 {
-	//lmu::Graph res = g;
-
-	//Get pruned property map 
-	//boost::property_map <GraphStructure, boost::edge_pruned_t>::type
-	//	pruned = boost::get(boost::edge_pruned_t(), res.structure);
+	auto csr = createCSRGraph(g);
 
-	//boost::graph_traits <GraphStructure>::edge_iterator ei, ei_end;
-	//for (boost::tie(ei, ei_end) = boost::edges(res.structure); ei != ei_end; ++ei)
-	//{
-		//pruned[*ei] = shouldBePruned(res, *ei);
-	//}
+	//Edges are pruned if one of their vertices has degree 1.
+	std::vector<char> edgeEnabled(csr.numEdges, 1);
+	std::vector<int> degree(csr.numVertices(), 0);
+	for (int v = 0; v < csr.numVertices(); ++v)
+	{
+		for (int i = csr.offsets[v]; i < csr.offsets[v + 1]; ++i)
+		{
+			if (csr.degree(v) == 1 || csr.degree(csr.targets[i]) == 1)
+				edgeEnabled[csr.edgeIds[i]] = 0;
+			else
+				degree[v]++;
+		}
+	}
 
-	auto g1 = lmu::filterGraph(g, [](const VertexDescriptor& v) {return true; }, [&g](const EdgeDescriptor& e) { return !shouldBePruned(g, e); });
+	//Remove all vertices without remaining edges.
+	std::vector<int> vertices;
+	for (int v = 0; v < csr.numVertices(); ++v)
+		if (degree[v] > 0)
+			vertices.push_back(v);
 
-	auto g2 = lmu::filterGraph(g1, [&g1](const VertexDescriptor& v) {return boost::in_degree(v, g1.structure) > 0;  }, [](const EdgeDescriptor& e) { return true; });
-	
-	return g2;
+	return createGraph(csr, vertices, edgeEnabled);
 }
 
 bool shouldBePruned(lmu::VertexDescriptor v, const lmu::Graph& g, const std::unordered_map<lmu::VertexDescriptor, std::unordered_set<lmu::VertexDescriptor>>& neighborMap)
@@ -641,7 +1147,7 @@ lmu::Graph lmu::recreatePrunedGraph(const lmu::Graph& originalGraph, const lmu::
 	
 	if (numVertices(prunedGraph) > 1)
 	{
-		std::cerr << "Too many vertices. " << std::endl;
+		LMU_LOG_ERROR("Too many vertices. ");
 		return lmu::Graph();
 	}
 
@@ -651,17 +1157,17 @@ lmu::Graph lmu::recreatePrunedGraph(const lmu::Graph& originalGraph, const lmu::
 		auto func = prunedGraph.structure[*vi];
 		auto v = originalGraph.vertexLookup.at(func);
 
-		std::cout << " Partition " << func->name() << std::endl;
+		LMU_LOG_DEBUG(" Partition " << func->name());
 		auto it = pruneList.find(v);
 		if (it == pruneList.end())
 		{
-			std::cout << "Has no pruned nodes." << std::endl;
+			LMU_LOG_DEBUG("Has no pruned nodes.");
 			break;
 		}
 		auto prunedVertices = it->second;
 
 		for (const auto& pv : prunedVertices)
-			std::cout << "  " << originalGraph.structure[pv]->name() << std::endl;
+			LMU_LOG_DEBUG("  " << originalGraph.structure[pv]->name());
 
 		return lmu::filterGraph(originalGraph,
 			[&prunedVertices, v](const VertexDescriptor& vp)
@@ -2,6 +2,7 @@
 #include "..\include\csgnode_helper.h"
 
 #include <limits>
+#include <algorithm>
 #include <fstream>
 #include <random>
 #include <iostream>
@@ -508,15 +509,11 @@ void lmu::visit(CSGNode& node, const std::function<void(CSGNode&node)>& f)
 
 double lmu::computeGeometryScore(const CSGNode& node, double epsilon, double alpha, double h, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& funcs)
 {	
-	int num = 0; 
-
 	double score = 0.0;
 	for (const auto& func : funcs)
 	{
 		for (int i = 0; i < func->pointsCRef().rows(); ++i)
 		{
-			num++;
-
 			//const double* data = func->pointsCRef().data() + i * 6;
 			//Eigen::Vector3d p(data[0], data[1], data[2]);
 			//Eigen::Vector3d n(data[3], data[4], data[5]);
@@ -525,28 +522,31 @@ double lmu::computeGeometryScore(const CSGNode& node, double epsilon, double alp
 			Eigen::Vector3d p = row.head<3>();
 			Eigen::Vector3d n = row.tail<3>();
 
-			Eigen::Vector4d distAndGrad = node.signedDistanceAndGradient(p,h);
+			score += computePointScore(node, p, n, epsilon, alpha, h);
+		}
+	}
 
-			double d = distAndGrad[0] / epsilon;
-			
-			Eigen::Vector3d grad = distAndGrad.tail<3>();
-			grad.normalize();			
-			if (std::isnan(grad.norm()))
-			{	
-				continue;
-			}
+	return score;
+}
 
-			double gradientDotN = lmu::clamp(grad.dot(n), -1.0, 1.0); //clamp is necessary, acos is only defined in [-1,1].
-						
-			double theta = std::acos(gradientDotN) / alpha;
+double lmu::computePointScore(const CSGNode& node, const Eigen::Vector3d& p, const Eigen::Vector3d& n, double epsilon, double alpha, double h)
+{
+	Eigen::Vector4d distAndGrad = node.signedDistanceAndGradient(p, h);
 
-			double scoreDelta = (std::exp(-(d*d)) + std::exp(-(theta*theta)));
+	double d = distAndGrad[0] / epsilon;
 
-			score += scoreDelta;
-		}
+	Eigen::Vector3d grad = distAndGrad.tail<3>();
+	grad.normalize();
+	if (std::isnan(grad.norm()))
+	{
+		return 0.0;
 	}
 
-	return score;
+	double gradientDotN = lmu::clamp(grad.dot(n), -1.0, 1.0); //clamp is necessary, acos is only defined in [-1,1].
+
+	double theta = std::acos(gradientDotN) / alpha;
+
+	return std::exp(-(d*d)) + std::exp(-(theta*theta));
 }
 
 double lmu::computeRawDistanceScore(const CSGNode & node, const Eigen::MatrixXd & points)
@@ -592,6 +592,31 @@ int lmu::numPoints(const CSGNode& node)
 	return n;
 }
 
+size_t lmu::canonicalHash(const CSGNode& node, size_t seed)
+{
+	if (node.type() == CSGNodeType::Geometry)
+	{
+		boost::hash_combine(seed, node.function() ? node.function()->name() : node.name());
+		return seed;
+	}
+
+	boost::hash_combine(seed, (int)node.operationType());
+
+	std::vector<size_t> childHashes;
+	childHashes.reserve(node.childsCRef().size());
+	for (const auto& child : node.childsCRef())
+		childHashes.push_back(canonicalHash(child));
+
+	//Union and intersection are commutative.
+	if (node.operationType() == CSGNodeOperationType::Union || node.operationType() == CSGNodeOperationType::Intersection)
+		std::sort(childHashes.begin(), childHashes.end());
+
+	for (size_t childHash : childHashes)
+		boost::hash_combine(seed, childHash);
+
+	return seed;
+}
+
 CSGNode* nodeRec(CSGNode& node, int idx, int& curIdx)
 {
 	if (idx == curIdx)
@@ -717,6 +742,64 @@ SerializedCSGNode lmu::serializeNode(CSGNode& node)
 	return res;
 }
 
+void serializeCSGNodeRec(const CSGNode& node, const std::vector<ImplicitFunctionPtr>& functions, std::vector<int>& data)
+{
+	if (node.type() == CSGNodeType::Geometry)
+	{
+		auto it = std::find(functions.begin(), functions.end(), node.function());
+		if (it == functions.end())
+			throw std::runtime_error("Function of node " + node.name() + " cannot be serialized.");
+
+		data.push_back(-(int)(it - functions.begin()) - 1);
+		return;
+	}
+
+	data.push_back((int)node.operationType());
+	data.push_back((int)node.childsCRef().size());
+	for (const auto& child : node.childsCRef())
+		serializeCSGNodeRec(child, functions, data);
+}
+
+std::vector<int> lmu::serializeCSGNode(const CSGNode& node, const std::vector<ImplicitFunctionPtr>& functions)
+{
+	std::vector<int> data;
+	serializeCSGNodeRec(node, functions, data);
+	return data;
+}
+
+CSGNode deserializeCSGNodeRec(const std::vector<int>& data, const std::vector<ImplicitFunctionPtr>& functions, size_t& pos)
+{
+	if (pos >= data.size())
+		throw std::runtime_error("Serialized node is incomplete.");
+
+	int code = data[pos++];
+	if (code < 0)
+	{
+		int idx = -code - 1;
+		if ((size_t)idx >= functions.size())
+			throw std::runtime_error("Serialized node references an unknown function.");
+
+		return CSGNode(std::make_shared<CSGNodeGeometry>(functions[idx]));
+	}
+
+	if (pos >= data.size())
+		throw std::runtime_error("Serialized node is incomplete.");
+
+	int numChilds = data[pos++];
+	std::vector<CSGNode> childs;
+	childs.reserve(numChilds);
+	for (int i = 0; i < numChilds; ++i)
+		childs.push_back(deserializeCSGNodeRec(data, functions, pos));
+
+	return createOperation((CSGNodeOperationType)code, std::string(), childs);
+}
+
+CSGNode lmu::deserializeCSGNode(const std::vector<int>& data, const std::vector<ImplicitFunctionPtr>& functions)
+{
+	size_t pos = 0;
+	return deserializeCSGNodeRec(data, functions, pos);
+}
+
 CSGNode* getRoot(const SerializedCSGNode& n, int start, int end)
 {
 	//Note: We assume that n is representing a correct serialization of a tree.
@@ -1,10 +1,15 @@
 #include "../include/csgnode_evo.h"
 #include "../include/csgnode_helper.h"
 #include "../include/dnf.h"
+#include "../include/threadpool.h"
+#include "../include/log.h"
+#include "../include/workerprocesses.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <numeric>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/graph/adjacency_list.hpp>
 
 #include "../include/constants.h"
@@ -23,10 +28,23 @@ lmu::CSGNodeRanker::CSGNodeRanker(double lambda, double epsilon, double alpha, d
 	_functions(functions),
 	_earlyOutTest(!connectionGraph.structure.m_vertices.empty()),
 	_connectionGraph(connectionGraph),
-	_epsilonScale(computeEpsilonScale())
+	_epsilonScale(computeEpsilonScale()),
+	_fingerprint(computeFingerprint()),
+	_racingSampleRate(0.0),
+	_racingConfidenceZ(0.0)
 {
 }
 
+size_t lmu::CSGNodeRanker::computeFingerprint() const
+{
+	size_t seed = lmu::fingerprint(_functions);
+	boost::hash_combine(seed, _lambda);
+	boost::hash_combine(seed, _epsilon);
+	boost::hash_combine(seed, _alpha);
+	boost::hash_combine(seed, _h);
+	return seed;
+}
+
 double lmu::CSGNodeRanker::computeEpsilonScale()
 {
 	const double minVal = -std::numeric_limits<double>::max(); 
@@ -52,20 +70,302 @@ double lmu::CSGNodeRanker::computeEpsilonScale()
 	return (max - min).norm();
 }
 
+//Per thread, a tree is always ranked on one thread. Read by the GA around single rankings for its metrics.
+thread_local uint64_t numEvaluatedPointsOfThread = 0;
+
+uint64_t numPointsOf(const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions)
+{
+	uint64_t n = 0;
+	for (const auto& f : functions)
+		n += f->pointsCRef().rows();
+	return n;
+}
+
 double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node) const
 {	
+	bool failed;
+	return rank(node, failed);
+}
+
+double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node, bool& failed) const
+{
+	failed = false;
+
+	if (_workers && node.isValid())
+	{
+		try
+		{
+			double rank = _workers->call(serializeCSGNode(node, _functions));
+			numEvaluatedPointsOfThread += numPointsOf(_functions);
+			return rank;
+		}
+		catch (const std::exception& ex)
+		{
+			LMU_LOG_WARNING("Ranking in worker process failed: " << ex.what());
+			failed = true;
+			return worstRank;
+		}
+	}
+
 	return rank(node, _functions);
 }
 
 double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node, const std::vector<std::shared_ptr<lmu::ImplicitFunction>>& functions) const
 {
 	double geometryScore = computeGeometryScore(node, _epsilon * _epsilonScale, _alpha, _h, functions);
+	numEvaluatedPointsOfThread += numPointsOf(functions);
 
 	double score = geometryScore - _lambda * numNodes(node);
 	
 	return score;
 }
 
+//Points per function in the first subsample of a race, the variance estimate is not reliable with less.
+const int racingMinPoints = 16;
+
+double lmu::CSGNodeRanker::rank(const lmu::CSGNode& node, double cutoff, RaceOutcome& outcome) const
+{
+	if (!_racingOrder || _workers || cutoff == worstRank)
+	{
+		bool failed;
+		double r = rank(node, failed);
+		outcome = failed ? RaceOutcome::FAILED : RaceOutcome::NOT_RACED;
+		return r;
+	}
+
+	const double epsilon = _epsilon * _epsilonScale;
+	const double sizePenalty = _lambda * numNodes(node);
+	const auto& order = *_racingOrder;
+
+	//Per function: sum and sum of squares of the point scores of the subsample.
+	std::vector<double> sums(_functions.size(), 0.0);
+	std::vector<double> sqSums(_functions.size(), 0.0);
+	std::vector<int> numSampled(_functions.size(), 0);
+
+	for (double sampleRate = _racingSampleRate; ; sampleRate *= 2.0)
+	{
+		bool complete = true;
+		double estimate = 0.0;
+		double variance = 0.0;
+
+		for (size_t f = 0; f < _functions.size(); ++f)
+		{
+			const auto& points = _functions[f]->pointsCRef();
+			const int numPoints = points.rows();
+			if (numPoints == 0)
+				continue;
+
+			const int numToSample = std::min(numPoints, std::max(racingMinPoints, (int)std::ceil(sampleRate * numPoints)));
+			for (int i = numSampled[f]; i < numToSample; ++i)
+			{
+				auto row = points.row(order[f][i]);
+				double score = computePointScore(node, row.head<3>(), row.tail<3>(), epsilon, _alpha, _h);
+				sums[f] += score;
+				sqSums[f] += score * score;
+			}
+			numEvaluatedPointsOfThread += numToSample - numSampled[f];
+			numSampled[f] = numToSample;
+
+			const int n = numToSample;
+			if (n < numPoints)
+			{
+				complete = false;
+
+				//Stratified estimate of the function's score sum with finite population correction.
+				double mean = sums[f] / n;
+				double sampleVariance = std::max(0.0, (sqSums[f] - n * mean * mean) / (n - 1));
+				estimate += mean * numPoints;
+				variance += (double)numPoints * numPoints * sampleVariance / n * (1.0 - (double)n / numPoints);
+			}
+			else
+			{
+				estimate += sums[f];
+			}
+		}
+
+		if (complete)
+		{
+			outcome = RaceOutcome::PROMOTED;
+			return estimate - sizePenalty;
+		}
+
+		if (estimate + _racingConfidenceZ * std::sqrt(variance) - sizePenalty < cutoff)
+		{
+			outcome = RaceOutcome::ELIMINATED;
+			return estimate - sizePenalty;
+		}
+	}
+}
+
+double lmu::CSGNodeRanker::estimateCost(const lmu::CSGNode& node) const
+{
+	return numNodes(node);
+}
+
+size_t lmu::CSGNodeRanker::fingerprint() const
+{
+	return _fingerprint;
+}
+
+void lmu::CSGNodeRanker::useWorkerProcesses(int numWorkers, bool pinWorkers, int timeoutMilliseconds)
+{
+	//Workers rank with a copy that has no workers itself.
+	_workers.reset();
+	CSGNodeRanker localRanker = *this;
+
+	_workers = std::make_shared<WorkerProcesses>(numWorkers, [localRanker](const std::vector<int>& request)
+	{
+		return localRanker.rank(deserializeCSGNode(request, localRanker._functions));
+	}, pinWorkers, timeoutMilliseconds);
+
+	LMU_LOG_INFO("Ranking in " << numWorkers << " worker processes.");
+}
+
+void lmu::CSGNodeRanker::useRacing(double sampleRate, double confidenceZ)
+{
+	_racingSampleRate = sampleRate;
+	_racingConfidenceZ = confidenceZ;
+	_racingOrder.reset();
+
+	if (sampleRate <= 0.0)
+		return;
+
+	//The order only depends on the input, equal creatures get equal estimates.
+	std::default_random_engine rndEngine((unsigned int)_fingerprint);
+
+	auto order = std::make_shared<std::vector<std::vector<int>>>(_functions.size());
+	for (size_t f = 0; f < _functions.size(); ++f)
+	{
+		auto& indices = (*order)[f];
+		indices.resize(_functions[f]->pointsCRef().rows());
+		std::iota(indices.begin(), indices.end(), 0);
+		std::shuffle(indices.begin(), indices.end(), rndEngine);
+	}
+	_racingOrder = order;
+
+	LMU_LOG_INFO("Racing with sample rate " << sampleRate << " and confidence z " << confidenceZ << ".");
+}
+
+//Functions with less points are not subsampled.
+const int levelOfDetailMinPoints = 16;
+
+void lmu::CSGNodeRanker::useLevelsOfDetail(int numLevels, double reduction)
+{
+	_levelsOfDetail.reset();
+	_levelOfDetailFingerprints.clear();
+
+	if (numLevels <= 1 || reduction <= 1.0)
+		return;
+
+	auto levels = std::make_shared<std::vector<std::vector<PointCloud>>>(numLevels - 1, std::vector<PointCloud>(_functions.size()));
+	for (size_t f = 0; f < _functions.size(); ++f)
+	{
+		const auto& points = _functions[f]->pointsCRef();
+		const int numPoints = points.rows();
+
+		double voxelSize = 0.0;
+		if (numPoints > 0)
+		{
+			//Initial guess: spacing of points on a surface.
+			Eigen::Vector3d extent = (points.leftCols<3>().colwise().maxCoeff() - points.leftCols<3>().colwise().minCoeff()).transpose();
+			voxelSize = extent.norm() / std::sqrt((double)numPoints);
+		}
+
+		for (int l = 1; l < numLevels; ++l)
+		{
+			const double targetNumPoints = std::max((double)levelOfDetailMinPoints, numPoints / std::pow(reduction, l));
+			if (numPoints <= targetNumPoints || voxelSize <= 0.0)
+			{
+				(*levels)[l - 1][f] = points;
+				continue;
+			}
+
+			//The number of points shrinks with the square of the voxel size for points on a surface. A few corrections get close enough.
+			PointCloud subsample;
+			for (int i = 0; i < 8; ++i)
+			{
+				subsample = voxelGridSubsample(points, voxelSize);
+				double ratio = (double)subsample.rows() / targetNumPoints;
+				if (ratio > 0.75 && ratio < 1.5)
+					break;
+
+				voxelSize *= std::sqrt(ratio);
+			}
+			(*levels)[l - 1][f] = subsample;
+		}
+	}
+	_levelsOfDetail = levels;
+
+	for (size_t l = 0; l < levels->size(); ++l)
+	{
+		size_t seed = _fingerprint;
+		boost::hash_combine(seed, l + 1);
+		for (const auto& points : (*levels)[l])
+		{
+			boost::hash_combine(seed, points.rows());
+			boost::hash_range(seed, points.data(), points.data() + points.size());
+		}
+		_levelOfDetailFingerprints.push_back(seed);
+	}
+
+	std::stringstream ss;
+	for (size_t l = 0; l < levels->size(); ++l)
+	{
+		size_t n = 0;
+		for (const auto& points : (*levels)[l])
+			n += points.rows();
+		ss << " " << n;
+	}
+	LMU_LOG_INFO("Levels of detail with number of points:" << ss.str());
+}
+
+int lmu::CSGNodeRanker::numLevelsOfDetail() const
+{
+	return _levelsOfDetail ? _levelsOfDetail->size() + 1 : 1;
+}
+
+size_t lmu::CSGNodeRanker::levelOfDetailFingerprint(int level) const
+{
+	if (level <= 0 || (size_t)level > _levelOfDetailFingerprints.size())
+		return _fingerprint;
+
+	return _levelOfDetailFingerprints[level - 1];
+}
+
+double lmu::CSGNodeRanker::rankAtLevel(const lmu::CSGNode& node, int level) const
+{
+	if (level <= 0 || !_levelsOfDetail)
+		return rank(node);
+
+	const auto& levelPoints = (*_levelsOfDetail)[std::min(level, (int)_levelsOfDetail->size()) - 1];
+	const double epsilon = _epsilon * _epsilonScale;
+
+	double geometryScore = 0.0;
+	for (size_t f = 0; f < _functions.size(); ++f)
+	{
+		const auto& points = levelPoints[f];
+		if (points.rows() == 0)
+			continue;
+
+		double score = 0.0;
+		for (int i = 0; i < points.rows(); ++i)
+		{
+			auto row = points.row(i);
+			score += computePointScore(node, row.head<3>(), row.tail<3>(), epsilon, _alpha, _h);
+		}
+
+		geometryScore += score * (double)_functions[f]->pointsCRef().rows() / (double)points.rows();
+		numEvaluatedPointsOfThread += points.rows();
+	}
+
+	return geometryScore - _lambda * numNodes(node);
+}
+
+uint64_t lmu::CSGNodeRanker::numEvaluatedPoints() const
+{
+	return numEvaluatedPointsOfThread;
+}
+
 std::string lmu::CSGNodeRanker::info() const
 {
 	std::stringstream ss;
@@ -94,7 +394,6 @@ bool treeIsInvalidRec(const lmu::CSGNode& node, boost::dynamic_bitset<>& bf, con
 	if (node.type() == CSGNodeType::Operation)
 	{	
 		boost::dynamic_bitset<> lastBF(bf.size());
-		static boost::dynamic_bitset<> emptyBF(bf.size());
 
 		bool firstRun = true; 
 
@@ -105,7 +404,7 @@ bool treeIsInvalidRec(const lmu::CSGNode& node, boost::dynamic_bitset<>& bf, con
 			if (treeIsInvalidRec(child, childBF, connectionGraph, funcToIdx))
 				return true;
 						
-			if ((childBF & lastBF) == emptyBF && !firstRun)
+			if ((childBF & lastBF).none() && !firstRun)
 				return true; 
 
 			firstRun = false;
@@ -156,50 +455,70 @@ CSGNodeCreator::CSGNodeCreator(const std::vector<std::shared_ptr<ImplicitFunctio
 
 CSGNode CSGNodeCreator::mutate(const CSGNode& node) const
 {
-	static std::bernoulli_distribution d{};
+	return mutate(node, _rndEngine);
+}
+
+std::vector<lmu::CSGNode> lmu::CSGNodeCreator::crossover(const CSGNode& node1, const CSGNode& node2) const
+{
+	return crossover(node1, node2, _rndEngine);
+}
+
+lmu::CSGNode lmu::CSGNodeCreator::create(bool unions) const
+{
+	return create(_rndEngine, unions);
+}
+
+lmu::CSGNode lmu::CSGNodeCreator::create(int maxDepth) const
+{
+	return create(maxDepth, _rndEngine);
+}
+
+CSGNode CSGNodeCreator::mutate(const CSGNode& node, std::default_random_engine& rndEngine) const
+{
+	std::bernoulli_distribution d{};
 	using parm_t = decltype(d)::param_type;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
-	static std::uniform_real_distribution<double> dur(-0.1, 0.1);
+	std::uniform_real_distribution<double> dur(-0.1, 0.1);
 	using parmur_t = decltype(dur)::param_type;
 	
 	//_createNewRandomProb (my_0) 
-	if (d(_rndEngine, parm_t{ _createNewRandomProb }))
-		return create(_maxTreeDepth);
+	if (d(rndEngine, parm_t{ _createNewRandomProb }))
+		return create(_maxTreeDepth, rndEngine);
 
-	int nodeIdx = du(_rndEngine, parmu_t{ 0, numNodes(node) - 1 });
+	int nodeIdx = du(rndEngine, parmu_t{ 0, numNodes(node) - 1 });
 
-	std::cout << "Mutation at " << nodeIdx << std::endl;
+	LMU_LOG_DEBUG("Mutation at " << nodeIdx);
 
 	auto newNode = node;
 
 	CSGNode* subNode = nodePtrAt(newNode, nodeIdx);
 	
-	create(*subNode, _maxTreeDepth, 0);
+	create(*subNode, _maxTreeDepth, 0, rndEngine);
 
 	return newNode;
 }
 
-std::vector<lmu::CSGNode> lmu::CSGNodeCreator::crossover(const CSGNode& node1, const CSGNode& node2) const
+std::vector<lmu::CSGNode> lmu::CSGNodeCreator::crossover(const CSGNode& node1, const CSGNode& node2, std::default_random_engine& rndEngine) const
 {
-	static std::bernoulli_distribution db{};
+	std::bernoulli_distribution db{};
 	using parmb_t = decltype(db)::param_type;
 
-	std::cout << "Crossover" << std::endl;
+	LMU_LOG_DEBUG("Crossover");
 
-	if (db(_rndEngine, parmb_t{ _simpleCrossoverProb }))
+	if (db(rndEngine, parmb_t{ _simpleCrossoverProb }))
 	{
-		return simpleCrossover(node1, node2);
+		return simpleCrossover(node1, node2, rndEngine);
 	}
 	else
 	{
-		return sharedPrimitiveCrossover(node1, node2);
+		return sharedPrimitiveCrossover(node1, node2, rndEngine);
 	}
 }
 
-std::vector<lmu::CSGNode> lmu::CSGNodeCreator::simpleCrossover(const CSGNode & node1, const CSGNode & node2) const
+std::vector<lmu::CSGNode> lmu::CSGNodeCreator::simpleCrossover(const CSGNode & node1, const CSGNode & node2, std::default_random_engine& rndEngine) const
 {
 	if (!node1.isValid() || !node2.isValid())
 		return std::vector<lmu::CSGNode> {node1, node2};
@@ -210,11 +529,11 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreator::simpleCrossover(const CSGNode & n
 	auto newNode1 = node1;
 	auto newNode2 = node2;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
-	int nodeIdx1 = du(_rndEngine, parmu_t{ 0, numNodes1 - 1 });
-	int nodeIdx2 = du(_rndEngine, parmu_t{ 0, numNodes2 - 1 });
+	int nodeIdx1 = du(rndEngine, parmu_t{ 0, numNodes1 - 1 });
+	int nodeIdx2 = du(rndEngine, parmu_t{ 0, numNodes2 - 1 });
 
 	CSGNode* subNode1 = nodePtrAt(newNode1, nodeIdx1);
 	CSGNode* subNode2 = nodePtrAt(newNode2, nodeIdx2);
@@ -227,7 +546,7 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreator::simpleCrossover(const CSGNode & n
 	};
 }
 
-std::vector<lmu::CSGNode> lmu::CSGNodeCreator::sharedPrimitiveCrossover(const CSGNode& node1, const CSGNode& node2) const
+std::vector<lmu::CSGNode> lmu::CSGNodeCreator::sharedPrimitiveCrossover(const CSGNode& node1, const CSGNode& node2, std::default_random_engine& rndEngine) const
 {
 	if (!node1.isValid() || !node2.isValid())
 		return std::vector<lmu::CSGNode> {node1, node2};
@@ -235,10 +554,10 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreator::sharedPrimitiveCrossover(const CS
 	auto newNode1 = node1;
 	auto newNode2 = node2;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
-	int nodeIdx1 = du(_rndEngine, parmu_t{ 0, numNodes(newNode1) - 1 });
+	int nodeIdx1 = du(rndEngine, parmu_t{ 0, numNodes(newNode1) - 1 });
 
 	CSGNode* subNode1 = nodePtrAt(newNode1, nodeIdx1);
 	auto allDistinctFunctions = lmu::allDistinctFunctions(*subNode1);
@@ -246,7 +565,7 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreator::sharedPrimitiveCrossover(const CS
 	CSGNode* subNode2 = findSmallestSubgraphWithImplicitFunctions(newNode2, allDistinctFunctions);
 	if (!subNode2) // do normal crossover if no subtree could be found.
 	{		
-		int nodeIdx2 = du(_rndEngine, parmu_t{ 0, numNodes(newNode2) - 1 });
+		int nodeIdx2 = du(rndEngine, parmu_t{ 0, numNodes(newNode2) - 1 });
 		subNode2 = nodePtrAt(newNode2, nodeIdx2);
 		std::swap(*subNode1, *subNode2);
 	}
@@ -261,7 +580,7 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreator::sharedPrimitiveCrossover(const CS
 			*subNode1 = *subNode2;
 		else //If both scores are equal, do normal crossover.
 		{
-			int nodeIdx2 = du(_rndEngine, parmu_t{ 0, numNodes(newNode2) - 1 });
+			int nodeIdx2 = du(rndEngine, parmu_t{ 0, numNodes(newNode2) - 1 });
 			subNode2 = nodePtrAt(newNode2, nodeIdx2);
 			std::swap(*subNode1, *subNode2);
 		}
@@ -270,27 +589,27 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreator::sharedPrimitiveCrossover(const CS
 	return std::vector<lmu::CSGNode>{ newNode1, newNode2};
 }
 
-lmu::CSGNode lmu::CSGNodeCreator::create(bool unions) const
+lmu::CSGNode lmu::CSGNodeCreator::create(std::default_random_engine& rndEngine, bool unions) const
 {
-	static std::bernoulli_distribution db{};
+	std::bernoulli_distribution db{};
 	using parmb_t = decltype(db)::param_type;
 
-	if (!unions || !db(_rndEngine, parmb_t{ _initializeWithUnionOfAllFunctions }))
+	if (!unions || !db(rndEngine, parmb_t{ _initializeWithUnionOfAllFunctions }))
 	{
-		return create(_maxTreeDepth);
+		return create(_maxTreeDepth, rndEngine);
 	}
 	else
 	{
 		auto node = opUnion();
 		auto funcs = _functions;//lmu::getImplicitFunctions(_connectionGraph);
-		createUnionTree(node, funcs);
+		createUnionTree(node, funcs, rndEngine);
 		return node;
 	}
 }
 
-void lmu::CSGNodeCreator::createUnionTree(CSGNode& node, std::vector<ImplicitFunctionPtr>& funcs) const
+void lmu::CSGNodeCreator::createUnionTree(CSGNode& node, std::vector<ImplicitFunctionPtr>& funcs, std::default_random_engine& rndEngine) const
 {
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
 	if (funcs.size() == 0)
@@ -304,13 +623,13 @@ void lmu::CSGNodeCreator::createUnionTree(CSGNode& node, std::vector<ImplicitFun
 	}
 	else
 	{
-		int funcIdx = du(_rndEngine, parmu_t{ 0, static_cast<int>(funcs.size() - 1) });
+		int funcIdx = du(rndEngine, parmu_t{ 0, static_cast<int>(funcs.size() - 1) });
 		node.addChild(lmu::geometry(funcs[funcIdx]));
 		
 		funcs.erase(funcs.begin() + funcIdx);
 
 		CSGNode child = opUnion();
-		createUnionTree(child, funcs);
+		createUnionTree(child, funcs, rndEngine);
 		if (child.isValid())
 		{
 			node.addChild(child);
@@ -322,35 +641,35 @@ void lmu::CSGNodeCreator::createUnionTree(CSGNode& node, std::vector<ImplicitFun
 	}
 }
 
-lmu::CSGNode lmu::CSGNodeCreator::create(int maxDepth) const
+lmu::CSGNode lmu::CSGNodeCreator::create(int maxDepth, std::default_random_engine& rndEngine) const
 {
 	auto node = CSGNode::invalidNode;
-	create(node, maxDepth, 0);
+	create(node, maxDepth, 0, rndEngine);
 	return node;
 }
 
-void lmu::CSGNodeCreator::create(lmu::CSGNode& node, int maxDepth, int curDepth) const
+void lmu::CSGNodeCreator::create(lmu::CSGNode& node, int maxDepth, int curDepth, std::default_random_engine& rndEngine) const
 {
-	static std::bernoulli_distribution db{};
+	std::bernoulli_distribution db{};
 	using parmb_t = decltype(db)::param_type;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
-	static std::uniform_real_distribution<double> dur(0, 1);
+	std::uniform_real_distribution<double> dur(0, 1);
 	using parmur_t = decltype(dur)::param_type;
 
 	if (curDepth >= maxDepth)
 	{		
-		int funcIdx = du(_rndEngine, parmu_t{ 0, static_cast<int>(_functions.size() - 1) });
+		int funcIdx = du(rndEngine, parmu_t{ 0, static_cast<int>(_functions.size() - 1) });
 		node = geometry(_functions[funcIdx]);				
 	}
 	else
 	{
-		if (db(_rndEngine, parmb_t{ _subtreeProb }))
+		if (db(rndEngine, parmb_t{ _subtreeProb }))
 		{
 			std::discrete_distribution<> d({ 1, 1, 1 });
-			int op = d(_rndEngine) + 1; //0 is OperationType::Unknown, 6 is OperationType::Invalid.
+			int op = d(rndEngine) + 1; //0 is OperationType::Unknown, 6 is OperationType::Invalid.
 
 			node = createOperation(static_cast<CSGNodeOperationType>(op));
 
@@ -360,13 +679,13 @@ void lmu::CSGNodeCreator::create(lmu::CSGNode& node, int maxDepth, int curDepth)
 			for (int i = 0; i < numChilds; ++i)
 			{
 				auto child = CSGNode::invalidNode;
-				create(child, maxDepth, curDepth + 1);
+				create(child, maxDepth, curDepth + 1, rndEngine);
 				node.addChild(child);
 			}
 		}
 		else 
 		{
-			int funcIdx = du(_rndEngine, parmu_t{ 0, static_cast<int>(_functions.size() - 1) });
+			int funcIdx = du(rndEngine, parmu_t{ 0, static_cast<int>(_functions.size() - 1) });
 			node = geometry(_functions[funcIdx]);
 		}
 	}
@@ -379,6 +698,16 @@ std::string lmu::CSGNodeCreator::info() const
 	return ss.str();
 }
 
+std::vector<int> lmu::CSGNodeCreator::serialize(const CSGNode& tree) const
+{
+	return serializeCSGNode(tree, _functions);
+}
+
+CSGNode lmu::CSGNodeCreator::deserialize(const std::vector<int>& data) const
+{
+	return deserializeCSGNode(data, _functions);
+}
+
 
 size_t functionHash(const std::vector<lmu::ImplicitFunctionPtr>& funcs)
 {
@@ -451,7 +780,7 @@ CSGNode lmu::CSGNodePopMan::getOptimizedTree(std::vector<ImplicitFunctionPtr> fu
 	}
 }
 
-std::vector<ImplicitFunctionPtr> lmu::CSGNodePopMan::getSuitableFunctions(const std::vector<ImplicitFunctionPtr>& funcs) const
+std::vector<ImplicitFunctionPtr> lmu::CSGNodePopMan::getSuitableFunctions(const std::vector<ImplicitFunctionPtr>& funcs, std::default_random_engine& rndEngine) const
 {
 	static std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
@@ -461,11 +790,11 @@ std::vector<ImplicitFunctionPtr> lmu::CSGNodePopMan::getSuitableFunctions(const
 		//if functions are not connected, search for a connected one.
 		if (!lmu::areConnected(_connectionGraph, funcs[0], funcs[1]))
 		{
-			int funcIdx = du(_rndEngine, parmu_t{ 0, 1 });
+			int funcIdx = du(rndEngine, parmu_t{ 0, 1 });
 
 			auto neighbors = lmu::getConnectedImplicitFunctions(_connectionGraph, funcs[funcIdx]);
 
-			int newFuncIdx = du(_rndEngine, parmu_t{ 0, (int)neighbors.size() - 1 });
+			int newFuncIdx = du(rndEngine, parmu_t{ 0, (int)neighbors.size() - 1 });
 
 			auto res = funcs;
 			res[funcIdx == 1 ? 0 : 1] = neighbors[newFuncIdx];
@@ -479,9 +808,19 @@ std::vector<ImplicitFunctionPtr> lmu::CSGNodePopMan::getSuitableFunctions(const
 
 void lmu::CSGNodePopMan::manipulateAfterRanking(std::vector<RankedCreature<CSGNode>>& population) const
 {
+	manipulateAfterRanking(population, _rndEngine);
 }
 
 void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGNode>>& population) const
+{
+	manipulateBeforeRanking(population, _rndEngine);
+}
+
+void lmu::CSGNodePopMan::manipulateAfterRanking(std::vector<RankedCreature<CSGNode>>&, std::default_random_engine&) const
+{
+}
+
+void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGNode>>& population, std::default_random_engine& rndEngine) const
 {
 	static std::bernoulli_distribution db{};
 	using parmb_t = decltype(db)::param_type;
@@ -491,7 +830,7 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 		
 	for (int i = 0; i < population.size(); ++i)
 	{
-		if (db(_rndEngine, parmb_t{_preOptimizationProb }))
+		if (db(rndEngine, parmb_t{_preOptimizationProb }))
 		{
 			auto& node = population[i].creature;
 			int numOptimizations = optimizeCSGNodeStructure(node);
@@ -501,7 +840,7 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 			}
 		}
 		
-		if (db(_rndEngine, parmb_t{ _optimizationProb }))
+		if (db(rndEngine, parmb_t{ _optimizationProb }))
 		{
 					
 			auto& node = population[i].creature;
@@ -510,12 +849,12 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 			{
 			case CSGNodeOptimization::TRAVERSE:
 
-				lmu::visit(node, [this](CSGNode& n)
+				lmu::visit(node, [this, &rndEngine](CSGNode& n)
 				{
 					auto& childs = n.childsRef();
 					if (childs.size() == 2 && childs[0].type() == CSGNodeType::Geometry && childs[1].type() == CSGNodeType::Geometry)
 					{
-						std::vector<ImplicitFunctionPtr> funcs = getSuitableFunctions({ childs[0].function(), childs[1].function() });
+						std::vector<ImplicitFunctionPtr> funcs = getSuitableFunctions({ childs[0].function(), childs[1].function() }, rndEngine);
 						n = getOptimizedTree(funcs);
 					}
 				});
@@ -528,9 +867,9 @@ void lmu::CSGNodePopMan::manipulateBeforeRanking(std::vector<RankedCreature<CSGN
 				{
 					for (int tries = 0; tries < _nodeSelectionTries; ++tries)
 					{
-						int subNodeIdx = du(_rndEngine, parmu_t{ 0, numNodes(node) - 1 });
+						int subNodeIdx = du(rndEngine, parmu_t{ 0, numNodes(node) - 1 });
 						CSGNode* subNode = nodePtrAt(node, subNodeIdx);
-						auto funcs = getSuitableFunctions(lmu::allDistinctFunctions(*subNode));
+						auto funcs = getSuitableFunctions(lmu::allDistinctFunctions(*subNode), rndEngine);
 
 						if (funcs.size() < _maxFunctions)
 						{
@@ -588,6 +927,24 @@ lmu::CSGNode lmu::createCSGNodeWithGA(const std::vector<std::shared_ptr<Implicit
 {
 	bool inParallel = p.getBool("GA", "InParallel", false);
 	bool useCaching = p.getBool("GA", "UseCaching", false);
+	int cacheCapacity = std::max(0, p.getInt("GA", "CacheCapacity", 1 << 20));
+	std::string persistentCacheFile = p.getStr("GA", "PersistentCacheFile", "");
+	int numIslands = p.getInt("GA", "Islands", 1);
+	int migrationInterval = p.getInt("GA", "MigrationInterval", 10);
+	int migrationSize = p.getInt("GA", "MigrationSize", 2);
+	MigrationTopology migrationTopology = migrationTopologyFromString(p.getStr("GA", "MigrationTopology", "ring"));
+	int numWorkerProcesses = p.getInt("GA", "WorkerProcesses", 0);
+	bool pinWorkerProcesses = p.getBool("GA", "PinWorkerProcesses", false);
+	int workerTimeout = p.getInt("GA", "WorkerTimeout", 60000);
+	double racingSampleRate = p.getDouble("GA", "RacingSampleRate", 0.0);
+	double racingConfidenceZ = p.getDouble("GA", "RacingConfidenceZ", 3.0);
+	int numLevelsOfDetail = p.getInt("GA", "LevelsOfDetail", 1);
+	double levelOfDetailReduction = p.getDouble("GA", "LevelOfDetailReduction", 4.0);
+	int levelOfDetailMaxIterWithoutChange = p.getInt("GA", "LevelOfDetailMaxIterationsWithoutChange", 10);
+	double levelOfDetailChangeDelta = p.getDouble("GA", "LevelOfDetailChangeDelta", 0.01);
+	int levelOfDetailMaxIter = p.getInt("GA", "LevelOfDetailMaxIterations", 100);
+	std::string checkpointFile = p.getStr("GA", "CheckpointFile", "");
+	int checkpointInterval = p.getInt("GA", "CheckpointInterval", 10);
 
 	int popSize = p.getInt("GA", "PopulationSize", 150);
 	int numBestParents = p.getInt("GA", "NumBestParents", 2);
@@ -598,6 +955,7 @@ lmu::CSGNode lmu::createCSGNodeWithGA(const std::vector<std::shared_ptr<Implicit
 	ScheduleType crossScheduleType = scheduleTypeFromString(p.getStr("GA", "CrossoverScheduleType", "identity"));
 	ScheduleType mutationScheduleType = scheduleTypeFromString(p.getStr("GA", "MutationScheduleType", "identity"));
 	bool cancellable = p.getBool("GA", "Cancellable", false);
+	unsigned int seed = p.getInt("GA", "Seed", 0);
 
 	int k = p.getInt("Selection", "TournamentK", 2);
 	
@@ -606,6 +964,8 @@ lmu::CSGNode lmu::createCSGNodeWithGA(const std::vector<std::shared_ptr<Implicit
 	double changeDelta = p.getDouble("StopCriterion", "ChangeDelta", 0.01);
 
 	std::string statsFile = p.getStr("Statistics", "File", "stats.dat");
+	std::string metricsFile = p.getStr("Statistics", "MetricsFile", "");
+	std::string prometheusFile = p.getStr("Statistics", "PrometheusFile", "");
 
 	int maxTreeDepth = p.getInt("Creation", "MaxTreeDepth", 10);
 	double createNewRandomProb = p.getDouble("Creation", "CreateNewRandomProb", 0.5);
@@ -627,17 +987,39 @@ lmu::CSGNode lmu::createCSGNodeWithGA(const std::vector<std::shared_ptr<Implicit
 		return lmu::geometry(shapes[0]);
 
 	lmu::CSGNodeGA ga;
-	lmu::CSGNodeGA::Parameters params(popSize, numBestParents, mutation, crossover, inParallel, Schedule(crossScheduleType), Schedule(mutationScheduleType), useCaching);
+	lmu::CSGNodeGA::Parameters params(popSize, numBestParents, mutation, crossover, inParallel, Schedule(crossScheduleType), Schedule(mutationScheduleType), useCaching, seed, cacheCapacity, persistentCacheFile, 
+		IslandParameters(numIslands, migrationInterval, migrationSize, migrationTopology), 
+		LevelOfDetailSchedule(numLevelsOfDetail, levelOfDetailMaxIterWithoutChange, levelOfDetailChangeDelta, levelOfDetailMaxIter), 
+		checkpointFile, checkpointInterval, metricsFile, prometheusFile);
 
 	lmu::CSGNodeTournamentSelector s(k, true);
 	
 	lmu::CSGNodeNoFitnessIncreaseStopCriterion isc(maxIterWithoutChange, changeDelta, maxIter);
 
 	double lambda = lambdaBasedOnPoints(shapes);
-	std::cout << "lambda: " << lambda << std::endl;
+	LMU_LOG_INFO("lambda: " << lambda);
 
 	lmu::CSGNodeRanker r(lambda, epsilon, alpha, gradientStepSize, shapes, connectionGraph);
 
+	if (numWorkerProcesses > 0)
+	{
+		if (WorkerProcesses::isSupported())
+			r.useWorkerProcesses(numWorkerProcesses, pinWorkerProcesses, workerTimeout);
+		else
+			LMU_LOG_WARNING("Worker processes are not supported on this platform, ranking in process.");
+	}
+
+	if (racingSampleRate > 0.0)
+	{
+		if (numWorkerProcesses > 0)
+			LMU_LOG_WARNING("Racing is not used with worker processes.");
+		else
+			r.useRacing(racingSampleRate, racingConfidenceZ);
+	}
+
+	if (numLevelsOfDetail > 1)
+		r.useLevelsOfDetail(numLevelsOfDetail, levelOfDetailReduction);
+
 	lmu::CSGNodeCreator c(shapes, createNewRandomProb, subtreeProb, simpleCrossoverProb, maxTreeDepth, initializeWithUnionOfAllFunctions, r, connectionGraph);
 
 	lmu::CSGNodePopMan popMan(optimizationProb, preOptimizationProb, maxFunctions, nodeSelectionTries, randomIterations, optimizationType, r, connectionGraph);
@@ -724,14 +1106,24 @@ lmu::CSGNode
 lmu::computeGAWithPartitions
 (const std::vector<Graph>& partitions, const lmu::ParameterSet& params)
 {
+	//Shapiro results of the population manipulators are shared by all partitions.
+	lmu::ShapiroCache::Scope shapiroCacheScope;
+
 	lmu::CSGNode res = lmu::op<Union>();
 
 	//for (const auto& pi: get<1>(partition)) {
 	//  res.addChild(lmu::geometry(pi));
 	//}
 
+	//Partitions are independent, largest partitions are started first.
+	std::vector<lmu::CSGNode> partResults(partitions.size(), lmu::CSGNode(nullptr));
+	std::vector<double> sizes;
 	for (const auto& p : partitions)
+		sizes.push_back(numVertices(p));
+
+	lmu::parallelForLargestFirst(sizes, [&](int i)
 	{
+		const auto& p = partitions[i];
 		std::vector<std::shared_ptr<ImplicitFunction>> shapes = lmu::getImplicitFunctions(p);
 
 		lmu::CSGNode partRes(nullptr);
@@ -747,12 +1139,15 @@ lmu::computeGAWithPartitions
 		{
 			partRes = lmu::createCSGNodeWithGA(shapes, params, p);
 		}
-    
-		if (partitions.size() == 1)
-			return partRes;
 
+		partResults[i] = partRes;
+	});
+
+	if (partitions.size() == 1)
+		return partResults.front();
+
+	for (const auto& partRes : partResults)
 		res.addChild(partRes);
-  }
 
   return res;
 }
@@ -806,7 +1201,7 @@ std::tuple<long long, double> computeNodesForClique(const Clique& clique, const
 		for (const auto& candidate : candidates)
 		{
 			double curScore = ranker.rank(candidate);
-			std::cout << candidate.name() << " for " << clique.functions[0]->name() << " " << clique.functions[1]->name() << " rank: " << curScore /*<< " tree rank: " << ranker2.rank( trees[i++]) */ << std::endl;
+			LMU_LOG_DEBUG(candidate.name() << " for " << clique.functions[0]->name() << " " << clique.functions[1]->name() << " rank: " << curScore /*<< " tree rank: " << ranker2.rank( trees[i++]) */);
 
 			if (maxScore < curScore)
 			{
@@ -852,27 +1247,33 @@ std::vector<GeometryCliqueWithCSGNode> lmu::computeNodesForCliques(const std::ve
 	
 	if (cliquesParallel)
 	{
-#ifndef _OPENMP 
-		throw std::runtime_error("Cliques should run in parallel but OpenMP is not available.");
-#endif
+		ThreadPool& pool = ThreadPool::instance();
+		f << "Thread pool is running with " << pool.numThreads() << " threads." << std::endl;
 
-#pragma omp parallel
+		//Larger cliques take longer, start with them. Each clique gets its own result list to keep the order of the cliques.
+		std::vector<double> costs;
+		for (const auto& clique : geometryCliques)
+			costs.push_back(clique.functions.size());
+
+		std::vector<std::vector<GeometryCliqueWithCSGNode>> cliqueResults(geometryCliques.size());
+		std::mutex fileMutex;
+
+		lmu::parallelForLargestFirst(costs, [&](int i)
 		{
-#pragma omp master  
-			{
-				f << "OpenMP is running with " << omp_get_num_threads() << " threads." << std::endl;
-			}
-#pragma omp for
-			for (int i = 0; i < geometryCliques.size(); ++i)
 			{
+				std::lock_guard<std::mutex> lock(fileMutex);
 				f << "Clique " << (i + 1) << " of " << geometryCliques.size() << " is started" << geometryCliques[i] << std::endl;
-							
-				auto stats = computeNodesForClique(geometryCliques[i], params, res);
-				f << "Timing: " << std::get<0>(stats) << " Score: " << std::get<1>(stats) << std::endl;
-
-				f << geometryCliques[i] << " done." << std::endl;
 			}
-		}
+
+			auto stats = computeNodesForClique(geometryCliques[i], params, cliqueResults[i]);
+
+			std::lock_guard<std::mutex> lock(fileMutex);
+			f << "Timing: " << std::get<0>(stats) << " Score: " << std::get<1>(stats) << std::endl;
+			f << geometryCliques[i] << " done." << std::endl;
+		}, pool);
+
+		for (const auto& cliqueResult : cliqueResults)
+			res.insert(res.end(), cliqueResult.begin(), cliqueResult.end());
 	}
 	else
 	{
@@ -933,41 +1334,41 @@ CSGNode lmu::mergeCSGNodeCliqueSimple(CSGNodeClique& clique)
 		auto n2 = candidateList.front();
 		candidateList.pop_front();
 
-		std::cout << "Took two new nodes" << std::endl;
+		LMU_LOG_DEBUG("Took two new nodes");
 
 		auto firstN2 = n2;
 		while (true)
 		{
-			std::cout << "Find css" << std::endl;
+			LMU_LOG_DEBUG("Find css");
 
 			auto css = findCommonSubgraphs(*n1, *n2);
 
-			std::cout << "Found css" << std::endl;
+			LMU_LOG_DEBUG("Found css");
 
 			CSGNode* mergedNode = nullptr;
 			for (const auto& cs : css)
 			{
-				std::cout << "Write nodes" << std::endl;
+				LMU_LOG_DEBUG("Write nodes");
 
 				writeNode(*n1, "n1.dot");
 				writeNode(*n2, "n2.dot");
 
-				std::cout << "Wrote nodes" << std::endl;
+				LMU_LOG_DEBUG("Wrote nodes");
 
-				std::cout << "Merge nodes" << std::endl;
+				LMU_LOG_DEBUG("Merge nodes");
 
 				switch (mergeNodes(cs, allowIntersections))
 				{
 				case MergeResult::First:
-					std::cout << "Merged with n1" << std::endl;
+					LMU_LOG_DEBUG("Merged with n1");
 					mergedNode = n1;
 					break;
 				case MergeResult::Second:
-					std::cout << "Merged with n2" << std::endl;
+					LMU_LOG_DEBUG("Merged with n2");
 					mergedNode = n2;
 					break;
 				case MergeResult::None:
-					std::cout << "Not merged" << std::endl;			
+					LMU_LOG_DEBUG("Not merged");
 					break;
 				}
 				
@@ -975,11 +1376,11 @@ CSGNode lmu::mergeCSGNodeCliqueSimple(CSGNodeClique& clique)
 					break;
 			}
 
-			std::cout << "Merged nodes" << std::endl;
+			LMU_LOG_DEBUG("Merged nodes");
 
 			if (mergedNode)
 			{
-				std::cout << "Merge node available" << std::endl;
+				LMU_LOG_DEBUG("Merge node available");
 
 				candidateList.push_front(mergedNode);
 				allowIntersections = false;
@@ -987,7 +1388,7 @@ CSGNode lmu::mergeCSGNodeCliqueSimple(CSGNodeClique& clique)
 			}
 			else
 			{
-				std::cout << "Merge node not available" << std::endl;
+				LMU_LOG_DEBUG("Merge node not available");
 
 				candidateList.push_back(n2);
 				auto n2 = candidateList.front();
@@ -997,12 +1398,12 @@ CSGNode lmu::mergeCSGNodeCliqueSimple(CSGNodeClique& clique)
 				{
 					if (allowIntersections)
 					{
-						std::cout << "could not merge n1 with any other node - n1 is ignored now." << std::endl;
+						LMU_LOG_DEBUG("could not merge n1 with any other node - n1 is ignored now.");
 						break;
 					}
 					else
 					{
-						std::cout << "Try to merge now with intersections allowed." << std::endl;
+						LMU_LOG_DEBUG("Try to merge now with intersections allowed.");
 						allowIntersections = true;
 					}					
 				}
@@ -1010,7 +1411,7 @@ CSGNode lmu::mergeCSGNodeCliqueSimple(CSGNodeClique& clique)
 		}
 	}
 
-	std::cout << "Candidate list: " << candidateList.size() << std::endl;
+	LMU_LOG_INFO("Candidate list: " << candidateList.size());
 
 	return *candidateList.front();
 }
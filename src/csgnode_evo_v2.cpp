@@ -1,7 +1,11 @@
 #include <numeric>
+#include <algorithm>
+#include <boost/functional/hash.hpp>
 #include "../include/csgnode_evo_v2.h"
 #include "../include/csgnode_helper.h"
 #include "../include/dnf.h"
+#include "../include/threadpool.h"
+#include "../include/log.h"
 
 // =========================================================================================
 // Types 
@@ -11,10 +15,37 @@ lmu::CSGNodeRankerV2::CSGNodeRankerV2(const lmu::Graph& g, double sizeWeight, do
 	_connectionGraph(g),
 	_sizeWeight(sizeWeight),
 	_h(h),
-	_ifBudget(IFBudget(g))
+	_ifBudget(IFBudget(g)),
+	_fingerprint(computeFingerprint())
 {
 }
 
+size_t lmu::CSGNodeRankerV2::computeFingerprint() const
+{
+	size_t seed = lmu::fingerprint(lmu::getImplicitFunctions(_connectionGraph));
+	boost::hash_combine(seed, _sizeWeight);
+	boost::hash_combine(seed, _h);
+
+	//The function budget depends on the connections.
+	std::vector<std::pair<std::string, std::string>> edges;
+	boost::graph_traits<GraphStructure>::edge_iterator ei, ei_end;
+	for (boost::tie(ei, ei_end) = boost::edges(_connectionGraph.structure); ei != ei_end; ++ei)
+	{
+		auto u = _connectionGraph.structure[boost::source(*ei, _connectionGraph.structure)]->name();
+		auto v = _connectionGraph.structure[boost::target(*ei, _connectionGraph.structure)]->name();
+		edges.push_back(u < v ? std::make_pair(u, v) : std::make_pair(v, u));
+	}
+	std::sort(edges.begin(), edges.end());
+	boost::hash_range(seed, edges.begin(), edges.end());
+
+	return seed;
+}
+
+size_t lmu::CSGNodeRankerV2::fingerprint() const
+{
+	return _fingerprint;
+}
+
 double lmu::CSGNodeRankerV2::rank(const CSGNode& node) const
 {
 	if (!node.isValid())
@@ -35,6 +66,11 @@ std::string lmu::CSGNodeRankerV2::info() const
 	return "Size weight: " + std::to_string(_sizeWeight);
 }
 
+double lmu::CSGNodeRankerV2::estimateCost(const CSGNode& node) const
+{
+	return numNodes(node);
+}
+
 double lmu::CSGNodeRankerV2::computeGeometryScore(const CSGNode & node, const std::vector<ImplicitFunctionPtr>& funcs) const
 {
 	if (!node.isValid())
@@ -87,12 +123,12 @@ lmu::CSGNodeCreatorV2::CSGNodeCreatorV2(double createNewRandomProb, double subtr
 	_ifBudget(IFBudget(graph)),
 	_rndEngine(lmu::rndEngine())
 {
-	std::cout << "CREATOR BUDGET: " << _ifBudget << std::endl;
+	LMU_LOG_DEBUG("CREATOR BUDGET: " << _ifBudget);
 }
 
 lmu::CSGNode createWithShapiro(lmu::IFBudget& budget, std::default_random_engine& rndEngine)
 {
-	static std::bernoulli_distribution d{};
+	std::bernoulli_distribution d{};
 	using parm_t = decltype(d)::param_type;
 
 	//Collect primitives 
@@ -133,60 +169,78 @@ lmu::CSGNode createWithShapiro(lmu::IFBudget& budget, std::default_random_engine
 }
 
 lmu::CSGNode lmu::CSGNodeCreatorV2::mutate(const CSGNode& node) const
+{
+	return mutate(node, _rndEngine);
+}
+
+std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::crossover(const CSGNode& node1, const CSGNode& node2) const
+{
+	return crossover(node1, node2, _rndEngine);
+}
+
+lmu::CSGNode lmu::CSGNodeCreatorV2::create() const
+{
+	return create(_rndEngine);
+}
+
+lmu::CSGNode lmu::CSGNodeCreatorV2::mutate(const CSGNode& node, std::default_random_engine& rndEngine) const
 {
 	if (!node.isValid())
 		return node;
 
-	static std::bernoulli_distribution d{};
+	std::bernoulli_distribution d{};
 	using parm_t = decltype(d)::param_type;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
 	//_createNewRandomProb (my_0) 
-	if (d(_rndEngine, parm_t{ _createNewRandomProb }))
+	if (d(rndEngine, parm_t{ _createNewRandomProb }))
 	{
-		return create();	
+		return create(rndEngine);
 	}
 	else
 	{
 		auto mutatedNode = node;
 
-		int nodeIdx = du(_rndEngine, parmu_t{ 0, numNodes(mutatedNode) - 1 });
+		int nodeIdx = du(rndEngine, parmu_t{ 0, numNodes(mutatedNode) - 1 });
 			
 		CSGNode* subNode = nodePtrAt(mutatedNode, nodeIdx);
 		
-		if (d(_rndEngine, parm_t{ 1.0 }))
+		IFBudget budget(mutatedNode, _ifBudget);
+		budget.seed(rndEngine());
+
+		if (d(rndEngine, parm_t{ 1.0 }))
 		{
-			create(*subNode, IFBudget(mutatedNode, _ifBudget));
+			create(*subNode, budget, rndEngine);
 		}
 		else 		
 		{
-			//replaceIFs(IFBudget(mutatedNode, _ifBudget), *subNode);
-			*subNode = createWithShapiro(IFBudget(mutatedNode, _ifBudget), _rndEngine);
+			//replaceIFs(budget, *subNode);
+			*subNode = createWithShapiro(budget, rndEngine);
 		}
 
 		return mutatedNode;
 	}
 }
 
-std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::crossover(const CSGNode& node1, const CSGNode& node2) const
+std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::crossover(const CSGNode& node1, const CSGNode& node2, std::default_random_engine& rndEngine) const
 {
-	static std::bernoulli_distribution db{};
+	std::bernoulli_distribution db{};
 	using parmb_t = decltype(db)::param_type;
 
-	if (db(_rndEngine, parmb_t{ _simpleCrossoverProb }))
+	if (db(rndEngine, parmb_t{ _simpleCrossoverProb }))
 	{
-		return simpleCrossover(node1, node2);
+		return simpleCrossover(node1, node2, rndEngine);
 	}
 	else
 	{
-		return sharedPrimitiveCrossover(node1, node2);
+		return sharedPrimitiveCrossover(node1, node2, rndEngine);
 	}
 }
 
 
-std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::simpleCrossover(const CSGNode & node1, const CSGNode & node2) const
+std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::simpleCrossover(const CSGNode & node1, const CSGNode & node2, std::default_random_engine& rndEngine) const
 {
 	if (!node1.isValid() || !node2.isValid())
 		return std::vector<lmu::CSGNode> {node1, node2};
@@ -197,11 +251,11 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::simpleCrossover(const CSGNode &
 	auto newNode1 = node1;
 	auto newNode2 = node2;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
-	int nodeIdx1 = du(_rndEngine, parmu_t{ 0, numNodes1 - 1 });
-	int nodeIdx2 = du(_rndEngine, parmu_t{ 0, numNodes2 - 1 });
+	int nodeIdx1 = du(rndEngine, parmu_t{ 0, numNodes1 - 1 });
+	int nodeIdx2 = du(rndEngine, parmu_t{ 0, numNodes2 - 1 });
 
 	CSGNode* subNode1 = nodePtrAt(newNode1, nodeIdx1);
 	CSGNode* subNode2 = nodePtrAt(newNode2, nodeIdx2);
@@ -214,7 +268,7 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::simpleCrossover(const CSGNode &
 	};
 }
 
-std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::sharedPrimitiveCrossover(const CSGNode& node1, const CSGNode& node2) const
+std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::sharedPrimitiveCrossover(const CSGNode& node1, const CSGNode& node2, std::default_random_engine& rndEngine) const
 {
 	if (!node1.isValid() || !node2.isValid())
 		return std::vector<lmu::CSGNode> {node1, node2};
@@ -224,9 +278,9 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::sharedPrimitiveCrossover(const
 	auto newNode1 = node1;
 	auto newNode2 = node2;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
-	int nodeIdx1 = du(_rndEngine, parmu_t{ 0, numNodes(node1) - 1 });
+	int nodeIdx1 = du(rndEngine, parmu_t{ 0, numNodes(node1) - 1 });
 
 	CSGNode* subNode1 = nodePtrAt(newNode1, nodeIdx1);
 	auto subNode1Funcs = lmu::allDistinctFunctions(*subNode1);
@@ -243,9 +297,9 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::sharedPrimitiveCrossover(const
 	double score1 = r.computeGeometryScore(*subNode1, funcs);
 	double score2 = r.computeGeometryScore(*subNode2, funcs);
 
-	std::cout << "CROSSOVER" << std::endl;
-	std::cout << serializeNode(*subNode1) << "     " << serializeNode(*subNode2) << std::endl;
-	std::cout << score1 << "     " << score2 << std::endl;
+	LMU_LOG_DEBUG("CROSSOVER" << std::endl
+		<< serializeNode(*subNode1) << "     " << serializeNode(*subNode2) << std::endl
+		<< score1 << "     " << score2);
 	if (score1 > score2)
 		*subNode2 = *subNode1;
 	else if (score1 < score2)
@@ -254,11 +308,13 @@ std::vector<lmu::CSGNode> lmu::CSGNodeCreatorV2::sharedPrimitiveCrossover(const
 	return std::vector<lmu::CSGNode>{ newNode1, newNode2};
 }
 
-lmu::CSGNode lmu::CSGNodeCreatorV2::create() const
+lmu::CSGNode lmu::CSGNodeCreatorV2::create(std::default_random_engine& rndEngine) const
 {
 	auto budget = _ifBudget;
+	budget.seed(rndEngine());
+
 	auto node = CSGNode::invalidNode;
-	create(node, budget);
+	create(node, budget, rndEngine);
 	return node;
 }
 
@@ -276,15 +332,15 @@ void lmu::CSGNodeCreatorV2::replaceIFs(IFBudget& budget, CSGNode& node) const
 	}
 }
 
-void lmu::CSGNodeCreatorV2::create(lmu::CSGNode& node, IFBudget& budget) const
+void lmu::CSGNodeCreatorV2::create(lmu::CSGNode& node, IFBudget& budget, std::default_random_engine& rndEngine) const
 {
-	static std::bernoulli_distribution db{};
+	std::bernoulli_distribution db{};
 	using parmb_t = decltype(db)::param_type;
 
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
-	static std::uniform_real_distribution<double> dur(0, 1);
+	std::uniform_real_distribution<double> dur(0, 1);
 	using parmur_t = decltype(dur)::param_type;
 
 	if (budget.numFuncs() == 0)
@@ -293,10 +349,10 @@ void lmu::CSGNodeCreatorV2::create(lmu::CSGNode& node, IFBudget& budget) const
 	}
 	else
 	{
-		if (db(_rndEngine, parmb_t{ _subtreeProb }))
+		if (db(rndEngine, parmb_t{ _subtreeProb }))
 		{
 			std::discrete_distribution<> d({ 1, 1, 1 });
-			int op = d(_rndEngine) + 1; //0 is OperationType::Unknown, 6 is OperationType::Invalid.
+			int op = d(rndEngine) + 1; //0 is OperationType::Unknown, 6 is OperationType::Invalid.
 
 			node = createOperation(static_cast<CSGNodeOperationType>(op));
 
@@ -306,7 +362,7 @@ void lmu::CSGNodeCreatorV2::create(lmu::CSGNode& node, IFBudget& budget) const
 			for (int i = 0; i < numChilds; ++i)
 			{
 				auto child = CSGNode::invalidNode;
-				create(child, budget);
+				create(child, budget, rndEngine);
 				node.addChild(child);
 			}
 		}
@@ -330,6 +386,7 @@ lmu::CSGNode lmu::createCSGNodeWithGAV2(const lmu::Graph& connectionGraph, const
 	double mutation = p.getDouble("GA", "MutationRate", 0.3);
 	double crossover = p.getDouble("GA", "CrossoverRate", 0.4);
 	double simpleCrossoverProb = p.getDouble("GA", "SimpleCrossoverRate", 0.4);
+	unsigned int seed = p.getInt("GA", "Seed", 0);
 
 	int k = p.getInt("Selection", "TournamentK", 2);
 
@@ -351,7 +408,7 @@ lmu::CSGNode lmu::createCSGNodeWithGAV2(const lmu::Graph& connectionGraph, const
 
 	// New Ranker
 	lmu::CSGNodeGAV2 ga;
-	lmu::CSGNodeGAV2::Parameters params(popSize, numBestParents, mutation, crossover, inParallel, Schedule(), Schedule(), false);
+	lmu::CSGNodeGAV2::Parameters params(popSize, numBestParents, mutation, crossover, inParallel, Schedule(), Schedule(), false, seed);
 
 	lmu::CSGNodeRankerV2 r(connectionGraph, sizeWeight, gradientStepSize);
 	
@@ -398,8 +455,9 @@ lmu::IFBudgetPerIF::IFBudgetPerIF(const lmu::Graph& g) :
 		_budget[func] = 0;
 
 	//heuristic for function budget based on cliques.
-	auto cliques = lmu::getCliques(prunedGraph);
-	for (const auto& clique : cliques)
+	//Cliques are streamed as they are found, the budget update per clique is cheap enough to run in the serialized callback. 
+	//Sums do not depend on the order of the cliques.
+	lmu::enumerateCliques(prunedGraph, [this](const lmu::Clique& clique, const std::vector<int>&)
 	{
 		for (const auto& func : clique.functions)
 		{
@@ -422,12 +480,12 @@ lmu::IFBudgetPerIF::IFBudgetPerIF(const lmu::Graph& g) :
 				budgetForFunc = 5;
 				break;
 			default:
-				std::cerr << "Cannot estimate budget for Function. Not implemented for clique size " << clique.functions.size() << "." << std::endl;
+				LMU_LOG_ERROR("Cannot estimate budget for Function. Not implemented for clique size " << clique.functions.size() << ".");
 			}
 
 			_budget[func] += budgetForFunc;
 		}
-	}
+	});
 
 	//add pruned functions with a budget of 1.
 	for (const auto& func : funcs)
@@ -464,7 +522,7 @@ lmu::ImplicitFunctionPtr lmu::IFBudgetPerIF::useIF(const lmu::ImplicitFunctionPt
 
 lmu::ImplicitFunctionPtr lmu::IFBudgetPerIF::getRandomIF(bool uniform)
 {
-	static std::uniform_int_distribution<> du{};
+	std::uniform_int_distribution<> du{};
 	using parmu_t = decltype(du)::param_type;
 
 	std::vector<lmu::ImplicitFunctionPtr> funcs(_budget.size());
@@ -486,6 +544,11 @@ lmu::ImplicitFunctionPtr lmu::IFBudgetPerIF::getRandomIF(bool uniform)
 	return useIF(funcs[funcIdx]);
 }
 
+void lmu::IFBudgetPerIF::seed(std::default_random_engine::result_type value)
+{
+	_rndEngine.seed(value);
+}
+
 lmu::ImplicitFunctionPtr lmu::IFBudgetPerIF::useFirstIF()
 {
 	return useIF(_budget.begin()->first);
@@ -517,21 +580,31 @@ std::ostream& lmu::operator<<(std::ostream& os, const IFBudgetPerIF& b)
 lmu::CSGNode lmu::computeGAWithPartitionsV2(const std::vector<Graph>& partitions,
 	const lmu::ParameterSet& params)
 {
+	//Shapiro results of the population manipulators are shared by all partitions.
+	lmu::ShapiroCache::Scope shapiroCacheScope;
+
 	lmu::CSGNode res = lmu::op<Union>();
 
 	//for (const auto& pi: get<1>(partition)) {
 	//  res.addChild(lmu::geometry(pi));
 	//}
 
+	//Partitions are independent, largest partitions are started first.
+	std::vector<lmu::CSGNode> gaResults(partitions.size(), lmu::CSGNode(nullptr));
+	std::vector<double> sizes;
 	for (const auto& p : partitions)
+		sizes.push_back(numVertices(p));
+
+	lmu::parallelForLargestFirst(sizes, [&](int i)
 	{			
-		lmu::CSGNode ga = lmu::createCSGNodeWithGAV2(p, params);
+		gaResults[i] = lmu::createCSGNodeWithGAV2(partitions[i], params);
+	});
 
-		if (partitions.size() == 1)
-			return ga;
+	if (partitions.size() == 1)
+		return gaResults.front();
 
+	for (const auto& ga : gaResults)
 		res.addChild(ga);
-	}
 
 	return res;
 }
\ No newline at end of file
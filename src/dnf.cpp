@@ -4,6 +4,8 @@
 #include "congraph.h"
 
 #include <algorithm>
+#include <atomic>
+#include <sstream>
 #include <unordered_map>
 #include <Eigen/Core>
 
@@ -13,6 +15,8 @@
 
 #include "statistics.h"
 #include "helper.h"
+#include "threadpool.h"
+#include "log.h"
 
 Eigen::MatrixXd lmu::g_testPoints;
 lmu::Clause lmu::g_clause;
@@ -77,7 +81,7 @@ inline double median(std::vector<double> v)
 }
 
 //https://www.mathworks.com/help/matlab/ref/isoutlier.html
-std::tuple<double,double> scaled3MADAndMedian(const lmu::ImplicitFunctionPtr& func, double h)
+lmu::OutlierTestValue scaled3MADAndMedian(const lmu::ImplicitFunctionPtr& func, double h)
 {	
 	lmu::CSGNode node = lmu::geometry(func);
 
@@ -101,21 +105,42 @@ std::tuple<double,double> scaled3MADAndMedian(const lmu::ImplicitFunctionPtr& fu
 
 	const double c = -1.0 / (std::sqrt(2.0)*boost::math::erfc_inv(3.0 / 2.0));
 	
-	return std::make_tuple(c * median(values) * 3.0, med);
+	lmu::OutlierTestValue res;
+	res.maxDelta = c * median(values) * 3.0;
+	res.median = med;
+
+	//values now contains |deviation - median| for each point.
+	res.outliers.resize(values.size());
+	for (size_t j = 0; j < values.size(); ++j)
+		res.outliers[j] = values[j] > res.maxDelta;
+
+	return res;
 }
 
-std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double, double>> lmu::computeOutlierTestValues(const std::vector<lmu::ImplicitFunctionPtr>& functions, double h)
+lmu::OutlierTestValues lmu::computeOutlierTestValues(const std::vector<lmu::ImplicitFunctionPtr>& functions, double h)
 {
-	std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double, double>> map;
+	ShapiroCache& cache = ShapiroCache::instance();
+
+	std::vector<OutlierTestValue> values(functions.size());
+	lmu::parallelFor(0, functions.size(), 1, [&](int i)
+	{
+		if (cache.getOutlierTestValue(functions[i], h, values[i]))
+			return;
+
+		values[i] = scaled3MADAndMedian(functions[i], h);
+		cache.addOutlierTestValue(functions[i], h, values[i]);
+	});
+
+	OutlierTestValues map;
 
-	std::cout << "----------------------------" << std::endl;
-	std::cout << "Deviation from flatness outliers: " << std::endl;
-	for (const auto& func : functions)
+	LMU_LOG_INFO("----------------------------");
+	LMU_LOG_INFO("Deviation from flatness outliers: ");
+	for (size_t i = 0; i < functions.size(); ++i)
 	{
-		map[func] = scaled3MADAndMedian(func, h);
-		std::cout << func->name() << ": " << std::get<0>(map[func]) << " Mean: " << std::get<1>(map[func]) << std::endl;
+		map[functions[i]] = values[i];
+		LMU_LOG_INFO(functions[i]->name() << ": " << values[i].maxDelta << " Mean: " << values[i].median << " #Outliers: " << values[i].outliers.count());
 	}
-	std::cout << "----------------------------" << std::endl;
+	LMU_LOG_INFO("----------------------------");
 
 
 	return map;
@@ -179,7 +204,7 @@ std::vector<std::tuple<lmu::Clause, size_t>> getValidClauses(const std::vector<s
 	double angleT = 0.6; // getInOutThreshold(angleQualityValues);
 	
 
-	std::cout << "DIST T: " << distT << " ANGLE T: " << angleT;
+	LMU_LOG_DEBUG("DIST T: " << distT << " ANGLE T: " << angleT);
 	
 	std::vector<std::tuple<lmu::Clause, size_t>> validClauses;
 
@@ -202,7 +227,7 @@ bool isConnected(const lmu::Clause& c, const std::vector<lmu::ImplicitFunctionPt
 }
 
 std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, const std::vector<ImplicitFunctionPtr>& functions, int numClauseFunctions,
-	const std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double, double>>& outlierTestValues, const lmu::Graph& conGraph, const SampleParams& params)
+	const OutlierTestValues& outlierTestValues, const lmu::Graph& conGraph, const SampleParams& params)
 {
 	lmu::CSGNode node = clauseToCSGNode(clause, functions);
 
@@ -215,9 +240,15 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 
 	double correctSamplesPointCheck = std::numeric_limits<double>::max();
 
-	std::cout << "Clause: ";
-	print(std::cout, clause, functions, false);
-	std::cout << std::endl;
+	const bool debug = LMU_LOG_ENABLED(lmu::LogLevel::Debug);
+	std::stringstream log;
+
+	if (debug)
+	{
+		log << "Clause: ";
+		print(log, clause, functions, false);
+		log << std::endl;
+	}
 
 	int numConsideredFunctions = 0;
 
@@ -274,7 +305,8 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 
 
 		double score = numConsideredSamples == 0 ? 1.0 : (double)numCorrectSamples / (double)numConsideredSamples;
-		std::cout << currentFunc->name() << ": " << score << std::endl;
+		if (debug)
+			log << currentFunc->name() << ": " << score << std::endl;
 		correctSamplesPointCheck = score < correctSamplesPointCheck ? score : correctSamplesPointCheck;		
 	}
 
@@ -286,7 +318,8 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 	totalNumConsideredSamples = 0;
 	totalNumCorrectSamples = 0;
 
-	std::cout << "-" << std::endl;
+	if (debug)
+		log << "-" << std::endl;
 
 	double correctSamplesAngleCheck = std::numeric_limits<double>::max();
 
@@ -301,7 +334,7 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 			continue;
 
 		lmu::ImplicitFunctionPtr currentFunc = functions[i];
-		std::tuple<double, double> outlierTestValue = outlierTestValues.at(currentFunc);
+		const OutlierTestValue& outlierTestValue = outlierTestValues.at(currentFunc);
 
 		for (int j = 0; j < currentFunc->pointsCRef().rows(); ++j)
 		{
@@ -330,11 +363,7 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 
 			//Normals close to edges tend to be brittle. 
 			//We try to filter normals that are located close to curvature outliers (== edges).
-			Curvature c = curvature(sampleP, geometry(currentFunc), params.h);
-			double deviationFromFlatness = std::sqrt(c.k1 * c.k1 + c.k2 * c.k2);
-			double median = std::get<1>(outlierTestValue);
-			double maxDelta = std::get<0>(outlierTestValue);
-			if (std::abs(deviationFromFlatness - median) > maxDelta)
+			if (outlierTestValue.outliers[j])
 			{	
 				//std::cout << deviationFromFlatness << " ";
 
@@ -364,7 +393,8 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 		}
 
 		double score = numConsideredSamples == 0 ? 1.0 : (double)numCorrectSamples / (double)numConsideredSamples;
-		std::cout << currentFunc->name() << ": " << score  << std::endl;
+		if (debug)
+			log << currentFunc->name() << ": " << score << std::endl;
 		correctSamplesAngleCheck = score < correctSamplesAngleCheck ? score: correctSamplesAngleCheck;
 
 		totalNumConsideredSamples += numConsideredSamples;
@@ -374,45 +404,724 @@ std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, c
 	if (totalNumConsideredSamples == 0)
 		correctSamplesAngleCheck = 0.0;
 
-	std::cout << "---------------------------------" << std::endl;
+	if (debug)
+		log << "---------------------------------";
+	LMU_LOG_DEBUG(log.str());
 		
 	return std::make_tuple(clause, correctSamplesPointCheck, correctSamplesAngleCheck);
 }
 
-std::vector<std::tuple<lmu::Clause, double, double>>  permutateAllPossibleFPs(lmu::Clause clause /*copy necessary*/, lmu::DNF& dnf, const std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double,double>> outlierTestValues, 
-	const lmu::Graph& conGraph, const lmu::SampleParams& params, int& iterationCounter)
-{	
+lmu::ClauseScoringTable lmu::createClauseScoringTable(const std::vector<ImplicitFunctionPtr>& functions,
+	const OutlierTestValues& outlierTestValues,
+	const lmu::Graph& conGraph, const SampleParams& params)
+{
+	const double smallestDelta = 0.000000001;
+	const int n = functions.size();
+
+	ClauseScoringTable table;
+	table.functions = functions;
+	table.pointSets.resize(n * n);
+	table.connected.resize(n * n, 0);
+	table.flat.resize(n);
+	table.distances.resize(n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		for (int l = 0; l < n; ++l)
+		{
+			if (i != l && conGraph.vertexLookup.count(functions[i]) && conGraph.vertexLookup.count(functions[l]))
+				table.connected[table.index(i, l)] = lmu::areConnected(conGraph, functions[i], functions[l]);
+		}
+	}
+
+	//Cost grows with the number of points of a function.
+	std::vector<double> costs(n);
+	for (int i = 0; i < n; ++i)
+		costs[i] = functions[i]->pointsCRef().rows();
+
+	lmu::parallelForLargestFirst(costs, [&](int i)
+	{
+		const auto& points = functions[i]->pointsCRef();
+		const int numPoints = points.rows();
+
+		Eigen::MatrixXd& dist = table.distances[i];
+		dist.resize(numPoints, n);
+		for (int j = 0; j < numPoints; ++j)
+		{
+			Eigen::Vector3d p = points.row(j).leftCols(3).transpose();
+			for (int l = 0; l < n; ++l)
+				dist(j, l) = functions[l]->signedDistance(p);
+		}
+
+		for (int l = 0; l < n; ++l)
+		{
+			ClausePointSets& sets = table.pointSets[table.index(i, l)];
+			for (auto set : { &sets.inside, &sets.outside, &sets.notAbove, &sets.notAboveNeg, &sets.notBelow, &sets.notBelowNeg, &sets.gradientAligned, &sets.gradientOpposed })
+				set->resize(numPoints);
+
+			for (int j = 0; j < numPoints; ++j)
+			{
+				double d = dist(j, l);
+				double di = dist(j, i);
+
+				sets.inside[j] = d < -smallestDelta;
+				sets.outside[j] = d > smallestDelta;
+				sets.notAbove[j] = d - di <= smallestDelta;
+				sets.notAboveNeg[j] = -d - di <= smallestDelta;
+				sets.notBelow[j] = d - di >= -smallestDelta;
+				sets.notBelowNeg[j] = -d - di >= -smallestDelta;
+
+				//The gradient of l is only needed where l can define the surface of a clause containing i.
+				if (l == i || (sets.notAbove[j] && sets.notBelow[j]) || (sets.notAboveNeg[j] && sets.notBelowNeg[j]))
+				{
+					Eigen::Matrix<double, 1, 6> pn = points.row(j);
+					Eigen::Vector3d p = pn.leftCols(3);
+					Eigen::Vector3d normal = pn.rightCols(3);
+
+					Eigen::Vector3d grad = functions[l]->signedDistanceAndGradient(p, params.h).bottomRows(3);
+					double gradDotN = grad.dot(normal);
+
+					sets.gradientAligned[j] = gradDotN > 0.0;
+					sets.gradientOpposed[j] = gradDotN < 0.0;
+				}
+			}
+		}
+
+		//Normals close to edges tend to be brittle. 
+		//We try to filter normals that are located close to curvature outliers (== edges).
+		table.flat[i] = ~outlierTestValues.at(functions[i]).outliers;
+	});
+
+	return table;
+}
+
+lmu::ClauseScoringTable lmu::createClauseScoringTable(const ClauseScoringTable& table, const std::vector<ImplicitFunctionPtr>& functions)
+{
+	std::vector<int> indices;
+	for (const auto& f : functions)
+	{
+		auto it = std::find(table.functions.begin(), table.functions.end(), f);
+		if (it == table.functions.end())
+			throw std::runtime_error("Function '" + f->name() + "' is not part of the clause scoring table.");
+		indices.push_back(it - table.functions.begin());
+	}
+
+	const int n = functions.size();
+
+	ClauseScoringTable subTable;
+	subTable.functions = functions;
+	subTable.pointSets.resize(n * n);
+	subTable.connected.resize(n * n, 0);
+	subTable.flat.resize(n);
+	subTable.distances.resize(n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		for (int l = 0; l < n; ++l)
+		{
+			subTable.pointSets[subTable.index(i, l)] = table.pointSets[table.index(indices[i], indices[l])];
+			subTable.connected[subTable.index(i, l)] = table.connected[table.index(indices[i], indices[l])];
+		}
+
+		subTable.flat[i] = table.flat[indices[i]];
+
+		const Eigen::MatrixXd& dist = table.distances[indices[i]];
+		subTable.distances[i].resize(dist.rows(), n);
+		for (int l = 0; l < n; ++l)
+			subTable.distances[i].col(l) = dist.col(indices[l]);
+	}
+
+	return subTable;
+}
+
+bool isConnected(const lmu::Clause& c, const lmu::ClauseScoringTable& table, int func)
+{
+	for (size_t i = 0; i < c.literals.size(); ++i)
+		if (c.literals[i] && table.connected[table.index(func, i)])
+			return true;
+
+	return false;
+}
+
+//Index of the literal that defines the clause's distance (and gradient) at a point (first maximum, see intersection in CSGNode).
+int definingLiteral(const lmu::Clause& clause, const Eigen::MatrixXd& distances, int point)
+{
+	double maxDist = -std::numeric_limits<double>::max();
+	int maxLiteral = 0;
+
+	for (size_t l = 0; l < clause.size(); ++l)
+	{
+		if (!clause.literals[l])
+			continue;
+
+		double d = clause.negated[l] ? -distances(point, l) : distances(point, l);
+		if (d > maxDist)
+		{
+			maxDist = d;
+			maxLiteral = l;
+		}
+	}
+
+	return maxLiteral;
+}
+
+//Number of points of literal i that lie on the surface of multiple literals where the node's gradient points in the direction of the point normal.
+//These points take the gradient of the literal that defines the node's distance.
+size_t countCorrectAmbiguousSamples(const lmu::Clause& clause, const lmu::ClauseScoringTable& table, int i, const boost::dynamic_bitset<>& ambiguousSamples)
+{
+	size_t numCorrectSamples = 0;
+
+	for (size_t j = ambiguousSamples.find_first(); j != boost::dynamic_bitset<>::npos; j = ambiguousSamples.find_next(j))
+	{
+		int l = definingLiteral(clause, table.distances[i], j);
+		const lmu::ClausePointSets& sets = table.pointSets[table.index(i, l)];
+		if (clause.negated[l] ? sets.gradientOpposed[j] : sets.gradientAligned[j])
+			numCorrectSamples++;
+	}
+
+	return numCorrectSamples;
+}
+
+//Number of considered points of literal i where the node's gradient points in the direction of the point normal.
+size_t countCorrectSamples(const lmu::Clause& clause, const lmu::ClauseScoringTable& table, int i,
+	const boost::dynamic_bitset<>& consideredSamples, const boost::dynamic_bitset<>& onOtherSurfaces)
+{
+	const lmu::ClausePointSets& ownSets = table.pointSets[table.index(i, i)];
+
+	//Points only on the surface of function i have the (possibly complemented) gradient of function i.
+	boost::dynamic_bitset<> ambiguousSamples = consideredSamples & onOtherSurfaces;
+	size_t numCorrectSamples = ((consideredSamples - ambiguousSamples) &
+		(clause.negated[i] ? ownSets.gradientOpposed : ownSets.gradientAligned)).count();
+
+	return numCorrectSamples + countCorrectAmbiguousSamples(clause, table, i, ambiguousSamples);
+}
+
+std::tuple<lmu::Clause, double, double> lmu::scoreClause(const Clause& clause, const ClauseScoringTable& table)
+{
+	const auto& functions = table.functions;
+	const int n = functions.size();
+
+	double correctSamplesPointCheck = std::numeric_limits<double>::max();
+
+	//Clauses are scored concurrently, the log is written as one record to not interleave with other clauses.
+	const bool debug = LMU_LOG_ENABLED(lmu::LogLevel::Debug);
+	std::stringstream log;
+
+	if (debug)
+	{
+		log << "Clause: ";
+		print(log, clause, functions, false);
+		log << std::endl;
+	}
+
+	int numConsideredFunctions = 0;
+
+	//Point position violation check.
+	for (int i = 0; i < n; ++i)
+	{
+		//function should not be a literal of the clause to test.
+		if (clause.literals[i])
+			continue;
+
+		//If current primitive is not connected with primitives in clause, continue.
+		if (!isConnected(clause, table, i))
+			continue;
+
+		numConsideredFunctions++;
+
+		//Points inside all literals are inside the node's volume (=> wrong node).
+		boost::dynamic_bitset<> wrongSamples(table.flat[i].size());
+		wrongSamples.set();
+		for (int l = 0; l < n; ++l)
+		{
+			if (!clause.literals[l])
+				continue;
+
+			const ClausePointSets& sets = table.pointSets[table.index(i, l)];
+			wrongSamples &= clause.negated[l] ? sets.outside : sets.inside;
+		}
+
+		size_t numConsideredSamples = wrongSamples.size();
+		size_t numCorrectSamples = numConsideredSamples - wrongSamples.count();
+
+		double score = numConsideredSamples == 0 ? 1.0 : (double)numCorrectSamples / (double)numConsideredSamples;
+		if (debug)
+			log << functions[i]->name() << ": " << score << std::endl;
+		correctSamplesPointCheck = score < correctSamplesPointCheck ? score : correctSamplesPointCheck;
+	}
+
+	//If no function was considered then all functions are literals.
+	//In that case, point check is pointless.
+	if (numConsideredFunctions == 0)
+		correctSamplesPointCheck = 1.0;
+
+	if (debug)
+		log << "-" << std::endl;
+
+	double correctSamplesAngleCheck = std::numeric_limits<double>::max();
+	size_t totalNumConsideredSamples = 0;
+
+	//Angle violation check.
+	for (int i = 0; i < n; ++i)
+	{
+		//function must be a literal of the clause to test.
+		if (!clause.literals[i])
+			continue;
+
+		const ClausePointSets& ownSets = table.pointSets[table.index(i, i)];
+
+		//Only consider points on the node's surface (no literal is above, at least one literal is not below the point) 
+		//that are not close to an edge.
+		boost::dynamic_bitset<> consideredSamples = table.flat[i];
+		boost::dynamic_bitset<> onOtherSurfaces(consideredSamples.size());
+		for (int l = 0; l < n; ++l)
+		{
+			if (!clause.literals[l])
+				continue;
+
+			const ClausePointSets& sets = table.pointSets[table.index(i, l)];
+			consideredSamples &= clause.negated[l] ? sets.notAboveNeg : sets.notAbove;
+			if (l != i)
+				onOtherSurfaces |= clause.negated[l] ? sets.notBelowNeg : sets.notBelow;
+		}
+		consideredSamples &= (clause.negated[i] ? ownSets.notBelowNeg : ownSets.notBelow) | onOtherSurfaces;
+
+		size_t numCorrectSamples = countCorrectSamples(clause, table, i, consideredSamples, onOtherSurfaces);
+		size_t numConsideredSamples = consideredSamples.count();
+
+		double score = numConsideredSamples == 0 ? 1.0 : (double)numCorrectSamples / (double)numConsideredSamples;
+		if (debug)
+			log << functions[i]->name() << ": " << score << std::endl;
+		correctSamplesAngleCheck = score < correctSamplesAngleCheck ? score : correctSamplesAngleCheck;
+
+		totalNumConsideredSamples += numConsideredSamples;
+	}
+
+	if (totalNumConsideredSamples == 0)
+		correctSamplesAngleCheck = 0.0;
+
+	if (debug)
+		log << "---------------------------------";
+	LMU_LOG_DEBUG(log.str());
+
+	return std::make_tuple(clause, correctSamplesPointCheck, correctSamplesAngleCheck);
+}
+
+//Number of scored or skipped negation patterns, reported in percent of all patterns.
+struct SearchProgress
+{
+	SearchProgress(uint64_t numPatterns) :
+		numPatterns(numPatterns),
+		numDonePatterns(0),
+		reportedPercentage(-1)
+	{
+	}
+
+	void add(uint64_t n)
+	{
+		int percentage = (int)((numDonePatterns += n) * 100 / numPatterns);
+
+		//Only the thread that advances the percentage reports it.
+		int reported = reportedPercentage;
+		while (percentage > reported)
+		{
+			if (reportedPercentage.compare_exchange_weak(reported, percentage))
+			{
+				LMU_LOG_INFO("Ready: " << percentage << "%");
+				break;
+			}
+		}
+	}
+
+	const uint64_t numPatterns;
+	std::atomic<uint64_t> numDonePatterns;
+	std::atomic<int> reportedPercentage;
+};
+
+//Branch-and-bound search over the negation patterns of the clause that has all functions of the table as literals.
+//Negations are fixed in function order. For a prefix of fixed negations, the points of function i that can still be on 
+//the surface of the clause are flat_i & AND(notAbove of fixed literals) & AND(notAbove | notAboveNeg of open literals).
+//This set only shrinks when more negations are fixed. If it is empty for all functions, no completion has considered points, 
+//i.e. all completions have an angle score of 0 and are not valid (e.g. two positive literals that do not overlap). 
+//Partial intersections (and the unions needed to detect points on multiple surfaces) are kept per depth.
+//The last negations are enumerated in Gray code order, see searchGrayCode().
+struct NegationPatternSearch
+{
+	NegationPatternSearch(const lmu::ClauseScoringTable& table, SearchProgress& progress) :
+		table(table),
+		n(table.functions.size()),
+		progress(progress),
+		clause(table.functions.size()),
+		surface(n + 1, std::vector<boost::dynamic_bitset<>>(n)),
+		onOtherSurfaces(n + 1, std::vector<boost::dynamic_bitset<>>(n)),
+		openSurface(n + 1, std::vector<boost::dynamic_bitset<>>(n)),
+		consideredSamples(n),
+		ambiguousSamples(n),
+		correctSamples(n)
+	{
+		std::fill(clause.literals.begin(), clause.literals.end(), true);
+
+		for (int i = 0; i < n; ++i)
+		{
+			surface[0][i] = table.flat[i];
+			onOtherSurfaces[0][i].resize(table.flat[i].size());
+
+			openSurface[n][i].resize(table.flat[i].size());
+			openSurface[n][i].set();
+			for (int l = n - 1; l >= 0; --l)
+			{
+				const lmu::ClausePointSets& sets = table.pointSets[table.index(i, l)];
+				openSurface[l][i] = openSurface[l + 1][i] & (sets.notAbove | sets.notAboveNeg);
+			}
+		}
+	}
+
+	bool canHaveSurfacePoints(int depth) const
+	{
+		for (int i = 0; i < n; ++i)
+			if (surface[depth][i].intersects(openSurface[depth][i]))
+				return true;
+
+		return false;
+	}
+
+	void fixNegation(int depth, bool negated)
+	{
+		clause.negated[depth] = negated;
+
+		for (int i = 0; i < n; ++i)
+		{
+			const lmu::ClausePointSets& sets = table.pointSets[table.index(i, depth)];
+
+			surface[depth + 1][i] = surface[depth][i];
+			surface[depth + 1][i] &= negated ? sets.notAboveNeg : sets.notAbove;
+
+			onOtherSurfaces[depth + 1][i] = onOtherSurfaces[depth][i];
+			if (i != depth)
+				onOtherSurfaces[depth + 1][i] |= negated ? sets.notBelowNeg : sets.notBelow;
+		}
+	}
+
+	//Same result and log as lmu::scoreClause(clause, table) but based on the memoized sets.
+	//Set operations are done in place on per-function buffers, scoring does not allocate (besides the debug log).
+	std::tuple<lmu::Clause, double, double> scoreClause()
+	{
+		const bool debug = LMU_LOG_ENABLED(lmu::LogLevel::Debug);
+		std::stringstream log;
+		if (debug)
+		{
+			log << "Clause: ";
+			print(log, clause, table.functions, false);
+			log << std::endl << "-" << std::endl;
+		}
+
+		double correctSamplesAngleCheck = std::numeric_limits<double>::max();
+		size_t totalNumConsideredSamples = 0;
+
+		for (int i = 0; i < n; ++i)
+		{
+			const lmu::ClausePointSets& ownSets = table.pointSets[table.index(i, i)];
+
+			boost::dynamic_bitset<>& considered = consideredSamples[i];
+			considered = clause.negated[i] ? ownSets.notBelowNeg : ownSets.notBelow;
+			considered |= onOtherSurfaces[n][i];
+			considered &= surface[n][i];
+
+			boost::dynamic_bitset<>& ambiguous = ambiguousSamples[i];
+			ambiguous = considered;
+			ambiguous &= onOtherSurfaces[n][i];
+
+			boost::dynamic_bitset<>& correct = correctSamples[i];
+			correct = considered;
+			correct -= ambiguous;
+			correct &= clause.negated[i] ? ownSets.gradientOpposed : ownSets.gradientAligned;
+
+			size_t numCorrectSamples = correct.count() + countCorrectAmbiguousSamples(clause, table, i, ambiguous);
+			size_t numConsideredSamples = considered.count();
+
+			double score = numConsideredSamples == 0 ? 1.0 : (double)numCorrectSamples / (double)numConsideredSamples;
+			if (debug)
+				log << table.functions[i]->name() << ": " << score << std::endl;
+			correctSamplesAngleCheck = score < correctSamplesAngleCheck ? score : correctSamplesAngleCheck;
+
+			totalNumConsideredSamples += numConsideredSamples;
+		}
+
+		if (totalNumConsideredSamples == 0)
+			correctSamplesAngleCheck = 0.0;
+
+		if (debug)
+			log << "---------------------------------";
+		LMU_LOG_DEBUG(log.str());
+
+		//All functions are literals, the point check is pointless.
+		return std::make_tuple(clause, 1.0, correctSamplesAngleCheck);
+	}
+
+	void scoreLeaf()
+	{
+		if (canHaveSurfacePoints(n))
+			clauses.push_back(scoreClause());
+
+		progress.add(1);
+	}
+
+	//Enumerates all completions of the negations from depth on in Gray code order. 
+	//Consecutive patterns differ in a single negation and only the memoized sets from that negation's depth on are updated.
+	//The last negation flips for every other pattern, so most patterns only update a single depth.
+	void searchGrayCode(int depth)
+	{
+		const int numOpen = n - depth;
+
+		for (int d = depth; d < n; ++d)
+			fixNegation(d, false);
+		scoreLeaf();
+
+		for (uint64_t k = 1; k < ((uint64_t)1 << numOpen); ++k)
+		{
+			//Gray code k ^ (k >> 1) differs from the previous one in the lowest set bit of k. Bit b is the negation at depth n - 1 - b.
+			int b = 0;
+			while (((k >> b) & 1) == 0)
+				b++;
+
+			int d = n - 1 - b;
+			fixNegation(d, !clause.negated[d]);
+			for (int e = d + 1; e < n; ++e)
+				fixNegation(e, clause.negated[e]);
+
+			scoreLeaf();
+		}
+	}
+
+	//Searches all patterns starting with the given prefix (first prefixLength negations, bit d of prefix is negation d).
+	void search(int depth, int prefixLength, uint64_t prefix)
+	{
+		//Below this number of open negations, bounds rarely prune and patterns are enumerated without them.
+		const int grayCodeDepth = 4;
+
+		if (!canHaveSurfacePoints(depth))
+		{
+			progress.add((uint64_t)1 << (n - depth));
+			return;
+		}
+
+		if (depth == n)
+		{
+			scoreLeaf();
+			return;
+		}
+
+		if (depth >= prefixLength && n - depth <= grayCodeDepth)
+		{
+			searchGrayCode(depth);
+			return;
+		}
+
+		for (int negated = 0; negated <= 1; ++negated)
+		{
+			if (depth < prefixLength && (int)((prefix >> depth) & 1) != negated)
+				continue;
+
+			fixNegation(depth, negated);
+			search(depth + 1, prefixLength, prefix);
+		}
+	}
+
+	const lmu::ClauseScoringTable& table;
+	const int n;
+	SearchProgress& progress;
+
+	lmu::Clause clause;
+	std::vector<std::vector<boost::dynamic_bitset<>>> surface;
+	std::vector<std::vector<boost::dynamic_bitset<>>> onOtherSurfaces;
+	std::vector<std::vector<boost::dynamic_bitset<>>> openSurface;
+
+	std::vector<boost::dynamic_bitset<>> consideredSamples;
+	std::vector<boost::dynamic_bitset<>> ambiguousSamples;
+	std::vector<boost::dynamic_bitset<>> correctSamples;
+
 	std::vector<std::tuple<lmu::Clause, double, double>> clauses;
+};
 
-	std::sort(clause.negated.begin(), clause.negated.end());
-	do {							
-		clauses.push_back(lmu::scoreClause(clause, dnf.functions, dnf.functions.size(), outlierTestValues, conGraph, params));
+//Scores all negation patterns of the clause that has all functions of the table as literals and may be valid.
+//Result is ordered by number of negations and then in std::next_permutation order.
+std::vector<std::tuple<lmu::Clause, double, double>> permutateAllPossibleFPs(const lmu::ClauseScoringTable& table)
+{
+	const int n = table.functions.size();
+	SearchProgress progress((uint64_t)1 << n);
 
-		iterationCounter++;		
-		std::cout << "Ready: " << (double)iterationCounter / std::pow(2, clause.negated.size()) * 100.0 << "%" << std::endl;
+	//Subtrees of all negation prefixes of a certain length are searched in parallel.
+	int prefixLength = 0;
+	while (prefixLength < n && ((uint64_t)1 << prefixLength) < 16 * (uint64_t)lmu::ThreadPool::instance().numThreads())
+		prefixLength++;
 
-	} while (std::next_permutation(clause.negated.begin(), clause.negated.end()));
+	std::vector<std::vector<std::tuple<lmu::Clause, double, double>>> prefixClauses((size_t)1 << prefixLength);
+
+	lmu::parallelFor(0, prefixClauses.size(), 1, [&](int prefix)
+	{
+		NegationPatternSearch search(table, progress);
+		search.search(0, prefixLength, prefix);
+		prefixClauses[prefix] = std::move(search.clauses);
+	});
+
+	std::vector<std::tuple<lmu::Clause, double, double>> clauses;
+	for (auto& c : prefixClauses)
+		clauses.insert(clauses.end(), c.begin(), c.end());
+
+	std::sort(clauses.begin(), clauses.end(), [](const auto& c0, const auto& c1)
+	{
+		const auto& n0 = std::get<0>(c0).negated;
+		const auto& n1 = std::get<0>(c1).negated;
+		auto k0 = std::count(n0.begin(), n0.end(), true);
+		auto k1 = std::count(n1.begin(), n1.end(), true);
+
+		return k0 != k1 ? k0 < k1 : n0 < n1;
+	});
 
 	return clauses;
 }
 
-std::tuple<lmu::DNF, std::vector<lmu::ImplicitFunctionPtr>> identifyPrimeImplicants(const std::vector<lmu::ImplicitFunctionPtr>& functions, 
-	const std::unordered_map<lmu::ImplicitFunctionPtr, std::tuple<double, double>> outlierTestValues, const lmu::Graph& conGraph,
-	const lmu::SampleParams& params)
+lmu::ShapiroCache::Scope::Scope()
+{
+	ShapiroCache& cache = ShapiroCache::instance();
+	std::lock_guard<std::mutex> lock(cache._mutex);
+	cache._numScopes++;
+}
+
+lmu::ShapiroCache::Scope::~Scope()
+{
+	ShapiroCache& cache = ShapiroCache::instance();
+	std::lock_guard<std::mutex> lock(cache._mutex);
+	if (--cache._numScopes == 0)
+	{
+		cache._outlierTestValues.clear();
+		cache._singleLiteralScores.clear();
+	}
+}
+
+lmu::ShapiroCache::FunctionKey lmu::ShapiroCache::key(const ImplicitFunctionPtr& func, double h)
+{
+	return std::make_tuple(lmu::fingerprint({ func }), h);
+}
+
+std::vector<size_t> lmu::ShapiroCache::keys(const std::vector<ImplicitFunctionPtr>& funcs)
 {
+	std::vector<size_t> res;
+	res.reserve(funcs.size());
+	for (const auto& f : funcs)
+		res.push_back(lmu::fingerprint({ f }));
+	return res;
+}
+
+bool lmu::ShapiroCache::getOutlierTestValue(const ImplicitFunctionPtr& func, double h, OutlierTestValue& value) const
+{
+	auto k = key(func, h);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _outlierTestValues.find(k);
+	if (it == _outlierTestValues.end())
+		return false;
+
+	value = it->second;
+	return true;
+}
+
+void lmu::ShapiroCache::addOutlierTestValue(const ImplicitFunctionPtr& func, double h, const OutlierTestValue& value)
+{
+	auto k = key(func, h);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_numScopes > 0)
+		_outlierTestValues.insert(std::make_pair(k, value));
+}
+
+bool lmu::ShapiroCache::getSingleLiteralScores(const ImplicitFunctionPtr& func, const std::vector<ImplicitFunctionPtr>& neighbors, double h, std::tuple<double, double>& scores) const
+{
+	auto k = std::make_tuple(key(func, h), keys(neighbors));
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = _singleLiteralScores.find(k);
+	if (it == _singleLiteralScores.end())
+		return false;
+
+	scores = it->second;
+	return true;
+}
+
+void lmu::ShapiroCache::addSingleLiteralScores(const ImplicitFunctionPtr& func, const std::vector<ImplicitFunctionPtr>& neighbors, double h, const std::tuple<double, double>& scores)
+{
+	auto k = std::make_tuple(key(func, h), keys(neighbors));
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_numScopes > 0)
+		_singleLiteralScores.insert(std::make_pair(k, scores));
+}
+
+lmu::ShapiroCache& lmu::ShapiroCache::instance()
+{
+	static ShapiroCache cache;
+	return cache;
+}
+
+//Functions of the set that are connected with func (sorted by identity).
+std::vector<lmu::ImplicitFunctionPtr> getNeighborhood(const lmu::ImplicitFunctionPtr& func, const std::vector<lmu::ImplicitFunctionPtr>& functions, const lmu::Graph& conGraph)
+{
+	std::vector<lmu::ImplicitFunctionPtr> neighbors;
+
+	if (!conGraph.vertexLookup.count(func))
+		return neighbors;
+
+	for (const auto& f : functions)
+	{
+		if (f != func && conGraph.vertexLookup.count(f) && lmu::areConnected(conGraph, func, f))
+			neighbors.push_back(f);
+	}
+	std::sort(neighbors.begin(), neighbors.end());
+
+	return neighbors;
+}
+
+//If single literal clause scores are not cached, table is created for all functions.
+std::tuple<lmu::DNF, std::vector<lmu::ImplicitFunctionPtr>> identifyPrimeImplicants(const std::vector<lmu::ImplicitFunctionPtr>& functions,
+	const lmu::OutlierTestValues& outlierTestValues, const lmu::Graph& conGraph, const lmu::SampleParams& params, lmu::ClauseScoringTable& table)
+{
+	lmu::ShapiroCache& cache = lmu::ShapiroCache::instance();
+
 	//Check which primitive is completely inside the geometry.
 	std::vector<std::tuple<lmu::Clause, double, double>> clauses;
+	std::vector<std::vector<lmu::ImplicitFunctionPtr>> neighborhoods;
+	std::vector<int> uncachedClauses;
 	for (int i = 0; i < functions.size(); ++i)
 	{
 		//Defining a clause representing a single primitive.
 		lmu::Clause clause(functions.size());
 		clause.literals[i] = true;
 
-		//print(std::cout, clause, functions, false);
-		//std::cout << std::endl;
-		
-		auto c = lmu::scoreClause(clause, functions, functions.size(), outlierTestValues, conGraph, params);
-			clauses.push_back(c);			
+		neighborhoods.push_back(getNeighborhood(functions[i], functions, conGraph));
+
+		std::tuple<double, double> scores;
+		if (cache.getSingleLiteralScores(functions[i], neighborhoods[i], params.h, scores))
+		{
+			clauses.push_back(std::make_tuple(clause, std::get<0>(scores), std::get<1>(scores)));
+		}
+		else
+		{
+			clauses.push_back(std::make_tuple(clause, 0.0, 0.0));
+			uncachedClauses.push_back(i);
+		}
+	}
+
+	if (!uncachedClauses.empty())
+	{
+		table = lmu::createClauseScoringTable(functions, outlierTestValues, conGraph, params);
+
+		for (int i : uncachedClauses)
+		{
+			clauses[i] = lmu::scoreClause(std::get<0>(clauses[i]), table);
+			cache.addSingleLiteralScores(functions[i], neighborhoods[i], params.h, std::make_tuple(std::get<1>(clauses[i]), std::get<2>(clauses[i])));
+		}
 	}
 
 	//Create a DNF that contains a clause for each primitive.
@@ -450,14 +1159,17 @@ std::tuple<lmu::DNF, std::vector<lmu::ImplicitFunctionPtr>> identifyPrimeImplica
 
 lmu::DNF lmu::computeShapiro(const std::vector<ImplicitFunctionPtr>& functions, bool usePrimeImplicantOptimization, const lmu::Graph& conGraph, const SampleParams& params)
 {
+	ShapiroCache::Scope cacheScope;
+
 	DNF primeImplicantsDNF;
 	DNF dnf;
 
 	auto outlierTestValues = computeOutlierTestValues(functions, params.h);
+	ClauseScoringTable table;
 	
 	if (usePrimeImplicantOptimization)
 	{
-		auto res = identifyPrimeImplicants(functions, outlierTestValues, conGraph, params);
+		auto res = identifyPrimeImplicants(functions, outlierTestValues, conGraph, params, table);
 		primeImplicantsDNF = std::get<0>(res);
 		dnf.functions = std::get<1>(res);		
 	}
@@ -466,32 +1178,24 @@ lmu::DNF lmu::computeShapiro(const std::vector<ImplicitFunctionPtr>& functions,
 		dnf.functions = functions;
 	}
 
-	Clause clause(dnf.functions.size());
-	std::fill(clause.literals.begin(), clause.literals.end(), true);
-		
-	std::cout << "Do Shapiro..." << std::endl;
+	//Reuse the table of the prime implicant identification if it had to be created.
+	if (!table.functions.empty())
+		table = createClauseScoringTable(table, dnf.functions);
+	else
+		table = createClauseScoringTable(dnf.functions, outlierTestValues, conGraph, params);
+
+	LMU_LOG_INFO("Do Shapiro...");
 	//return primeImplicantsDNF;
 	
-	int iterationCounter = 0;
-
-	std::vector<std::tuple<lmu::Clause, double, double>> clauses;
-
-	for (int i = 0; i <= dnf.functions.size(); i++)
-	{	
-		auto newClauses = permutateAllPossibleFPs(clause, dnf, outlierTestValues, conGraph, params, iterationCounter);
-		clauses.insert(clauses.end(), newClauses.begin(), newClauses.end());
-				
-		if(i < dnf.functions.size())
-			clause.negated[i] = true;
-	}
+	auto clauses = permutateAllPossibleFPs(table);
 
 	//Check for validity of all found clauses
 	for (const auto& validClause : getValidClauses(clauses))
 		dnf.clauses.push_back(std::get<0>(validClause));
 
-	std::cout << "Done Shapiro." << std::endl;
+	LMU_LOG_INFO("Done Shapiro.");
 
-	return lmu::mergeDNFs({ primeImplicantsDNF, dnf });
+	return lmu::minimizeDNF(lmu::mergeDNFs({ primeImplicantsDNF, dnf }));
 }
 
 lmu::DNF lmu::mergeDNFs(const std::vector<DNF>& dnfs)
@@ -528,6 +1232,254 @@ lmu::DNF lmu::mergeDNFs(const std::vector<DNF>& dnfs)
 	return mergedDNF;
 }
 
+//Clause in positional cube notation: variable i can be 0 if zero[i] is set and can be 1 if one[i] is set.
+//Literals that are not part of the clause allow both values.
+struct Cube
+{
+	Cube(const lmu::Clause& clause) :
+		zero(clause.size()),
+		one(clause.size())
+	{
+		for (size_t i = 0; i < clause.size(); ++i)
+		{
+			zero[i] = !clause.literals[i] || clause.negated[i];
+			one[i] = !clause.literals[i] || !clause.negated[i];
+		}
+	}
+
+	lmu::Clause toClause() const
+	{
+		lmu::Clause clause(zero.size());
+		for (size_t i = 0; i < zero.size(); ++i)
+		{
+			clause.literals[i] = !(zero[i] && one[i]);
+			clause.negated[i] = !one[i];
+		}
+		return clause;
+	}
+
+	boost::dynamic_bitset<> literals() const
+	{
+		return ~(zero & one);
+	}
+
+	size_t numLiterals() const
+	{
+		return literals().count();
+	}
+
+	bool contains(const Cube& c) const
+	{
+		return c.zero.is_subset_of(zero) && c.one.is_subset_of(one);
+	}
+
+	bool intersects(const Cube& c) const
+	{
+		return ((zero & c.zero) | (one & c.one)).all();
+	}
+
+	boost::dynamic_bitset<> zero;
+	boost::dynamic_bitset<> one;
+};
+
+using Cover = std::vector<Cube>;
+
+//Cubes of the cover restricted to the subspace of cube c (variables fixed by c become free).
+Cover cofactor(const Cover& cover, const Cube& c)
+{
+	Cover res;
+	boost::dynamic_bitset<> fixed = c.literals();
+
+	for (const auto& d : cover)
+	{
+		if (!d.intersects(c))
+			continue;
+
+		Cube r = d;
+		r.zero |= fixed;
+		r.one |= fixed;
+		res.push_back(r);
+	}
+
+	return res;
+}
+
+//Unate recursive paradigm: split on the most binate variable until the cover is unate.
+//A unate cover is a tautology iff it contains the universal cube.
+bool isTautology(const Cover& cover)
+{
+	if (cover.empty())
+		return false;
+
+	for (const auto& c : cover)
+		if ((c.zero & c.one).all())
+			return true;
+
+	const int n = cover.front().zero.size();
+	int splitVar = -1;
+	int maxCount = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		int numZero = 0;
+		int numOne = 0;
+		for (const auto& c : cover)
+		{
+			numZero += c.zero[i] && !c.one[i];
+			numOne += c.one[i] && !c.zero[i];
+		}
+
+		if (numZero > 0 && numOne > 0 && numZero + numOne > maxCount)
+		{
+			maxCount = numZero + numOne;
+			splitVar = i;
+		}
+	}
+
+	if (splitVar == -1)
+		return false;
+
+	Cube c = cover.front();
+	c.zero.set();
+	c.one.set();
+
+	c.one[splitVar] = false;
+	if (!isTautology(cofactor(cover, c)))
+		return false;
+
+	c.one[splitVar] = true;
+	c.zero[splitVar] = false;
+	return isTautology(cofactor(cover, c));
+}
+
+bool isCovered(const Cube& c, const Cover& cover)
+{
+	return isTautology(cofactor(cover, c));
+}
+
+//Removes literals from the cubes as long as they stay inside of the function described by onSet. 
+//Cubes covered by an expanded cube are removed. Larger cubes are expanded first.
+Cover expand(Cover cover, const Cover& onSet)
+{
+	std::stable_sort(cover.begin(), cover.end(), [](const Cube& c0, const Cube& c1) { return c0.numLiterals() < c1.numLiterals(); });
+
+	Cover res;
+	for (auto c : cover)
+	{
+		bool covered = false;
+		for (const auto& r : res)
+			covered |= r.contains(c);
+		if (covered)
+			continue;
+
+		boost::dynamic_bitset<> literals = c.literals();
+		for (size_t i = literals.find_first(); i != boost::dynamic_bitset<>::npos && c.numLiterals() > 1; i = literals.find_next(i))
+		{
+			Cube expanded = c;
+			expanded.zero[i] = true;
+			expanded.one[i] = true;
+
+			if (isCovered(expanded, onSet))
+				c = expanded;
+		}
+
+		res.erase(std::remove_if(res.begin(), res.end(), [&c](const Cube& r) { return c.contains(r); }), res.end());
+		res.push_back(c);
+	}
+
+	return res;
+}
+
+//Removes cubes that are covered by the remaining cubes. Smaller cubes are removed first.
+Cover irredundant(Cover cover)
+{
+	std::stable_sort(cover.begin(), cover.end(), [](const Cube& c0, const Cube& c1) { return c0.numLiterals() > c1.numLiterals(); });
+
+	for (size_t i = 0; i < cover.size();)
+	{
+		Cover others = cover;
+		others.erase(others.begin() + i);
+
+		if (isCovered(cover[i], others))
+			cover = others;
+		else
+			i++;
+	}
+
+	return cover;
+}
+
+//Adds literals to the cubes as long as the removed part is still covered by the other cubes. 
+//Gives the next expand step the chance to expand the cubes in another direction.
+Cover reduce(Cover cover)
+{
+	for (size_t i = 0; i < cover.size(); ++i)
+	{
+		Cover others = cover;
+		others.erase(others.begin() + i);
+
+		Cube& c = cover[i];
+		boost::dynamic_bitset<> freeVars = c.zero & c.one;
+		for (size_t v = freeVars.find_first(); v != boost::dynamic_bitset<>::npos; v = freeVars.find_next(v))
+		{
+			for (int value = 0; value <= 1; ++value)
+			{
+				//Part of c that would be removed by fixing v to value.
+				Cube removed = c;
+				removed.zero[v] = value == 1;
+				removed.one[v] = value == 0;
+
+				if (isCovered(removed, others))
+				{
+					c.zero[v] = value == 0;
+					c.one[v] = value == 1;
+					break;
+				}
+			}
+		}
+	}
+
+	return cover;
+}
+
+std::tuple<size_t, size_t> cost(const Cover& cover)
+{
+	size_t numLiterals = 0;
+	for (const auto& c : cover)
+		numLiterals += c.numLiterals();
+
+	return std::make_tuple(numLiterals, cover.size());
+}
+
+lmu::DNF lmu::minimizeDNF(const DNF& dnf)
+{
+	Cover onSet;
+	for (const auto& clause : dnf.clauses)
+		onSet.push_back(Cube(clause));
+
+	if (onSet.empty())
+		return dnf;
+
+	Cover cover = irredundant(expand(onSet, onSet));
+	while (true)
+	{
+		Cover newCover = irredundant(expand(reduce(cover), onSet));
+		if (cost(newCover) >= cost(cover))
+			break;
+
+		cover = newCover;
+	}
+
+	DNF res;
+	res.functions = dnf.functions;
+	for (const auto& c : cover)
+		res.clauses.push_back(c.toClause());
+
+	LMU_LOG_INFO("Minimized DNF: " << std::get<1>(cost(onSet)) << " clauses / " << std::get<0>(cost(onSet)) << " literals -> " 
+		<< std::get<1>(cost(cover)) << " clauses / " << std::get<0>(cost(cover)) << " literals.");
+
+	return res;
+}
+
 std::string lmu::espressoExpression(const DNF& dnf)
 {
 	std::stringstream ss;
@@ -590,18 +1542,37 @@ std::string lmu::espressoExpression(const DNF& dnf)
 
 lmu::CSGNode lmu::computeShapiroWithPartitions(const std::vector<Graph>& partitions, const SampleParams& params)
 {
+	ShapiroCache::Scope cacheScope;
+
 	lmu::CSGNode res = lmu::op<Union>();
 
+	//Partitions are independent, largest partitions are started first.
+	std::vector<DNF> dnfs(partitions.size());
+	std::vector<double> sizes;
 	for (const auto& p : partitions)
+		sizes.push_back(numVertices(p));
+
+	lmu::parallelForLargestFirst(sizes, [&](int i)
 	{
-		std::cout << "component functions: " << std::endl;
-		for (const auto& f : lmu::getImplicitFunctions(p))
+		const auto& p = partitions[i];
+
+		if (LMU_LOG_ENABLED(lmu::LogLevel::Info))
 		{
-			std::cout << "f: " << f->name() << std::endl;
+			std::stringstream ss;
+			ss << "component functions: " << std::endl;
+			for (const auto& f : lmu::getImplicitFunctions(p))
+			{
+				ss << "f: " << f->name() << std::endl;
+			}
+			ss << "----";
+			LMU_LOG_INFO(ss.str());
 		}
-		std::cout << "----" << std::endl;
 
-		auto dnf = lmu::computeShapiro(lmu::getImplicitFunctions(p), true, p, params);
+		dnfs[i] = lmu::computeShapiro(lmu::getImplicitFunctions(p), true, p, params);
+	});
+
+	for (const auto& dnf : dnfs)
+	{
 		for (const auto& clause : dnf.clauses)
 		{
 			res.addChild(lmu::clauseToCSGNode(clause, dnf.functions));
@@ -614,20 +1585,23 @@ lmu::CSGNode lmu::computeShapiroWithPartitions(const std::vector<Graph>& partiti
 
 std::vector<lmu::Graph> lmu::getUnionPartitionsByPrimeImplicants(const lmu::Graph& graph, const SampleParams& params)
 {
+	ShapiroCache::Scope cacheScope;
+
 	auto functions = lmu::getImplicitFunctions(graph);
 	
 	auto outlierTestValues = computeOutlierTestValues(functions, params.h);
 
-	std::cout << "PARTITION BY PIs" << std::endl;
+	LMU_LOG_INFO("PARTITION BY PIs");
 
 	//Get prime implicants.
-	auto res = identifyPrimeImplicants(functions, outlierTestValues, graph, params);
+	ClauseScoringTable table;
+	auto res = identifyPrimeImplicants(functions, outlierTestValues, graph, params, table);
 	auto primeImplicants = std::get<0>(res).functions;
 
-	std::cout << "Found " << primeImplicants.size() << " prime implicants." << std::endl;
+	LMU_LOG_INFO("Found " << primeImplicants.size() << " prime implicants.");
 	for (const auto& f : primeImplicants)
 	{
-		std::cout << f->name() << std::endl;
+		LMU_LOG_INFO(f->name());
 	}
 
 	//Remove prime implicants from graph.	
@@ -699,7 +1673,7 @@ std::vector<lmu::Graph> lmu::getUnionPartitionsByPrimeImplicantsWithPruning(cons
 
 	for (const auto& c : components)
 	{
-		std::cout << "Component: " << numVertices(c) << std::endl;
+		LMU_LOG_INFO("Component: " << numVertices(c));
 
 		//Only search for bridges if component has more than 2 vertices.
 		if (numVertices(c) > 2)
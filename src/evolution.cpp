@@ -15,3 +15,12 @@ lmu::ScheduleType lmu::scheduleTypeFromString(std::string scheduleType)
 	return ScheduleType::IDENTITY;
 }
 
+lmu::MigrationTopology lmu::migrationTopologyFromString(std::string topology)
+{
+	std::transform(topology.begin(), topology.end(), topology.begin(), ::tolower);
+
+	if (topology == "full" || topology == "fullyconnected" || topology == "fully_connected")
+		return MigrationTopology::FULLY_CONNECTED;
+
+	return MigrationTopology::RING;
+}
@@ -1,9 +1,14 @@
 #include "helper.h"
 
+#include <mutex>
+
 std::default_random_engine lmu::rndEngine()
 {
 	static std::default_random_engine eng;
 	static std::random_device rd;
+	static std::mutex mutex;
+
+	std::lock_guard<std::mutex> lock(mutex);
 	eng.seed(rd());
 
 	return eng;
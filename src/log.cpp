@@ -0,0 +1,219 @@
+#include "log.h"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+std::atomic<int> lmu::g_logLevel((int)lmu::LogLevel::Info);
+
+//Sink shared by all threads. The file is only accessed with the mutex held.
+struct LogSink
+{
+	std::mutex mutex;
+	std::unique_ptr<std::ofstream> file;
+	std::atomic<int> format{ (int)lmu::LogFormat::Text };
+
+	void write(const std::string& s)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::ostream& os = file ? *file : std::cout;
+		os.write(s.data(), s.size());
+		os.flush();
+	}
+
+	//Never destroyed: the buffers of pool workers are flushed when ~ThreadPool joins them, which runs after the destructor 
+	//of a static sink if the pool was created first. Writes are flushed right away, so nothing is lost.
+	static LogSink& instance()
+	{
+		static LogSink* sink = new LogSink();
+		return *sink;
+	}
+};
+
+//Per thread record buffer, flushed to the sink when the thread exits.
+struct LogBuffer
+{
+	static const size_t capacity = 1 << 14;
+
+	~LogBuffer()
+	{
+		flush();
+	}
+
+	void flush()
+	{
+		if (data.empty())
+			return;
+
+		LogSink::instance().write(data);
+		data.clear();
+	}
+
+	std::string data;
+};
+
+thread_local LogBuffer t_logBuffer;
+
+const char* logLevelName(lmu::LogLevel level)
+{
+	switch (level)
+	{
+	case lmu::LogLevel::Error:
+		return "error";
+	case lmu::LogLevel::Warning:
+		return "warning";
+	case lmu::LogLevel::Info:
+		return "info";
+	case lmu::LogLevel::Debug:
+		return "debug";
+	case lmu::LogLevel::Trace:
+		return "trace";
+	default:
+		return "off";
+	}
+}
+
+void appendJsonString(std::string& s, const std::string& v)
+{
+	s += '"';
+	for (char c : v)
+	{
+		switch (c)
+		{
+		case '"':
+			s += "\\\"";
+			break;
+		case '\\':
+			s += "\\\\";
+			break;
+		case '\n':
+			s += "\\n";
+			break;
+		case '\t':
+			s += "\\t";
+			break;
+		case '\r':
+			s += "\\r";
+			break;
+		default:
+			s += c;
+		}
+	}
+	s += '"';
+}
+
+void lmu::setLogLevel(LogLevel level)
+{
+	g_logLevel = (int)level;
+}
+
+lmu::LogLevel lmu::logLevel()
+{
+	return (LogLevel)g_logLevel.load();
+}
+
+void lmu::setLogFormat(LogFormat format)
+{
+	LogSink::instance().format = (int)format;
+}
+
+void lmu::setLogFile(const std::string& path)
+{
+	flushLog();
+
+	LogSink& sink = LogSink::instance();
+	std::lock_guard<std::mutex> lock(sink.mutex);
+
+	if (path.empty())
+	{
+		sink.file.reset();
+		return;
+	}
+
+	auto file = std::make_unique<std::ofstream>(path, std::ios::app);
+	if (!file->is_open())
+		throw std::runtime_error("Could not open log file " + path + ".");
+
+	sink.file = std::move(file);
+}
+
+lmu::LogLevel lmu::logLevelFromString(const std::string& level)
+{
+	for (int i = (int)LogLevel::Off; i <= (int)LogLevel::Trace; ++i)
+	{
+		if (level == logLevelName((LogLevel)i))
+			return (LogLevel)i;
+	}
+
+	throw std::runtime_error("Unknown log level " + level + ".");
+}
+
+lmu::LogFormat lmu::logFormatFromString(const std::string& format)
+{
+	if (format == "text")
+		return LogFormat::Text;
+	if (format == "json")
+		return LogFormat::Json;
+
+	throw std::runtime_error("Unknown log format " + format + ".");
+}
+
+void lmu::flushLog()
+{
+	t_logBuffer.flush();
+}
+
+lmu::LogRecord::LogRecord(LogLevel level, const char* file, int line) :
+	_level(level),
+	_file(file),
+	_line(line)
+{
+}
+
+lmu::LogRecord::~LogRecord()
+{
+	std::string message = _stream.str();
+	std::string& buffer = t_logBuffer.data;
+
+	if (LogSink::instance().format == (int)LogFormat::Json)
+	{
+		const char* fileName = _file;
+		for (const char* c = _file; *c; ++c)
+		{
+			if (*c == '/' || *c == '\\')
+				fileName = c + 1;
+		}
+
+		std::ostringstream thread;
+		thread << std::this_thread::get_id();
+
+		buffer += "{\"level\":\"";
+		buffer += logLevelName(_level);
+		buffer += "\",\"thread\":\"";
+		buffer += thread.str();
+		buffer += "\",\"file\":";
+		appendJsonString(buffer, fileName);
+		buffer += ",\"line\":";
+		buffer += std::to_string(_line);
+		buffer += ",\"message\":";
+		appendJsonString(buffer, message);
+		buffer += "}\n";
+	}
+	else
+	{
+		if (_level <= LogLevel::Warning)
+		{
+			buffer += logLevelName(_level);
+			buffer += ": ";
+		}
+		buffer += message;
+		buffer += '\n';
+	}
+
+	//Only debug and trace records are frequent enough to be worth buffering.
+	if (_level <= LogLevel::Info || buffer.size() >= LogBuffer::capacity)
+		t_logBuffer.flush();
+}
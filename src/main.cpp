@@ -67,6 +67,11 @@ int main(int argc, char *argv[])
 	using namespace std;
 
 	//RUN_TEST(CSGNodeTest);
+	//RUN_TEST(CSGNodeSerializationTest);
+	//RUN_TEST(CollisionTest);
+	//RUN_TEST(DNFTest);
+	//RUN_TEST(ShapiroTest);
+	//RUN_TEST(RankCacheTest);
 
 
 	igl::opengl::glfw::Viewer viewer;
@@ -25,6 +25,7 @@
 #include "statistics.h"
 #include "constants.h"
 #include "params.h"
+#include "log.h"
 
 
 using namespace lmu;
@@ -79,6 +80,10 @@ int main(int argc, char *argv[])
 
   ParameterSet params(argv[3]);
   params.print();
+
+  lmu::setLogLevel(lmu::logLevelFromString(params.getStr("Logging", "Level", "info")));
+  lmu::setLogFormat(lmu::logFormatFromString(params.getStr("Logging", "Format", "text")));
+  lmu::setLogFile(params.getStr("Logging", "File", ""));
   
   double samplingStepSize = params.getDouble("Sampling", "StepSize", 0.0);
   double maxDistance = params.getDouble("Sampling", "MaxDistance", 0.03);
@@ -126,6 +131,9 @@ int main(int argc, char *argv[])
   // for the max-size computation for the trees.
   // * should we call optimizeCSGNodeStructure for each recoveryType? 
   
+  // Partitioning and reconstruction share the Shapiro results of the functions.
+  lmu::ShapiroCache::Scope shapiroCacheScope;
+
   if (partitionType == "none") 
   {
     if (recoveryType == "shapiro") {
@@ -180,6 +188,8 @@ int main(int argc, char *argv[])
 
   igl::writeOBJ(outBasename + "_mesh.obj", mesh.vertices, mesh.indices);
 
+  lmu::flushLog();
+
   
   //std::cout << lmu::espressoExpression(dnf) << std::endl;
 	
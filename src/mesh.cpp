@@ -12,6 +12,8 @@
 #include <igl/signed_distance.h>
 #include <igl/upsample.h>
 
+#include <boost/functional/hash.hpp>
+
 #include "../include/constants.h"
 
 
@@ -576,3 +578,20 @@ void lmu::writePrimitives(const std::string& filename,
     of << std::endl;
   }
 }
+
+size_t lmu::fingerprint(const std::vector<std::shared_ptr<ImplicitFunction>>& functions, size_t seed)
+{
+	for (const auto& f : functions)
+	{
+		boost::hash_combine(seed, f->name());
+		boost::hash_combine(seed, (int)f->type());
+		boost::hash_combine(seed, f->serializeTransform());
+		boost::hash_combine(seed, f->serializeParameters());
+
+		const auto& points = f->pointsCRef();
+		boost::hash_combine(seed, points.rows());
+		boost::hash_range(seed, points.data(), points.data() + points.size());
+	}
+
+	return seed;
+}
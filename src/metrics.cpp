@@ -0,0 +1,191 @@
+#include "metrics.h"
+#include "checkpoint.h"
+#include "log.h"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <sstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+//Columns of the CSV file, in the order of writeLine.
+const char* metricsColumns = "run,island,iteration,level_of_detail,best_score,worst_score,opt_us,ranking_us,sorting_us,scm_us,iteration_us,"
+	"evaluations,evaluated_points,points_per_second,cache_hits,cache_tries,cache_size,ranking_utilization,peak_memory_bytes";
+
+//Prometheus scrapes are usually several seconds apart, rewriting the file more often only costs I/O.
+const std::chrono::seconds prometheusWriteInterval(1);
+
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+	return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//JSON has no literals for NaN and infinity.
+std::string jsonNumber(double v)
+{
+	if (!std::isfinite(v))
+		return "null";
+
+	std::stringstream ss;
+	ss.precision(std::numeric_limits<double>::max_digits10);
+	ss << v;
+	return ss.str();
+}
+
+std::string runLabel(uint64_t run)
+{
+	std::stringstream ss;
+	ss << std::hex << run;
+	return ss.str();
+}
+
+std::shared_ptr<lmu::MetricsSink> lmu::MetricsSink::open(const std::string& file, const std::string& prometheusFile)
+{
+	//Never destroyed, like the sinks themselves they may be used until the process ends.
+	static std::mutex* mutex = new std::mutex();
+	static auto sinks = new std::map<std::pair<std::string, std::string>, std::shared_ptr<MetricsSink>>();
+
+	std::lock_guard<std::mutex> lock(*mutex);
+
+	auto& sink = (*sinks)[std::make_pair(file, prometheusFile)];
+	if (!sink)
+		sink = std::make_shared<MetricsSink>(file, prometheusFile);
+	return sink;
+}
+
+lmu::MetricsSink::MetricsSink(const std::string& file, const std::string& prometheusFile) :
+	_csv(endsWith(file, ".csv")),
+	_prometheusFile(prometheusFile),
+	_lastPrometheusWrite(std::chrono::steady_clock::now())
+{
+	if (!file.empty())
+	{
+		_file.open(file, std::ios::trunc);
+		if (!_file.is_open())
+			LMU_LOG_WARNING("Could not open metrics file " << file << ".");
+		else if (_csv)
+			_file << metricsColumns << std::endl;
+	}
+}
+
+lmu::MetricsSink::~MetricsSink()
+{
+	flush();
+}
+
+void lmu::MetricsSink::record(const IterationMetrics& metrics)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	IslandTotals& totals = _islands[std::make_pair(metrics.run, metrics.island)];
+	totals.latest = metrics;
+	totals.numEvaluations += metrics.numEvaluations;
+	totals.numEvaluatedPoints += metrics.numEvaluatedPoints;
+	totals.numCacheHits += metrics.numCacheHits;
+	totals.numCacheTries += metrics.numCacheTries;
+	totals.rankingMicroseconds += metrics.rankingMicroseconds;
+	totals.iterationMicroseconds += metrics.iterationMicroseconds();
+
+	if (_file.is_open())
+		writeLine(metrics);
+
+	if (!_prometheusFile.empty() && std::chrono::steady_clock::now() - _lastPrometheusWrite >= prometheusWriteInterval)
+		writePrometheusFile();
+}
+
+void lmu::MetricsSink::flush()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_file.is_open())
+		_file.flush();
+
+	if (!_prometheusFile.empty() && !_islands.empty())
+		writePrometheusFile();
+}
+
+void lmu::MetricsSink::writeLine(const IterationMetrics& m)
+{
+	//Lines are flushed right away, the file is read while the run is in progress.
+	if (_csv)
+	{
+		_file << runLabel(m.run) << "," << m.island << "," << m.iteration << "," << m.levelOfDetail << "," << jsonNumber(m.bestScore) << "," << jsonNumber(m.worstScore) << ","
+			<< m.optMicroseconds << "," << m.rankingMicroseconds << "," << m.sortingMicroseconds << "," << m.scmMicroseconds << "," << m.iterationMicroseconds() << ","
+			<< m.numEvaluations << "," << m.numEvaluatedPoints << "," << jsonNumber(m.pointsPerSecond()) << ","
+			<< m.numCacheHits << "," << m.numCacheTries << "," << m.cacheSize << "," << jsonNumber(m.rankingUtilization) << "," << m.peakMemoryBytes << std::endl;
+	}
+	else
+	{
+		_file << "{\"run\":\"" << runLabel(m.run) << "\",\"island\":" << m.island << ",\"iteration\":" << m.iteration << ",\"level_of_detail\":" << m.levelOfDetail
+			<< ",\"best_score\":" << jsonNumber(m.bestScore) << ",\"worst_score\":" << jsonNumber(m.worstScore)
+			<< ",\"opt_us\":" << m.optMicroseconds << ",\"ranking_us\":" << m.rankingMicroseconds << ",\"sorting_us\":" << m.sortingMicroseconds
+			<< ",\"scm_us\":" << m.scmMicroseconds << ",\"iteration_us\":" << m.iterationMicroseconds()
+			<< ",\"evaluations\":" << m.numEvaluations << ",\"evaluated_points\":" << m.numEvaluatedPoints << ",\"points_per_second\":" << jsonNumber(m.pointsPerSecond())
+			<< ",\"cache_hits\":" << m.numCacheHits << ",\"cache_tries\":" << m.numCacheTries << ",\"cache_size\":" << m.cacheSize
+			<< ",\"ranking_utilization\":" << jsonNumber(m.rankingUtilization) << ",\"peak_memory_bytes\":" << m.peakMemoryBytes << "}" << std::endl;
+	}
+}
+
+void lmu::MetricsSink::writePrometheusFile()
+{
+	std::stringstream ss;
+	ss.precision(std::numeric_limits<double>::max_digits10);
+
+	auto metric = [&](const std::string& name, const std::string& type, const std::string& help, const std::function<double(const IslandTotals&)>& value)
+	{
+		ss << "# HELP " << name << " " << help << "\n";
+		ss << "# TYPE " << name << " " << type << "\n";
+		for (const auto& island : _islands)
+			ss << name << "{run=\"" << runLabel(island.first.first) << "\",island=\"" << island.first.second << "\"} " << value(island.second) << "\n";
+	};
+
+	metric("lmu_ga_iteration", "gauge", "Last finished iteration.", [](const IslandTotals& t) { return t.latest.iteration; });
+	metric("lmu_ga_level_of_detail", "gauge", "Level of detail the population is ranked at (0 = full resolution).", [](const IslandTotals& t) { return t.latest.levelOfDetail; });
+	metric("lmu_ga_best_score", "gauge", "Best score of the last iteration.", [](const IslandTotals& t) { return t.latest.bestScore; });
+	metric("lmu_ga_worst_score", "gauge", "Worst score of the last iteration.", [](const IslandTotals& t) { return t.latest.worstScore; });
+	metric("lmu_ga_iteration_duration_microseconds", "gauge", "Duration of the last iteration.", [](const IslandTotals& t) { return t.latest.iterationMicroseconds(); });
+	metric("lmu_ga_ranking_duration_microseconds", "gauge", "Ranking duration of the last iteration.", [](const IslandTotals& t) { return t.latest.rankingMicroseconds; });
+	metric("lmu_ga_points_per_second", "gauge", "Points evaluated per second of ranking in the last iteration.", [](const IslandTotals& t) { return t.latest.pointsPerSecond(); });
+	metric("lmu_ga_ranking_utilization", "gauge", "Share of the parallel ranking time the threads were busy in the last iteration.", [](const IslandTotals& t) { return t.latest.rankingUtilization; });
+	metric("lmu_ga_cache_size", "gauge", "Number of cached ranks.", [](const IslandTotals& t) { return t.latest.cacheSize; });
+	metric("lmu_ga_evaluations_total", "counter", "Creatures ranked (not taken from a cache).", [](const IslandTotals& t) { return t.numEvaluations; });
+	metric("lmu_ga_evaluated_points_total", "counter", "Points evaluated while ranking.", [](const IslandTotals& t) { return t.numEvaluatedPoints; });
+	metric("lmu_ga_cache_hits_total", "counter", "Ranks taken from a cache.", [](const IslandTotals& t) { return t.numCacheHits; });
+	metric("lmu_ga_cache_tries_total", "counter", "Rank cache lookups.", [](const IslandTotals& t) { return t.numCacheTries; });
+	metric("lmu_ga_ranking_duration_microseconds_total", "counter", "Time spent ranking.", [](const IslandTotals& t) { return t.rankingMicroseconds; });
+	metric("lmu_ga_duration_microseconds_total", "counter", "Time spent in iterations.", [](const IslandTotals& t) { return t.iterationMicroseconds; });
+
+	ss << "# HELP lmu_process_peak_memory_bytes Peak resident memory of the process.\n";
+	ss << "# TYPE lmu_process_peak_memory_bytes gauge\n";
+	ss << "lmu_process_peak_memory_bytes " << peakMemoryUsage() << "\n";
+
+	writeFileAtomically(_prometheusFile, ss.str());
+	_lastPrometheusWrite = std::chrono::steady_clock::now();
+}
+
+size_t lmu::peakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	//Kilobytes on Linux.
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
@@ -1,6 +1,7 @@
 #include <fstream>
 #include <iostream>
 #include <random>
+#include <unordered_map>
 
 #include <Eigen/Core>
 #include <Eigen/Geometry>
@@ -212,6 +213,47 @@ lmu::PointCloud lmu::pointCloudFromMesh(const lmu::Mesh& mesh, double delta, dou
 	return res;
 }
 
+lmu::PointCloud lmu::voxelGridSubsample(const PointCloud& points, double voxelSize)
+{
+	if (points.rows() == 0 || voxelSize <= 0.0)
+		return points;
+
+	Eigen::Vector3d min = points.leftCols<3>().colwise().minCoeff().transpose();
+
+	//Cells in order of their first point, so the result does not depend on the hash map.
+	std::unordered_map<uint64_t, int> cellLookup;
+	std::vector<int> cellPoints;
+	std::vector<double> cellDistances;
+
+	for (int i = 0; i < points.rows(); ++i)
+	{
+		Eigen::Vector3d p = points.row(i).head<3>().transpose();
+		Eigen::Vector3d c = ((p - min) / voxelSize).array().floor();
+
+		//21 bits per coordinate are plenty for subsampling.
+		uint64_t key = ((uint64_t)c.x() & 0x1fffff) | (((uint64_t)c.y() & 0x1fffff) << 21) | (((uint64_t)c.z() & 0x1fffff) << 42);
+		double distance = (p - (min + (c.array() + 0.5).matrix() * voxelSize)).squaredNorm();
+
+		auto it = cellLookup.find(key);
+		if (it == cellLookup.end())
+		{
+			cellLookup[key] = cellPoints.size();
+			cellPoints.push_back(i);
+			cellDistances.push_back(distance);
+		}
+		else if (distance < cellDistances[it->second])
+		{
+			cellPoints[it->second] = i;
+			cellDistances[it->second] = distance;
+		}
+	}
+
+	PointCloud res(cellPoints.size(), 6);
+	for (size_t i = 0; i < cellPoints.size(); ++i)
+		res.row(i) = points.row(cellPoints[i]);
+
+	return res;
+}
 
 double computeAABBLength(Eigen::MatrixXd& points) {
   Eigen::VectorXd min = points.colwise().minCoeff();
@@ -0,0 +1,435 @@
+#include "rankcache.h"
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+uint64_t mixHash(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+lmu::RankCache::RankCache(size_t capacity, int numShards) :
+	_capacity(0),
+	_shardCapacity(0),
+	_numHits(0),
+	_numMisses(0),
+	_numEvictions(0)
+{
+	numShards = numShards < 1 ? 1 : numShards;
+	for (int i = 0; i < numShards; ++i)
+		_shards.push_back(std::make_unique<Shard>());
+
+	setCapacity(capacity);
+}
+
+void lmu::RankCache::setCapacity(size_t capacity)
+{
+	if (capacity == _capacity)
+		return;
+
+	clear();
+
+	_capacity = capacity;
+	_shardCapacity = capacity == 0 ? 0 : (capacity + _shards.size() - 1) / _shards.size();
+}
+
+size_t lmu::RankCache::capacity() const
+{
+	return _capacity;
+}
+
+bool lmu::RankCache::find(size_t hash, double& rank)
+{
+	Shard& s = shard(hash);
+	{
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		auto it = s.index.find(hash);
+		if (it != s.index.end())
+		{
+			Entry& entry = s.entries[it->second];
+			entry.referenced = true;
+			rank = entry.rank;
+
+			_numHits++;
+			return true;
+		}
+	}
+
+	_numMisses++;
+	return false;
+}
+
+bool lmu::RankCache::insert(size_t hash, double rank)
+{
+	Shard& s = shard(hash);
+	std::lock_guard<std::mutex> lock(s.mutex);
+
+	auto it = s.index.find(hash);
+	if (it != s.index.end())
+	{
+		s.entries[it->second].rank = rank;
+		return false;
+	}
+
+	//New entries are not referenced, creatures that are never seen again are the first to go.
+	if (_shardCapacity == 0 || s.entries.size() < _shardCapacity)
+	{
+		s.index[hash] = s.entries.size();
+		s.entries.push_back(Entry{ hash, rank, false });
+		return false;
+	}
+
+	while (s.entries[s.hand].referenced)
+	{
+		s.entries[s.hand].referenced = false;
+		s.hand = (s.hand + 1) % s.entries.size();
+	}
+
+	Entry& victim = s.entries[s.hand];
+	s.index.erase(victim.hash);
+	victim = Entry{ hash, rank, false };
+	s.index[hash] = s.hand;
+	s.hand = (s.hand + 1) % s.entries.size();
+
+	_numEvictions++;
+	return true;
+}
+
+void lmu::RankCache::clear()
+{
+	for (auto& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		s->entries.clear();
+		s->index.clear();
+		s->hand = 0;
+	}
+}
+
+size_t lmu::RankCache::size() const
+{
+	size_t size = 0;
+	for (auto& s : _shards)
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+		size += s->entries.size();
+	}
+	return size;
+}
+
+lmu::RankCache::Counters lmu::RankCache::counters() const
+{
+	Counters c;
+	c.numHits = _numHits.load();
+	c.numMisses = _numMisses.load();
+	c.numEvictions = _numEvictions.load();
+	return c;
+}
+
+void lmu::RankCache::writeTo(CheckpointWriter& writer) const
+{
+	writer.write<uint64_t>(_capacity);
+	writer.write<uint64_t>(_shards.size());
+
+	for (const auto& s : _shards)
+	{
+		writer.write<uint64_t>(s->hand);
+		writer.write<uint64_t>(s->entries.size());
+		for (const auto& entry : s->entries)
+		{
+			writer.write<uint64_t>(entry.hash);
+			writer.write(entry.rank);
+			writer.write<uint8_t>(entry.referenced);
+		}
+	}
+}
+
+void lmu::RankCache::readFrom(CheckpointReader& reader)
+{
+	clear();
+
+	const uint64_t capacity = reader.read<uint64_t>();
+	const uint64_t numShards = reader.read<uint64_t>();
+	const bool sameLayout = capacity == _capacity && numShards == _shards.size();
+
+	for (uint64_t i = 0; i < numShards; ++i)
+	{
+		const uint64_t hand = reader.read<uint64_t>();
+		const uint64_t numEntries = reader.read<uint64_t>();
+
+		std::vector<Entry> entries;
+		entries.reserve(numEntries);
+		for (uint64_t j = 0; j < numEntries; ++j)
+		{
+			Entry entry;
+			entry.hash = reader.read<uint64_t>();
+			entry.rank = reader.read<double>();
+			entry.referenced = reader.read<uint8_t>() != 0;
+			entries.push_back(entry);
+		}
+
+		if (!sameLayout)
+		{
+			for (const auto& entry : entries)
+				insert(entry.hash, entry.rank);
+			continue;
+		}
+
+		Shard& s = *_shards[i];
+		s.entries = std::move(entries);
+		s.hand = s.entries.empty() ? 0 : hand % s.entries.size();
+		for (size_t j = 0; j < s.entries.size(); ++j)
+			s.index[s.entries[j].hash] = j;
+	}
+}
+
+lmu::RankCache::Shard& lmu::RankCache::shard(size_t hash) const
+{
+	//Creature hashes need not be well distributed in the low bits, mix them before picking the shard.
+	return *_shards[mixHash(hash) % _shards.size()];
+}
+
+struct lmu::PersistentRankCache::Header
+{
+	char magic[8];
+	uint64_t version;
+	uint64_t numSlots;
+	uint64_t size;
+};
+
+//A slot with context 0 and hash 0 is empty.
+struct lmu::PersistentRankCache::Slot
+{
+	uint64_t context;
+	uint64_t hash;
+	double rank;
+};
+
+const char persistentRankCacheMagic[8] = { 'L', 'M', 'U', 'R', 'A', 'N', 'K', 0 };
+const uint64_t persistentRankCacheVersion = 1;
+const uint64_t persistentRankCacheInitialNumSlots = 1 << 16;
+
+lmu::PersistentRankCache::PersistentRankCache(const std::string& file) :
+	_file(file)
+{
+	//The lock is taken on a separate file: on POSIX, closing any handle of a locked file (as map() does) releases the lock.
+	const std::string lockFile = file + ".lock";
+	{
+		std::ofstream fs(lockFile, std::ios::binary | std::ios::app);
+		if (!fs.is_open())
+			throw std::runtime_error("Could not create rank cache lock file " + lockFile + ".");
+	}
+	_lock = std::make_unique<boost::interprocess::file_lock>(lockFile.c_str());
+	if (!_lock->try_lock())
+		throw std::runtime_error("Rank cache file " + file + " is used by another process.");
+
+	//Check the header and the file size before mapping, a broken file (e.g. from a crash while growing) is reset.
+	Header h;
+	std::memset(&h, 0, sizeof(Header));
+	uint64_t fileSize = 0;
+	{
+		std::ifstream fs(file, std::ios::binary | std::ios::ate);
+		if (fs.is_open())
+		{
+			fileSize = fs.tellg();
+			fs.seekg(0);
+			fs.read(reinterpret_cast<char*>(&h), sizeof(Header));
+		}
+	}
+
+	bool valid = fileSize >= sizeof(Header) &&
+		std::memcmp(h.magic, persistentRankCacheMagic, sizeof(h.magic)) == 0 &&
+		h.version == persistentRankCacheVersion &&
+		h.numSlots > 0 && (h.numSlots & (h.numSlots - 1)) == 0 &&
+		fileSize == sizeof(Header) + h.numSlots * sizeof(Slot);
+
+	if (valid)
+	{
+		map(h.numSlots);
+		return;
+	}
+
+	std::ofstream fs(file, std::ios::binary | std::ios::trunc);
+	if (!fs.is_open())
+		throw std::runtime_error("Could not create rank cache file " + file + ".");
+	fs.close();
+
+	map(persistentRankCacheInitialNumSlots);
+}
+
+lmu::PersistentRankCache::~PersistentRankCache()
+{
+	unmap();
+}
+
+std::shared_ptr<lmu::PersistentRankCache> lmu::PersistentRankCache::open(const std::string& file)
+{
+	static std::mutex mutex;
+	static std::map<std::string, std::weak_ptr<PersistentRankCache>> caches;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto cache = caches[file].lock();
+	if (!cache)
+	{
+		try
+		{
+			cache = std::shared_ptr<PersistentRankCache>(new PersistentRankCache(file));
+		}
+		catch (const boost::interprocess::interprocess_exception& ex)
+		{
+			throw std::runtime_error("Could not map rank cache file " + file + ": " + ex.what());
+		}
+		caches[file] = cache;
+	}
+
+	return cache;
+}
+
+bool lmu::PersistentRankCache::find(uint64_t context, uint64_t hash, double& rank) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Slot* slot = findSlot(context, hash);
+	if (slot->context == 0 && slot->hash == 0)
+		return false;
+
+	rank = slot->rank;
+	return true;
+}
+
+void lmu::PersistentRankCache::insert(uint64_t context, uint64_t hash, double rank)
+{
+	if (context == 0 && hash == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Slot* slot = findSlot(context, hash);
+	if (slot->context == context && slot->hash == hash)
+	{
+		slot->rank = rank;
+		return;
+	}
+
+	if ((header().size + 1) * 10 > header().numSlots * 7)
+	{
+		grow();
+		slot = findSlot(context, hash);
+	}
+
+	*slot = Slot{ context, hash, rank };
+	header().size++;
+}
+
+size_t lmu::PersistentRankCache::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return header().size;
+}
+
+std::string lmu::PersistentRankCache::file() const
+{
+	return _file;
+}
+
+void lmu::PersistentRankCache::flush()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_region->flush();
+}
+
+void lmu::PersistentRankCache::map(uint64_t numSlots)
+{
+	uint64_t fileSize = sizeof(Header) + numSlots * sizeof(Slot);
+
+	//Extend the file, new bytes read as zero (== empty slots).
+	{
+		std::fstream fs(_file, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+		if (!fs.is_open())
+			throw std::runtime_error("Could not open rank cache file " + _file + ".");
+		if ((uint64_t)fs.tellp() < fileSize)
+		{
+			fs.seekp(fileSize - 1);
+			fs.put(0);
+		}
+	}
+
+	_mapping = std::make_unique<boost::interprocess::file_mapping>(_file.c_str(), boost::interprocess::read_write);
+	_region = std::make_unique<boost::interprocess::mapped_region>(*_mapping, boost::interprocess::read_write);
+
+	Header& h = header();
+	if (h.numSlots != numSlots)
+	{
+		std::memcpy(h.magic, persistentRankCacheMagic, sizeof(h.magic));
+		h.version = persistentRankCacheVersion;
+		h.numSlots = numSlots;
+		h.size = 0;
+	}
+}
+
+void lmu::PersistentRankCache::unmap()
+{
+	if (_region)
+		_region->flush();
+
+	_region.reset();
+	_mapping.reset();
+}
+
+void lmu::PersistentRankCache::grow()
+{
+	std::vector<Slot> entries;
+	entries.reserve(header().size);
+
+	const uint64_t numSlots = header().numSlots;
+	for (uint64_t i = 0; i < numSlots; ++i)
+	{
+		if (slots()[i].context != 0 || slots()[i].hash != 0)
+			entries.push_back(slots()[i]);
+	}
+
+	//Invalidate the header first, the file is reset if the process dies before the table is rebuilt.
+	header().numSlots = 0;
+	std::memset(slots(), 0, numSlots * sizeof(Slot));
+	unmap();
+
+	map(numSlots * 2);
+
+	for (const auto& entry : entries)
+		*findSlot(entry.context, entry.hash) = entry;
+	header().size = entries.size();
+}
+
+lmu::PersistentRankCache::Header& lmu::PersistentRankCache::header() const
+{
+	return *static_cast<Header*>(_region->get_address());
+}
+
+lmu::PersistentRankCache::Slot* lmu::PersistentRankCache::slots() const
+{
+	return reinterpret_cast<Slot*>(static_cast<char*>(_region->get_address()) + sizeof(Header));
+}
+
+//Slot holding the key or the empty slot where the probe sequence ends. The table always has empty slots.
+lmu::PersistentRankCache::Slot* lmu::PersistentRankCache::findSlot(uint64_t context, uint64_t hash) const
+{
+	const uint64_t mask = header().numSlots - 1;
+	Slot* s = slots();
+
+	for (uint64_t i = mixHash(context ^ mixHash(hash)) & mask; ; i = (i + 1) & mask)
+	{
+		if ((s[i].context == context && s[i].hash == hash) || (s[i].context == 0 && s[i].hash == 0))
+			return &s[i];
+	}
+}
@@ -0,0 +1,248 @@
+#include "threadpool.h"
+
+//Pool and deque index of the worker running on the current thread (-1 if the thread is not a worker).
+thread_local lmu::ThreadPool* t_pool = nullptr;
+thread_local int t_workerIndex = -1;
+
+lmu::ThreadPool::ThreadPool(int numThreads) :
+	_numPendingTasks(0),
+	_stop(false)
+{
+	if (numThreads <= 0)
+		numThreads = std::thread::hardware_concurrency();
+	if (numThreads <= 0)
+		numThreads = 1;
+
+	for (int i = 0; i < numThreads; ++i)
+		_workers.push_back(std::make_unique<Worker>());
+
+	for (int i = 0; i < numThreads; ++i)
+		_threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+lmu::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_all();
+
+	for (auto& thread : _threads)
+		thread.join();
+}
+
+int lmu::ThreadPool::numThreads() const
+{
+	return _threads.size();
+}
+
+int lmu::ThreadPool::workerIndex() const
+{
+	return t_pool == this ? t_workerIndex : -1;
+}
+
+void lmu::ThreadPool::submit(Task task)
+{
+	if (t_pool == this)
+	{
+		Worker& worker = *_workers[t_workerIndex];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_sharedTasks.push_back(std::move(task));
+	}
+
+	//Lock before notifying so that no worker can miss the new task between checking the counter and waiting.
+	_numPendingTasks++;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+	}
+	_condition.notify_one();
+}
+
+bool lmu::ThreadPool::popTask(Task& task)
+{
+	const int numWorkers = _workers.size();
+	const int ownIndex = t_pool == this ? t_workerIndex : -1;
+
+	//Own tasks first (newest first).
+	if (ownIndex != -1)
+	{
+		Worker& worker = *_workers[ownIndex];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (!worker.tasks.empty())
+		{
+			task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+			_numPendingTasks--;
+			return true;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_sharedTasks.empty())
+		{
+			task = std::move(_sharedTasks.front());
+			_sharedTasks.pop_front();
+			_numPendingTasks--;
+			return true;
+		}
+	}
+
+	//Steal the oldest task of another worker.
+	for (int i = 1; i <= numWorkers; ++i)
+	{
+		Worker& victim = *_workers[(ownIndex + i + numWorkers) % numWorkers];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			_numPendingTasks--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool lmu::ThreadPool::runPendingTask()
+{
+	Task task;
+	if (!popTask(task))
+		return false;
+
+	task();
+	return true;
+}
+
+void lmu::ThreadPool::work(int workerIndex)
+{
+	t_pool = this;
+	t_workerIndex = workerIndex;
+
+	while (true)
+	{
+		if (runPendingTask())
+			continue;
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_condition.wait(lock, [this]() { return _stop || _numPendingTasks > 0; });
+
+		if (_stop)
+			return;
+	}
+}
+
+lmu::ThreadPool& lmu::ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+struct lmu::TaskGroup::State
+{
+	std::deque<Task> tasks;
+	//Queued and running tasks.
+	int numPendingTasks = 0;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::exception_ptr exception;
+
+	//Runs the next queued task. Returns false if there was none.
+	bool runNextTask()
+	{
+		Task task;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (tasks.empty())
+				return false;
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		std::exception_ptr taskException;
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			taskException = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (taskException && !exception)
+				exception = taskException;
+			numPendingTasks--;
+		}
+		condition.notify_all();
+
+		return true;
+	}
+};
+
+lmu::TaskGroup::TaskGroup(ThreadPool& pool) :
+	_pool(pool),
+	_state(std::make_shared<State>())
+{
+}
+
+lmu::TaskGroup::~TaskGroup()
+{
+	//Tasks reference data of the creator of the group, it must not go away before they are done.
+	waitForTasks();
+}
+
+void lmu::TaskGroup::run(Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		_state->tasks.push_back(std::move(task));
+		_state->numPendingTasks++;
+	}
+	_state->condition.notify_all();
+
+	//One ticket per task. Tickets that find the queue empty (the waiting thread took the task) do nothing.
+	std::shared_ptr<State> state = _state;
+	_pool.submit([state]()
+	{
+		state->runNextTask();
+	});
+}
+
+void lmu::TaskGroup::waitForTasks()
+{
+	while (true)
+	{
+		if (_state->runNextTask())
+			continue;
+
+		//All tasks are claimed. Wait for the running ones, or for new ones they add to the group.
+		std::unique_lock<std::mutex> lock(_state->mutex);
+		_state->condition.wait(lock, [this]() { return _state->numPendingTasks == 0 || !_state->tasks.empty(); });
+		if (_state->numPendingTasks == 0)
+			return;
+	}
+}
+
+void lmu::TaskGroup::wait()
+{
+	waitForTasks();
+
+	std::exception_ptr exception;
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		std::swap(exception, _state->exception);
+	}
+
+	if (exception)
+		std::rethrow_exception(exception);
+}
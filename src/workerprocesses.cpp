@@ -0,0 +1,318 @@
+#include "workerprocesses.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/prctl.h>
+#endif
+
+#ifndef _WIN32
+
+bool readAll(int fd, void* data, size_t size)
+{
+	char* p = static_cast<char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+//Like readAll, but gives up when nothing arrives within timeoutMilliseconds (<= 0 => waits forever).
+bool readAllWithin(int fd, void* data, size_t size, int timeoutMilliseconds, bool& timedOut)
+{
+	timedOut = false;
+	if (timeoutMilliseconds <= 0)
+		return readAll(fd, data, size);
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+
+	char* p = static_cast<char*>(data);
+	while (size > 0)
+	{
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (remaining <= 0)
+		{
+			timedOut = true;
+			return false;
+		}
+
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		int ready = poll(&pfd, 1, (int)remaining);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0)
+			return false;
+		if (ready == 0)
+		{
+			timedOut = true;
+			return false;
+		}
+
+		//Also readable if the worker closed the pipe, read then returns 0.
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size > 0)
+	{
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+//Loop of a worker process: request = size + ints, result = double (NaN if the handler failed).
+void runWorker(int requestFd, int resultFd, const lmu::WorkerProcesses::Handler& handler)
+{
+	std::vector<int> request;
+	while (true)
+	{
+		uint32_t size;
+		if (!readAll(requestFd, &size, sizeof(size)))
+			break;
+
+		request.resize(size);
+		if (!readAll(requestFd, request.data(), size * sizeof(int)))
+			break;
+
+		double result;
+		try
+		{
+			result = handler(request);
+		}
+		catch (...)
+		{
+			result = std::numeric_limits<double>::quiet_NaN();
+		}
+
+		if (!writeAll(resultFd, &result, sizeof(result)))
+			break;
+	}
+}
+
+#endif
+
+lmu::WorkerProcesses::WorkerProcesses(int numWorkers, const Handler& handler, bool pinWorkers, int timeoutMilliseconds) :
+	_handler(handler),
+	_pinWorkers(pinWorkers),
+	_timeoutMilliseconds(timeoutMilliseconds),
+	_workers(numWorkers < 1 ? 1 : numWorkers)
+{
+	if (!isSupported())
+		throw std::runtime_error("Worker processes are not supported on this platform.");
+
+#ifndef _WIN32
+	//A worker that died must not kill the coordinator when it writes the next request.
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	std::lock_guard<std::mutex> lock(_forkMutex);
+	for (int i = 0; i < (int)_workers.size(); ++i)
+	{
+		start(i);
+		_idleWorkers.push_back(i);
+	}
+}
+
+lmu::WorkerProcesses::~WorkerProcesses()
+{
+	std::lock_guard<std::mutex> lock(_forkMutex);
+	for (int i = 0; i < (int)_workers.size(); ++i)
+		stop(i);
+}
+
+bool lmu::WorkerProcesses::isSupported()
+{
+#ifdef _WIN32
+	return false;
+#else
+	return true;
+#endif
+}
+
+int lmu::WorkerProcesses::numWorkers() const
+{
+	return _workers.size();
+}
+
+double lmu::WorkerProcesses::call(const std::vector<int>& request)
+{
+#ifdef _WIN32
+	throw std::runtime_error("Worker processes are not supported on this platform.");
+#else
+	int idx;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_condition.wait(lock, [this]() { return !_idleWorkers.empty(); });
+		idx = _idleWorkers.back();
+		_idleWorkers.pop_back();
+	}
+
+	Worker worker;
+	{
+		std::lock_guard<std::mutex> lock(_forkMutex);
+		worker = _workers[idx];
+	}
+
+	uint32_t size = request.size();
+	double result = std::numeric_limits<double>::quiet_NaN();
+	bool timedOut = false;
+	bool ok = writeAll(worker.requestFd, &size, sizeof(size)) &&
+		writeAll(worker.requestFd, request.data(), size * sizeof(int)) &&
+		readAllWithin(worker.resultFd, &result, sizeof(result), _timeoutMilliseconds, timedOut);
+
+	//Replace a worker that does not respond properly (or in time), it could be in any state.
+	if (!ok)
+	{
+		std::lock_guard<std::mutex> lock(_forkMutex);
+		stop(idx);
+		start(idx);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_idleWorkers.push_back(idx);
+	}
+	_condition.notify_one();
+
+	if (timedOut)
+		throw std::runtime_error("Worker process " + std::to_string(idx) + " timed out after " + std::to_string(_timeoutMilliseconds) + " ms.");
+	if (!ok)
+		throw std::runtime_error("Worker process " + std::to_string(idx) + " died.");
+	if (std::isnan(result))
+		throw std::runtime_error("Worker process " + std::to_string(idx) + " failed to handle the request.");
+
+	return result;
+#endif
+}
+
+void lmu::WorkerProcesses::start(int idx)
+{
+#ifndef _WIN32
+	int requestPipe[2];
+	int resultPipe[2];
+	if (pipe(requestPipe) != 0)
+		throw std::runtime_error("Could not create pipe for worker process.");
+	if (pipe(resultPipe) != 0)
+	{
+		close(requestPipe[0]);
+		close(requestPipe[1]);
+		throw std::runtime_error("Could not create pipe for worker process.");
+	}
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(requestPipe[0]);
+		close(requestPipe[1]);
+		close(resultPipe[0]);
+		close(resultPipe[1]);
+		throw std::runtime_error("Could not fork worker process.");
+	}
+
+	if (pid == 0)
+	{
+		close(requestPipe[1]);
+		close(resultPipe[0]);
+
+		//Pipes of the other workers were inherited, close them so that workers notice when the coordinator goes away.
+		for (const auto& other : _workers)
+		{
+			if (other.requestFd != -1)
+				close(other.requestFd);
+			if (other.resultFd != -1)
+				close(other.resultFd);
+		}
+
+#ifdef __linux__
+		//Do not outlive the coordinator (the forking thread), other processes forked from it may keep the request pipe open.
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+		if (_pinWorkers)
+		{
+			long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+			if (numCpus > 0)
+			{
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				CPU_SET(idx % numCpus, &cpus);
+				sched_setaffinity(0, sizeof(cpus), &cpus);
+			}
+		}
+#endif
+
+		runWorker(requestPipe[0], resultPipe[1], _handler);
+
+		//No static destructors, they would e.g. wait for threads that only exist in the coordinator.
+		_exit(0);
+	}
+
+	close(requestPipe[0]);
+	close(resultPipe[1]);
+
+	_workers[idx].pid = pid;
+	_workers[idx].requestFd = requestPipe[1];
+	_workers[idx].resultFd = resultPipe[0];
+#endif
+}
+
+void lmu::WorkerProcesses::stop(int idx)
+{
+#ifndef _WIN32
+	Worker& worker = _workers[idx];
+	if (worker.pid == -1)
+		return;
+
+	//Workers hold no state. They are killed instead of waiting for them to see the closed pipe, 
+	//which may never happen if other forked processes inherited its write end.
+	close(worker.requestFd);
+	close(worker.resultFd);
+	kill(worker.pid, SIGKILL);
+	waitpid(worker.pid, nullptr, 0);
+
+	worker = Worker();
+#endif
+}